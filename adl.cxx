@@ -0,0 +1,678 @@
+// Analysis description language (ADL) benchmark queries on the Events tree of
+// the CMS dataset, adapted to its NanoAOD schema
+// (https://github.com/iris-hep/adl-benchmarks-index)
+
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleView.hxx>
+
+#include <TH1D.h>
+
+#include <arrow/io/api.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/exception.h>
+#include <arrow/adapters/orc/adapter.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "memory_pool.hxx"
+#include "metadata_cache.hxx"
+#include "read_trace.hxx"
+#include "reader_pool.hxx"
+#include "server.hxx"
+#include "throttled_file.hxx"
+#include "util.hxx"
+
+using AdlSchema_t = Schema<
+    float, float,
+    // Jet
+    ROOT::RVec<float>, ROOT::RVec<float>, ROOT::RVec<float>, ROOT::RVec<float>,
+    // Muon
+    ROOT::RVec<float>, ROOT::RVec<float>, ROOT::RVec<float>, ROOT::RVec<float>,
+    ROOT::RVec<std::int32_t>,
+    // Electron
+    ROOT::RVec<float>, ROOT::RVec<float>, ROOT::RVec<float>, ROOT::RVec<float>,
+    ROOT::RVec<std::int32_t>>;
+
+// Column ids in adlSchema
+enum : std::size_t {
+  kMetPt,
+  kMetPhi,
+  kJetPt,
+  kJetEta,
+  kJetPhi,
+  kJetMass,
+  kMuonPt,
+  kMuonEta,
+  kMuonPhi,
+  kMuonMass,
+  kMuonCharge,
+  kElectronPt,
+  kElectronEta,
+  kElectronPhi,
+  kElectronMass,
+  kElectronCharge,
+};
+
+const AdlSchema_t adlSchema({
+    "MET_pt",
+    "MET_phi",
+    "Jet_pt",
+    "Jet_eta",
+    "Jet_phi",
+    "Jet_mass",
+    "Muon_pt",
+    "Muon_eta",
+    "Muon_phi",
+    "Muon_mass",
+    "Muon_charge",
+    "Electron_pt",
+    "Electron_eta",
+    "Electron_phi",
+    "Electron_mass",
+    "Electron_charge",
+});
+
+// The values of one entry, only the columns read by the query are set. The
+// list values stay in the buffers they were read into and are valid until the
+// next entry.
+struct Event {
+  float MET_pt = 0;
+  float MET_phi = 0;
+  ValueRange<float> Jet_pt, Jet_eta, Jet_phi, Jet_mass;
+  ValueRange<float> Muon_pt, Muon_eta, Muon_phi, Muon_mass;
+  ValueRange<std::int32_t> Muon_charge;
+  ValueRange<float> Electron_pt, Electron_eta, Electron_phi, Electron_mass;
+  ValueRange<std::int32_t> Electron_charge;
+};
+
+// The member of Event for every column of adlSchema
+const auto eventMembers = std::make_tuple(
+    &Event::MET_pt,
+    &Event::MET_phi,
+    &Event::Jet_pt,
+    &Event::Jet_eta,
+    &Event::Jet_phi,
+    &Event::Jet_mass,
+    &Event::Muon_pt,
+    &Event::Muon_eta,
+    &Event::Muon_phi,
+    &Event::Muon_mass,
+    &Event::Muon_charge,
+    &Event::Electron_pt,
+    &Event::Electron_eta,
+    &Event::Electron_phi,
+    &Event::Electron_mass,
+    &Event::Electron_charge);
+
+struct FourVector {
+  float x = 0;
+  float y = 0;
+  float z = 0;
+  float e = 0;
+
+  static FourVector FromPtEtaPhiM(float pt, float eta, float phi, float mass) {
+    FourVector v;
+    v.x = pt * std::cos(phi);
+    v.y = pt * std::sin(phi);
+    v.z = pt * std::sinh(eta);
+    v.e = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z + mass * mass);
+    return v;
+  }
+
+  FourVector operator+(const FourVector &other) const {
+    return {x + other.x, y + other.y, z + other.z, e + other.e};
+  }
+
+  float Pt() const { return std::sqrt(x * x + y * y); }
+  // With (+, -, -, -) metric
+  float M() const {
+    return std::sqrt(std::max(e * e - x * x - y * y - z * z, 0.f));
+  }
+};
+
+static float delta_r(float eta1, float phi1, float eta2, float phi2) {
+  auto dPhi = std::remainder(phi1 - phi2, 2 * M_PI);
+  auto dEta = eta1 - eta2;
+  return std::sqrt(dEta * dEta + dPhi * dPhi);
+}
+
+// Electron or muon
+struct Lepton {
+  FourVector p4;
+  float pt, eta, phi;
+  std::int32_t charge;
+  bool isMuon;
+};
+
+static std::vector<Lepton> get_leptons(const Event &event) {
+  std::vector<Lepton> leptons;
+  for (std::size_t i = 0; i < event.Muon_pt.size(); ++i) {
+    leptons.push_back({FourVector::FromPtEtaPhiM(
+                           event.Muon_pt[i], event.Muon_eta[i],
+                           event.Muon_phi[i], event.Muon_mass[i]),
+                       event.Muon_pt[i], event.Muon_eta[i], event.Muon_phi[i],
+                       event.Muon_charge[i], true});
+  }
+  for (std::size_t i = 0; i < event.Electron_pt.size(); ++i) {
+    leptons.push_back({FourVector::FromPtEtaPhiM(
+                           event.Electron_pt[i], event.Electron_eta[i],
+                           event.Electron_phi[i], event.Electron_mass[i]),
+                       event.Electron_pt[i], event.Electron_eta[i],
+                       event.Electron_phi[i], event.Electron_charge[i], false});
+  }
+  return leptons;
+}
+
+struct Query {
+  std::string name;
+  std::string description;
+  // Column ids in adlSchema
+  std::vector<std::size_t> columns;
+  int nBins;
+  double low;
+  double high;
+  void (*fill)(const Event &event, TH1D *hist);
+};
+
+const std::vector<Query> queries = {
+  {"q1", "MET of all events",
+   {kMetPt}, 100, 0, 200,
+   [](const Event &event, TH1D *hist) { hist->Fill(event.MET_pt); }},
+
+  {"q2", "pT of all jets",
+   {kJetPt}, 100, 15, 60,
+   [](const Event &event, TH1D *hist) {
+     for (auto pt : event.Jet_pt)
+       hist->Fill(pt);
+   }},
+
+  {"q3", "pT of jets with |eta| < 1",
+   {kJetPt, kJetEta}, 100, 15, 60,
+   [](const Event &event, TH1D *hist) {
+     for (std::size_t i = 0; i < event.Jet_pt.size(); ++i) {
+       if (std::abs(event.Jet_eta[i]) < 1)
+         hist->Fill(event.Jet_pt[i]);
+     }
+   }},
+
+  {"q4", "MET of events with at least two jets with pT > 40 GeV",
+   {kMetPt, kJetPt}, 100, 0, 200,
+   [](const Event &event, TH1D *hist) {
+     unsigned nJets = 0;
+     for (auto pt : event.Jet_pt)
+       nJets += pt > 40;
+     if (nJets >= 2)
+       hist->Fill(event.MET_pt);
+   }},
+
+  {"q5", "MET of events with an opposite-charge muon pair with "
+         "60 < mass < 120 GeV",
+   {kMetPt, kMuonPt, kMuonEta, kMuonPhi, kMuonMass, kMuonCharge},
+   100, 0, 200,
+   [](const Event &event, TH1D *hist) {
+     auto nMuons = event.Muon_pt.size();
+     for (std::size_t i = 0; i < nMuons; ++i) {
+       auto p1 = FourVector::FromPtEtaPhiM(event.Muon_pt[i], event.Muon_eta[i],
+                                           event.Muon_phi[i],
+                                           event.Muon_mass[i]);
+       for (std::size_t j = i + 1; j < nMuons; ++j) {
+         if (event.Muon_charge[i] == event.Muon_charge[j])
+           continue;
+         auto p2 = FourVector::FromPtEtaPhiM(
+             event.Muon_pt[j], event.Muon_eta[j], event.Muon_phi[j],
+             event.Muon_mass[j]);
+         auto mass = (p1 + p2).M();
+         if (mass > 60 && mass < 120) {
+           hist->Fill(event.MET_pt);
+           return;
+         }
+       }
+     }
+   }},
+
+  {"q6", "pT of the trijet system with the mass closest to 172.5 GeV",
+   {kJetPt, kJetEta, kJetPhi, kJetMass}, 100, 15, 40,
+   [](const Event &event, TH1D *hist) {
+     auto nJets = event.Jet_pt.size();
+     if (nJets < 3)
+       return;
+     std::vector<FourVector> jets;
+     for (std::size_t i = 0; i < nJets; ++i) {
+       jets.push_back(FourVector::FromPtEtaPhiM(
+           event.Jet_pt[i], event.Jet_eta[i], event.Jet_phi[i],
+           event.Jet_mass[i]));
+     }
+     float bestDistance = -1;
+     float bestPt = 0;
+     for (std::size_t i = 0; i < nJets; ++i) {
+       for (std::size_t j = i + 1; j < nJets; ++j) {
+         for (std::size_t k = j + 1; k < nJets; ++k) {
+           auto trijet = jets[i] + jets[j] + jets[k];
+           auto distance = std::abs(trijet.M() - 172.5f);
+           if (bestDistance < 0 || distance < bestDistance) {
+             bestDistance = distance;
+             bestPt = trijet.Pt();
+           }
+         }
+       }
+     }
+     hist->Fill(bestPt);
+   }},
+
+  {"q7", "scalar sum of the pT of jets with pT > 30 GeV that are not within "
+         "dR < 0.4 of a lepton with pT > 10 GeV",
+   {kJetPt, kJetEta, kJetPhi, kMuonPt, kMuonEta, kMuonPhi,
+    kElectronPt, kElectronEta, kElectronPhi},
+   100, 15, 200,
+   [](const Event &event, TH1D *hist) {
+     auto isolated = [&](std::size_t jet, const ValueRange<float> &pt,
+                         const ValueRange<float> &eta,
+                         const ValueRange<float> &phi) {
+       for (std::size_t i = 0; i < pt.size(); ++i) {
+         if (pt[i] > 10 && delta_r(event.Jet_eta[jet], event.Jet_phi[jet],
+                                   eta[i], phi[i]) < 0.4)
+           return false;
+       }
+       return true;
+     };
+     float sumPt = 0;
+     for (std::size_t i = 0; i < event.Jet_pt.size(); ++i) {
+       if (event.Jet_pt[i] > 30 &&
+           isolated(i, event.Muon_pt, event.Muon_eta, event.Muon_phi) &&
+           isolated(i, event.Electron_pt, event.Electron_eta,
+                    event.Electron_phi))
+         sumPt += event.Jet_pt[i];
+     }
+     hist->Fill(sumPt);
+   }},
+
+  {"q8", "transverse mass of the MET and the leading lepton not in the "
+         "same-flavor opposite-charge pair closest to 91.2 GeV, in events "
+         "with at least three leptons",
+   {kMetPt, kMetPhi, kMuonPt, kMuonEta, kMuonPhi, kMuonMass,
+    kMuonCharge, kElectronPt, kElectronEta, kElectronPhi,
+    kElectronMass, kElectronCharge},
+   100, 15, 250,
+   [](const Event &event, TH1D *hist) {
+     if (event.Muon_pt.size() + event.Electron_pt.size() < 3)
+       return;
+     auto leptons = get_leptons(event);
+     float bestDistance = -1;
+     std::size_t bestI = 0, bestJ = 0;
+     for (std::size_t i = 0; i < leptons.size(); ++i) {
+       for (std::size_t j = i + 1; j < leptons.size(); ++j) {
+         if (leptons[i].isMuon != leptons[j].isMuon ||
+             leptons[i].charge == leptons[j].charge)
+           continue;
+         auto distance =
+             std::abs((leptons[i].p4 + leptons[j].p4).M() - 91.2f);
+         if (bestDistance < 0 || distance < bestDistance) {
+           bestDistance = distance;
+           bestI = i;
+           bestJ = j;
+         }
+       }
+     }
+     if (bestDistance < 0)
+       return;
+
+     const Lepton *leading = nullptr;
+     for (std::size_t i = 0; i < leptons.size(); ++i) {
+       if (i != bestI && i != bestJ &&
+           (!leading || leptons[i].pt > leading->pt))
+         leading = &leptons[i];
+     }
+     auto mt = std::sqrt(2 * leading->pt * event.MET_pt *
+                         (1 - std::cos(leading->phi - event.MET_phi)));
+     hist->Fill(mt);
+   }},
+};
+
+static const Query *find_query(const std::string &name) {
+  for (const auto &query : queries) {
+    if (query.name == name)
+      return &query;
+  }
+  return nullptr;
+}
+
+// Typed access to the entries of one cluster of an RNTuple, like RNTupleBatch,
+// except that list columns are read through RVec views so that the values of an
+// entry are contiguous
+template <typename SchemaT>
+class RNTupleViewBatch;
+
+template <typename... Ts>
+class RNTupleViewBatch<Schema<Ts...>> {
+public:
+  RNTupleViewBatch(const Schema<Ts...> &schema, ROOT::RNTupleReader &reader,
+                   const std::vector<std::size_t> &columns) {
+    Open(schema, reader, columns, std::index_sequence_for<Ts...>{});
+  }
+
+  void SetEntryRange(std::uint64_t firstEntry, std::uint64_t lastEntry) {
+    fFirstEntry = firstEntry;
+    fNEntries = lastEntry - firstEntry;
+  }
+
+  std::int64_t GetNEntries() const { return fNEntries; }
+
+  template <std::size_t I>
+  const auto &Get(std::int64_t entry) {
+    return (*std::get<I>(fViews))(fFirstEntry + entry);
+  }
+
+private:
+  template <std::size_t... Is>
+  void Open(const Schema<Ts...> &schema, ROOT::RNTupleReader &reader,
+            const std::vector<std::size_t> &columns,
+            std::index_sequence<Is...>) {
+    ((std::find(columns.begin(), columns.end(), Is) != columns.end()
+          ? (void)std::get<Is>(fViews).emplace(
+                reader.GetView<Ts>(schema.GetName(Is)))
+          : (void)0),
+     ...);
+  }
+
+  std::tuple<std::optional<ROOT::RNTupleView<Ts>>...> fViews;
+  std::uint64_t fFirstEntry = 0;
+  std::int64_t fNEntries = 0;
+};
+
+// Flat values are copied into the event, list values are referenced
+static void set_value(float value, float *member) { *member = value; }
+
+template <typename T>
+static void set_value(const ValueRange<T> &values, ValueRange<T> *member) {
+  *member = values;
+}
+
+template <typename T>
+static void set_value(const ROOT::RVec<T> &values, ValueRange<T> *member) {
+  *member = ValueRange<T>(values.data(), values.size());
+}
+
+using ColumnMask_t = std::array<bool, AdlSchema_t::kNColumns>;
+
+template <typename BatchT, std::size_t... Is>
+static void fill_event(BatchT &batch, std::int64_t entry,
+                       const ColumnMask_t &columns, Event *event,
+                       std::index_sequence<Is...>) {
+  ((columns[Is] ? set_value(get_column<Is>(batch, entry),
+                            &(event->*std::get<Is>(eventMembers)))
+                : void()),
+   ...);
+}
+
+// Runs the query on the entries of the batch. Compiled for every batch type,
+// see ArrowBatch and RNTupleViewBatch.
+template <typename BatchT>
+static void process_batch(const Query &query, BatchT &batch, TH1D *hist) {
+  ColumnMask_t columns{};
+  for (auto column : query.columns)
+    columns[column] = true;
+
+  Event event;
+  for (std::int64_t entry = 0; entry < batch.GetNEntries(); ++entry) {
+    fill_event(batch, entry, columns, &event,
+               std::make_index_sequence<AdlSchema_t::kNColumns>{});
+    query.fill(event, hist);
+  }
+}
+
+static AnalysisTime_t analysis_orc(const Query &query,
+                                   const AnalysisOptions &opts,
+                                   const WorkerSlice &slice,
+                                   const AnalysisCaches &caches, TH1D *hist) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto pool = get_memory_pool(opts);
+  auto input = acquire_orc(opts, caches);
+  auto &reader = input->reader;
+  auto nStripes = reader->NumberOfStripes();
+  auto stripes = get_unit_range(nStripes, slice);
+  const ArrowBinding binding(adlSchema, query.columns, input->schema.get());
+
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
+
+  for (std::int64_t stripe = stripes.first; stripe < stripes.second;
+       ++stripe) {
+    TraceContext unitContext("stripe " + std::to_string(stripe));
+    pool->CountUnit();
+    std::shared_ptr<arrow::RecordBatch> recordBatch;
+    PARQUET_ASSIGN_OR_THROW(
+        recordBatch, reader->ReadStripe(stripe, binding.GetColumnNames()));
+    ArrowBatch batch(binding, *recordBatch);
+    process_batch(query, batch, hist);
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_init =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_first - ts_init)
+          .count();
+  auto runtime_analyze =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
+          .count();
+
+  return std::make_pair(runtime_init, runtime_analyze);
+}
+
+static AnalysisTime_t analysis_parquet(const Query &query,
+                                       const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches,
+                                       TH1D *hist) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto pool = get_memory_pool(opts);
+
+  auto reader = acquire_parquet(opts, caches);
+  auto row_groups = get_unit_range(reader->num_row_groups(), slice);
+  std::shared_ptr<arrow::Table> table;
+
+  std::shared_ptr<arrow::Schema> schema;
+  PARQUET_THROW_NOT_OK(reader->GetSchema(&schema));
+  const ArrowBinding binding(adlSchema, query.columns, schema.get());
+
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
+
+  for (std::int64_t row_group = row_groups.first;
+       row_group < row_groups.second; ++row_group) {
+    TraceContext unitContext("row group " + std::to_string(row_group));
+    pool->CountUnit();
+    PARQUET_THROW_NOT_OK(reader->ReadRowGroup(
+        row_group, binding.GetFieldIndices(), &table));
+    std::shared_ptr<arrow::RecordBatch> recordBatch;
+    PARQUET_ASSIGN_OR_THROW(recordBatch, table->CombineChunksToBatch(pool));
+    ArrowBatch batch(binding, *recordBatch);
+    process_batch(query, batch, hist);
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_init =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_first - ts_init)
+          .count();
+  auto runtime_analyze =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
+          .count();
+
+  return std::make_pair(runtime_init, runtime_analyze);
+}
+
+static AnalysisTime_t analysis_rntuple(const Query &query,
+                                       const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches,
+                                       TH1D *hist) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto ntuple = acquire_rntuple("Events", opts, caches);
+  auto clusterBoundaries = get_cluster_boundaries(ntuple->GetDescriptor());
+  auto clusters = get_unit_range(clusterBoundaries.size() - 1, slice);
+
+  RNTupleViewBatch<AdlSchema_t> batch(adlSchema, *ntuple, query.columns);
+
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
+
+  for (auto cluster = clusters.first; cluster < clusters.second; ++cluster) {
+    TraceContext unitContext("cluster " + std::to_string(cluster));
+    batch.SetEntryRange(clusterBoundaries[cluster],
+                        clusterBoundaries[cluster + 1]);
+    process_batch(query, batch, hist);
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_init =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_first - ts_init)
+          .count();
+  auto runtime_analyze =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
+          .count();
+
+  return std::make_pair(runtime_init, runtime_analyze);
+}
+
+// Runs the query on opts.input_path, either from the command line or as a
+// request to the analysis server. The resident state is owned by the caller.
+static AnalysisTime_t run_benchmark(const Query &query,
+                                    const AnalysisOptions &opts,
+                                    const ResidentState &resident,
+                                    TH1D *hist) {
+  std::string basename, suffix;
+  split_path(opts.input_path, &basename, &suffix);
+  auto fmt = get_file_format(suffix);
+
+  // The cached selections and columns are specific to the dimuon analysis
+  if (!opts.selection_cache_dir.empty() || !opts.column_cache_dir.empty()) {
+    throw std::invalid_argument(
+        "The selection and column caches are not supported by the ADL queries");
+  }
+  if (!opts.entry_list_path.empty()) {
+    throw std::invalid_argument(
+        "Entry lists are not supported by the ADL queries");
+  }
+
+  // Keep the trace open until all threads are done
+  auto trace = get_read_trace(opts);
+
+  AnalysisCaches caches;
+  caches.metadata = resident.metadata;
+  caches.readers = resident.readers;
+
+  AnalysisFn_t analysis;
+  switch (fmt) {
+  case FileFormat::rntuple:
+    analysis = [&](const WorkerSlice &slice, TH1D *threadHist) {
+      return analysis_rntuple(query, opts, slice, caches, threadHist);
+    };
+    break;
+  case FileFormat::parquet:
+    analysis = [&](const WorkerSlice &slice, TH1D *threadHist) {
+      return analysis_parquet(query, opts, slice, caches, threadHist);
+    };
+    break;
+  case FileFormat::orc:
+    analysis = [&](const WorkerSlice &slice, TH1D *threadHist) {
+      return analysis_orc(query, opts, slice, caches, threadHist);
+    };
+    break;
+  default:
+    throw std::invalid_argument("Invalid file format: " + suffix);
+  }
+
+  return run_analysis(opts, analysis, hist, resident.threads);
+}
+
+static void print_adl_usage(const char *progname) {
+  print_usage((std::string(progname) + " QUERY").c_str());
+  printf("\nQueries:\n");
+  for (const auto &query : queries)
+    printf("  %-4s %s\n", query.name.c_str(), query.description.c_str());
+}
+
+int main(int argc, char **argv) {
+  auto ts_init = std::chrono::steady_clock::now();
+
+  // The query is the first argument, the remaining ones are the usual
+  // benchmark options
+  const Query *query = argc > 1 ? find_query(argv[1]) : nullptr;
+  AnalysisOptions opts;
+  if (!query || !parse_options(argc - 1, argv + 1, &opts)) {
+    print_adl_usage(argv[0]);
+    return 1;
+  }
+
+  auto hist = std::make_unique<TH1D>(query->name.c_str(),
+                                     query->description.c_str(), query->nBins,
+                                     query->low, query->high);
+
+  BenchmarkFn_t benchmark = [query](const AnalysisOptions &requestOpts,
+                                    const ResidentState &resident,
+                                    TH1D *requestHist) {
+    return run_benchmark(*query, requestOpts, resident, requestHist);
+  };
+
+  if (!opts.server_socket.empty()) {
+    AnalysisServer server(opts, benchmark, *hist);
+    return server.Run();
+  }
+
+  std::shared_ptr<MetadataCache> metadataCache;
+  if (!opts.metadata_cache_dir.empty()) {
+    metadataCache = std::make_shared<MetadataCache>(opts.metadata_cache_dir,
+                                                    opts.input_path);
+  }
+
+  auto pageFaults = get_page_faults();
+  AnalysisTime_t runtime_analysis;
+  try {
+    ResidentState resident;
+    resident.metadata = metadataCache.get();
+    runtime_analysis = benchmark(opts, resident, hist.get());
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if (metadataCache)
+    metadataCache->Save();
+  if (auto throttle = get_storage_throttle(opts)) {
+    std::cerr << "storage: " << throttle->GetNRequests() << " requests, "
+              << throttle->GetNBytes() << " bytes" << std::endl;
+  }
+  print_memory_pool_stats(opts, get_page_faults() - pageFaults);
+
+  if (opts.partial) {
+    save_partial_histogram(hist.get(), opts.histo_path, opts.unit_range,
+                           runtime_analysis);
+  } else if (!opts.histo_path.empty()) {
+    save_histogram(hist.get(), opts.histo_path);
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_main =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_init)
+          .count();
+
+  std::cout << runtime_analysis.first << ", " << runtime_analysis.second << ", "
+            << runtime_main << std::endl;
+
+  return 0;
+}
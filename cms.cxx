@@ -10,101 +10,215 @@
 
 #include <arrow/io/api.h>
 #include <parquet/arrow/reader.h>
+#include <parquet/exception.h>
 #include <arrow/adapters/orc/adapter.h>
 
 #include <chrono>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
 #include <string>
 
+#include "column_cache.hxx"
+#include "dictionary_column.hxx"
+#include "memory_pool.hxx"
+#include "metadata_cache.hxx"
+#include "read_trace.hxx"
+#include "reader_pool.hxx"
+#include "selection_cache.hxx"
+#include "server.hxx"
+#include "sparse_read.hxx"
+#include "throttled_file.hxx"
 #include "util.hxx"
 
-const std::vector<std::string> columnNames = {
+// The inputs are converted by convert_unsigned2signed.py, so nMuon is an int32
+using CmsSchema_t =
+    Schema<std::int32_t, ROOT::RVec<std::int32_t>, ROOT::RVec<float>,
+           ROOT::RVec<float>, ROOT::RVec<float>, ROOT::RVec<float>>;
+
+// Column ids in cmsSchema
+enum : std::size_t {
+  kNMuon,
+  kMuonCharge,
+  kMuonPt,
+  kMuonEta,
+  kMuonPhi,
+  kMuonMass,
+};
+
+const CmsSchema_t cmsSchema({
   "nMuon",
   "Muon_charge",
   "Muon_pt",
   "Muon_eta",
   "Muon_phi",
   "Muon_mass"
+});
+
+// Columns needed to compute the dimuon mass of the selected entries
+const std::vector<std::size_t> kinematicColumns = {
+  kMuonPt,
+  kMuonEta,
+  kMuonPhi,
+  kMuonMass
 };
 
-static AnalysisTime_t analysis_orc(const std::string &path,
-                                   const std::string &histo_path) {
-  auto ts_init = std::chrono::steady_clock::now();
+// Columns read through RNTupleBatch, which takes the number of muons from the
+// Muon_charge collection instead of from nMuon
+const std::vector<std::size_t> rntupleColumns = {
+  kMuonCharge,
+  kMuonPt,
+  kMuonEta,
+  kMuonPhi,
+  kMuonMass
+};
 
-  auto hMass =
-      std::make_unique<TH1D>("Dimuon_mass", "Dimuon_mass", 2000, 0.25, 300);
+// All columns but Muon_charge, for when it is read as dictionary indices
+const std::vector<std::size_t> nonDictionaryColumns = {
+  kNMuon,
+  kMuonPt,
+  kMuonEta,
+  kMuonPhi,
+  kMuonMass
+};
+
+using DictionaryBatch_t =
+    ArrowBatch<CmsSchema_t, get_column_mask({kMuonCharge})>;
+
+// Identifies the selection in the selection cache, to be updated whenever the
+// cuts change
+const std::string selectionCut =
+    "cms: nMuon == 2 && Muon_charge[0] != Muon_charge[1]";
+
+// Fills the dimuon mass of the selected entries of the batch. Without a
+// (cached) selection, the cuts are evaluated and the passing entries are added
+// to `passing`. Compiled for every batch type, see ArrowBatch and RNTupleBatch.
+// Whether the batch is an RNTupleBatch, which does not read nMuon
+template <typename BatchT>
+constexpr bool kIsRNTupleBatch = false;
+template <typename SchemaT>
+constexpr bool kIsRNTupleBatch<RNTupleBatch<SchemaT>> = true;
+
+template <typename BatchT>
+static void process_batch(BatchT &batch, const Selection_t *selection,
+                          Selection_t *passing, TH1D *hMass) {
+  auto fill_mass = [&](std::int64_t entryId) {
+    auto muonPt = get_column<kMuonPt>(batch, entryId);
+    auto muonEta = get_column<kMuonEta>(batch, entryId);
+    auto muonPhi = get_column<kMuonPhi>(batch, entryId);
+    auto muonMass = get_column<kMuonMass>(batch, entryId);
+
+    float x_sum = 0.;
+    float y_sum = 0.;
+    float z_sum = 0.;
+    float e_sum = 0.;
+    for (std::size_t i = 0u; i < 2; ++i) {
+      const float pt = muonPt[i];
+      const float eta = muonEta[i];
+      const float phi = muonPhi[i];
+      const float mass = muonMass[i];
+
+      // Convert to (e, x, y, z) coordinate system and update sums
+      const auto x = pt * std::cos(phi);
+      x_sum += x;
+      const auto y = pt * std::sin(phi);
+      y_sum += y;
+      const auto z = pt * std::sinh(eta);
+      z_sum += z;
+      const auto e = std::sqrt(x * x + y * y + z * z + mass * mass);
+      e_sum += e;
+    }
+    // Return invariant mass with (+, -, -, -) metric
+    auto fmass = std::sqrt(e_sum * e_sum - x_sum * x_sum - y_sum * y_sum -
+                           z_sum * z_sum);
+    hMass->Fill(fmass);
+  };
+
+  if (selection) {
+    for (auto entryId : *selection)
+      fill_mass(entryId);
+    return;
+  }
+
+  for (std::int64_t entryId = 0; entryId < batch.GetNEntries(); ++entryId) {
+    auto charges = get_column<kMuonCharge>(batch, entryId);
+    if constexpr (kIsRNTupleBatch<BatchT>) {
+      if (charges.size() != 2)
+        continue;
+    } else {
+      if (get_column<kNMuon>(batch, entryId) != 2)
+        continue;
+    }
+
+    if (same_value(charges, 0, 1))
+      continue;
+
+    if (passing)
+      passing->push_back(entryId);
+    fill_mass(entryId);
+  }
+}
 
-  arrow::MemoryPool *pool = arrow::default_memory_pool();
-  auto localFile = arrow::io::ReadableFile::Open(path, pool).ValueOrDie();
-  auto reader = arrow::adapters::orc::ORCFileReader::Open(localFile, pool).ValueOrDie();
+static AnalysisTime_t analysis_orc(const AnalysisOptions &opts,
+                                   const WorkerSlice &slice,
+                                   const AnalysisCaches &caches, TH1D *hMass) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
 
-  auto schema = reader->ReadSchema().ValueOrDie();
+  auto pool = get_memory_pool(opts);
+  auto input = acquire_orc(opts, caches);
+  auto &reader = input->reader;
+  auto &localFile = input->file;
+  const auto &schema = input->schema;
   auto nStripes = reader->NumberOfStripes();
+  auto stripes = get_unit_range(nStripes, slice);
   std::shared_ptr<arrow::RecordBatch> recordBatch;
 
+  const ArrowBinding binding(cmsSchema, CmsSchema_t::GetAllColumns(),
+                             schema.get());
+  const ArrowBinding kinematicBinding(cmsSchema, kinematicColumns,
+                                      schema.get());
+
+  // The ORC adapter does not expose the stream offsets within a stripe, so we
+  // can only prefetch entire stripes. Only do so if all columns are read.
+  bool prefetchStripes =
+      opts.io == IoBackend::uring &&
+      static_cast<int>(CmsSchema_t::kNColumns) == schema->num_fields();
+
   std::chrono::steady_clock::time_point ts_first =
       std::chrono::steady_clock::now();
 
-  for (std::int64_t stripe = 0; stripe < nStripes; ++stripe) {
-    recordBatch = reader->ReadStripe(stripe, columnNames).ValueOrDie();
-
-    auto nMuonArr = std::static_pointer_cast<arrow::Int32Array>(
-        recordBatch->GetColumnByName("nMuon"));
-    auto muonChargeArr = std::static_pointer_cast<arrow::ListArray>(
-        recordBatch->GetColumnByName("Muon_charge"));
-    auto muonPtArr = std::static_pointer_cast<arrow::ListArray>(
-        recordBatch->GetColumnByName("Muon_pt"));
-    auto muonEtaArr = std::static_pointer_cast<arrow::ListArray>(
-        recordBatch->GetColumnByName("Muon_eta"));
-    auto muonPhiArr = std::static_pointer_cast<arrow::ListArray>(
-        recordBatch->GetColumnByName("Muon_phi"));
-    auto muonMassArr = std::static_pointer_cast<arrow::ListArray>(
-        recordBatch->GetColumnByName("Muon_mass"));
-
-      std::shared_ptr<arrow::Int32Array> nMuonsArray;
-      auto rawNMuonVals = nMuonArr->raw_values();
-      ROOT::RVec<std::int32_t> nMuons(rawNMuonVals,
-                                      rawNMuonVals + nMuonArr->length());
-
-      ROOT::RVec<std::int32_t> muonCharge;
-      ROOT::RVec<float> muonPt, muonEta, muonPhi, muonMass;
-
-      for (std::int64_t entryId = 0; entryId < recordBatch->num_rows(); ++entryId) {
-        if (nMuons[entryId] != 2)
-          continue;
-
-        fill_vector_from_arrow(entryId, *muonChargeArr, muonCharge);
-
-        if (muonCharge[0] == muonCharge[1]) {
-          continue;
-        }
+  for (std::int64_t stripe = stripes.first; stripe < stripes.second;
+       ++stripe) {
+    TraceContext unitContext("stripe " + std::to_string(stripe));
+    pool->CountUnit();
+    const Selection_t *selection = caches.selection ? caches.selection->Find(stripe) : nullptr;
+    if (selection && selection->empty())
+      continue;
 
-        fill_vector_from_arrow(entryId, *muonPtArr, muonPt);
-        fill_vector_from_arrow(entryId, *muonEtaArr, muonEta);
-        fill_vector_from_arrow(entryId, *muonPhiArr, muonPhi);
-        fill_vector_from_arrow(entryId, *muonMassArr, muonMass);
-
-        float x_sum = 0.;
-        float y_sum = 0.;
-        float z_sum = 0.;
-        float e_sum = 0.;
-        for (std::size_t i = 0u; i < 2; ++i) {
-          // Convert to (e, x, y, z) coordinate system and update sums
-          const auto x = muonPt[i] * std::cos(muonPhi[i]);
-          x_sum += x;
-          const auto y = muonPt[i] * std::sin(muonPhi[i]);
-          y_sum += y;
-          const auto z = muonPt[i] * std::sinh(muonEta[i]);
-          z_sum += z;
-          const auto e =
-              std::sqrt(x * x + y * y + z * z + muonMass[i] * muonMass[i]);
-          e_sum += e;
+    const auto &readBinding = selection ? kinematicBinding : binding;
+    const auto &readColumns = readBinding.GetColumnNames();
+    recordBatch = caches.column ? caches.column->GetBatch(readColumns, stripe)
+                                : nullptr;
+    if (!recordBatch) {
+      if (prefetchStripes && !selection) {
+        auto info = reader->GetStripeInformation(stripe);
+        auto st = localFile->WillNeed({{info.offset, info.length}});
+        if (!st.ok()) {
+          throw std::runtime_error("could not prefetch stripe");
         }
-        // Return invariant mass with (+, -, -, -) metric
-        auto fmass = std::sqrt(e_sum * e_sum - x_sum * x_sum - y_sum * y_sum -
-                               z_sum * z_sum);
-        hMass->Fill(fmass);
       }
+      PARQUET_ASSIGN_OR_THROW(recordBatch,
+                              reader->ReadStripe(stripe, readColumns));
+      if (caches.column)
+        caches.column->PutBatch(*recordBatch, stripe);
+    }
+
+    Selection_t passing;
+    ArrowBatch batch(readBinding, *recordBatch);
+    process_batch(batch, selection, &passing, hMass);
+    if (caches.selection && !selection)
+      caches.selection->Record(stripe, recordBatch->num_rows(), std::move(passing));
   }
 
   auto ts_end = std::chrono::steady_clock::now();
@@ -115,32 +229,21 @@ static AnalysisTime_t analysis_orc(const std::string &path,
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
           .count();
 
-  if (!histo_path.empty())
-    save_histogram(hMass.get(), histo_path);
-
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
-static AnalysisTime_t analysis_parquet(const std::string &path,
-                                       const std::string &histo_path) {
+static AnalysisTime_t analysis_parquet(const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches, TH1D *hMass) {
   auto ts_init = std::chrono::steady_clock::now();
-
-  auto hMass =
-      std::make_unique<TH1D>("Dimuon_mass", "Dimuon_mass", 2000, 0.25, 300);
+  TraceContext traceContext("open");
 
   arrow::Status st;
-  arrow::MemoryPool *pool = arrow::default_memory_pool();
-
-  parquet::arrow::FileReaderBuilder reader_builder;
-  st = reader_builder.OpenFile(path);
-  if (!st.ok()) {
-    throw std::runtime_error("could not create reader builder");
-  }
-  reader_builder.memory_pool(pool);
+  auto pool = get_memory_pool(opts);
 
-  auto reader = reader_builder.Build().ValueOrDie();
-  reader->set_use_threads(false);
+  auto reader = acquire_parquet(opts, caches);
   auto n_row_groups = reader->num_row_groups();
+  auto row_groups = get_unit_range(n_row_groups, slice);
   std::shared_ptr<arrow::Table> table;
 
   std::shared_ptr<arrow::Schema> schema;
@@ -149,81 +252,60 @@ static AnalysisTime_t analysis_parquet(const std::string &path,
     throw std::runtime_error("could not get schema");
   }
 
-  std::vector<std::int32_t> columns;
-  for (const auto colName : columnNames) {
-    columns.emplace_back(schema->GetFieldIndex(colName));
-  }
+  const ArrowBinding binding(cmsSchema, CmsSchema_t::GetAllColumns(),
+                             schema.get());
+  const ArrowBinding kinematicBinding(cmsSchema, kinematicColumns,
+                                      schema.get());
+  // Without Muon_charge, which is read as dictionary indices instead
+  const ArrowBinding nonDictionaryBinding(cmsSchema, nonDictionaryColumns,
+                                          schema.get());
 
   std::chrono::steady_clock::time_point ts_first =
       std::chrono::steady_clock::now();
 
-  for (std::int32_t row_group = 0; row_group < n_row_groups; ++row_group) {
-    auto st = reader->ReadRowGroup(row_group, columns, &table);
-    assert(st.ok());
-
-    assert(table->GetColumnByName("nMuon")->num_chunks() == 1);
-    assert(table->GetColumnByName("Muon_charge")->num_chunks() == 1);
-    assert(table->GetColumnByName("Muon_pt")->num_chunks() == 1);
-    assert(table->GetColumnByName("Muon_eta")->num_chunks() == 1);
-    assert(table->GetColumnByName("Muon_phi")->num_chunks() == 1);
-    assert(table->GetColumnByName("Muon_mass")->num_chunks() == 1);
-
-    auto nMuonArr = std::static_pointer_cast<arrow::Int32Array>(
-        table->GetColumnByName("nMuon")->chunk(0));
-    auto muonChargeArr = std::static_pointer_cast<arrow::ListArray>(
-        table->GetColumnByName("Muon_charge")->chunk(0));
-    auto muonPtArr = std::static_pointer_cast<arrow::ListArray>(
-        table->GetColumnByName("Muon_pt")->chunk(0));
-    auto muonEtaArr = std::static_pointer_cast<arrow::ListArray>(
-        table->GetColumnByName("Muon_eta")->chunk(0));
-    auto muonPhiArr = std::static_pointer_cast<arrow::ListArray>(
-        table->GetColumnByName("Muon_phi")->chunk(0));
-    auto muonMassArr = std::static_pointer_cast<arrow::ListArray>(
-        table->GetColumnByName("Muon_mass")->chunk(0));
-
-    auto rawNMuonVals = nMuonArr->raw_values();
-    ROOT::RVec<std::int32_t> nMuons(rawNMuonVals,
-                                    rawNMuonVals + nMuonArr->length());
-
-    ROOT::RVec<std::int32_t> muonCharge;
-    ROOT::RVec<float> muonPt, muonEta, muonPhi, muonMass;
-
-    for (std::int64_t entryId = 0; entryId < table->num_rows(); ++entryId) {
-      if (nMuons[entryId] != 2)
-        continue;
+  for (std::int64_t row_group = row_groups.first;
+       row_group < row_groups.second; ++row_group) {
+    TraceContext unitContext("row group " + std::to_string(row_group));
+    pool->CountUnit();
+    const Selection_t *selection =
+        caches.selection ? caches.selection->Find(row_group) : nullptr;
+    if (selection && selection->empty())
+      continue;
 
-      fill_vector_from_arrow(entryId, *muonChargeArr, muonCharge);
+    // The column cache holds complete batches, so the dictionary indices are
+    // only used without it
+    std::optional<DictionaryColumn> muonChargeValues;
+    if (!selection && !caches.column) {
+      muonChargeValues = read_dictionary_column(
+          *reader->parquet_reader(), row_group, cmsSchema.GetName(kMuonCharge));
+    }
 
-      if (muonCharge[0] == muonCharge[1]) {
-        continue;
-      }
+    const auto &readBinding = selection          ? kinematicBinding
+                              : muonChargeValues ? nonDictionaryBinding
+                                                 : binding;
+    auto batch = caches.column
+                     ? caches.column->GetBatch(readBinding.GetColumnNames(),
+                                               row_group)
+                     : nullptr;
+    if (!batch) {
+      PARQUET_THROW_NOT_OK(reader->ReadRowGroup(
+          row_group, readBinding.GetFieldIndices(), &table));
+      PARQUET_ASSIGN_OR_THROW(batch, table->CombineChunksToBatch(pool));
+      if (caches.column)
+        caches.column->PutBatch(*batch, row_group);
+    }
 
-      fill_vector_from_arrow(entryId, *muonPtArr, muonPt);
-      fill_vector_from_arrow(entryId, *muonEtaArr, muonEta);
-      fill_vector_from_arrow(entryId, *muonPhiArr, muonPhi);
-      fill_vector_from_arrow(entryId, *muonMassArr, muonMass);
-
-      float x_sum = 0.;
-      float y_sum = 0.;
-      float z_sum = 0.;
-      float e_sum = 0.;
-      for (std::size_t i = 0u; i < 2; ++i) {
-        // Convert to (e, x, y, z) coordinate system and update sums
-        const auto x = muonPt[i] * std::cos(muonPhi[i]);
-        x_sum += x;
-        const auto y = muonPt[i] * std::sin(muonPhi[i]);
-        y_sum += y;
-        const auto z = muonPt[i] * std::sinh(muonEta[i]);
-        z_sum += z;
-        const auto e =
-            std::sqrt(x * x + y * y + z * z + muonMass[i] * muonMass[i]);
-        e_sum += e;
-      }
-      // Return invariant mass with (+, -, -, -) metric
-      auto fmass = std::sqrt(e_sum * e_sum - x_sum * x_sum - y_sum * y_sum -
-                             z_sum * z_sum);
-      hMass->Fill(fmass);
+    Selection_t passing;
+    if (muonChargeValues) {
+      DictionaryBatch_t dictionaryBatch(readBinding, *batch);
+      dictionaryBatch.SetDictionaryColumn(kMuonCharge, *muonChargeValues);
+      process_batch(dictionaryBatch, selection, &passing, hMass);
+    } else {
+      ArrowBatch arrowBatch(readBinding, *batch);
+      process_batch(arrowBatch, selection, &passing, hMass);
     }
+    if (caches.selection && !selection)
+      caches.selection->Record(row_group, batch->num_rows(), std::move(passing));
   }
 
   auto ts_end = std::chrono::steady_clock::now();
@@ -234,64 +316,78 @@ static AnalysisTime_t analysis_parquet(const std::string &path,
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
           .count();
 
-  if (!histo_path.empty())
-    save_histogram(hMass.get(), histo_path);
-
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
-static AnalysisTime_t analysis_rntuple(std::string_view ntuple_path,
-                                       const std::string &histo_path) {
+static AnalysisTime_t analysis_rntuple(const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches, TH1D *hMass) {
   auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto ntuple = acquire_rntuple("Events", opts, caches);
+  auto clusterBoundaries = get_cluster_boundaries(ntuple->GetDescriptor());
+  auto clusters = get_unit_range(clusterBoundaries.size() - 1, slice);
+
+  // Only create views for the selection columns if they are needed, so that
+  // their pages are not loaded otherwise. With the column cache, the views are
+  // not used at all.
+  bool needCuts = false;
+  for (auto cluster = clusters.first;
+       cluster < clusters.second && !caches.column && !needCuts; ++cluster) {
+    needCuts = !caches.selection || !caches.selection->Find(cluster);
+  }
 
-  auto ntuple = ROOT::RNTupleReader::Open("Events", ntuple_path);
-
-  auto hMass =
-      std::make_unique<TH1D>("Dimuon_mass", "Dimuon_mass", 2000, 0.25, 300);
-
-  auto viewNMuon = ntuple->GetView<std::int32_t>("nMuon");
-  auto viewMuonCharge =
-      ntuple->GetView<ROOT::RVec<std::int32_t>>("Muon_charge");
-  auto viewMuonPt = ntuple->GetView<ROOT::RVec<float>>("Muon_pt");
-  auto viewMuonEta = ntuple->GetView<ROOT::RVec<float>>("Muon_eta");
-  auto viewMuonPhi = ntuple->GetView<ROOT::RVec<float>>("Muon_phi");
-  auto viewMuonMass = ntuple->GetView<ROOT::RVec<float>>("Muon_mass");
+  // The Muon_* fields are read as collections, whose elements are accessed
+  // through views of their item fields. All of them have the same number of
+  // elements per entry, so only the offsets of Muon_pt are read for the
+  // kinematic columns.
+  RNTupleBatch<CmsSchema_t> rntupleBatch(
+      cmsSchema, *ntuple, needCuts ? rntupleColumns : kinematicColumns);
+  rntupleBatch.ShareOffsets<kMuonEta, kMuonPt>();
+  rntupleBatch.ShareOffsets<kMuonPhi, kMuonPt>();
+  rntupleBatch.ShareOffsets<kMuonMass, kMuonPt>();
+  // Used with the column cache, in schema order
+  const ArrowBinding binding(cmsSchema, CmsSchema_t::GetAllColumns());
+  const ArrowBinding kinematicBinding(cmsSchema, kinematicColumns);
 
   std::chrono::steady_clock::time_point ts_first =
       std::chrono::steady_clock::now();
 
-  for (auto entryId : ntuple->GetEntryRange()) {
-    if (viewNMuon(entryId) != 2)
-      continue;
+  for (auto cluster = clusters.first; cluster < clusters.second; ++cluster) {
+    TraceContext unitContext("cluster " + std::to_string(cluster));
+    auto firstEntry = clusterBoundaries[cluster];
+    auto lastEntry = clusterBoundaries[cluster + 1];
 
-    auto charges = viewMuonCharge(entryId);
-    if (charges[0] == charges[1])
-      continue;
+    const Selection_t *selection =
+        caches.selection ? caches.selection->Find(cluster) : nullptr;
 
-    auto pt = viewMuonPt(entryId);
-    auto eta = viewMuonEta(entryId);
-    auto phi = viewMuonPhi(entryId);
-    auto mass = viewMuonMass(entryId);
+    // The column cache is filled and read per cluster, as Arrow arrays
+    if (caches.column) {
+      if (selection && selection->empty())
+        continue;
+      const auto &readBinding = selection ? kinematicBinding : binding;
+      const auto &readColumns = readBinding.GetColumnNames();
+      auto batch = caches.column->GetBatch(readColumns, cluster);
+      if (!batch) {
+        batch = read_rntuple_batch(*ntuple, readColumns, firstEntry, lastEntry);
+        caches.column->PutBatch(*batch, cluster);
+      }
 
-    float x_sum = 0.;
-    float y_sum = 0.;
-    float z_sum = 0.;
-    float e_sum = 0.;
-    for (std::size_t i = 0u; i < 2; ++i) {
-      // Convert to (e, x, y, z) coordinate system and update sums
-      const auto x = pt[i] * std::cos(phi[i]);
-      x_sum += x;
-      const auto y = pt[i] * std::sin(phi[i]);
-      y_sum += y;
-      const auto z = pt[i] * std::sinh(eta[i]);
-      z_sum += z;
-      const auto e = std::sqrt(x * x + y * y + z * z + mass[i] * mass[i]);
-      e_sum += e;
+      Selection_t passing;
+      ArrowBatch arrowBatch(readBinding, *batch);
+      process_batch(arrowBatch, selection, &passing, hMass);
+      if (caches.selection && !selection)
+        caches.selection->Record(cluster, lastEntry - firstEntry,
+                                 std::move(passing));
+      continue;
     }
-    // Return invariant mass with (+, -, -, -) metric
-    auto fmass = std::sqrt(e_sum * e_sum - x_sum * x_sum - y_sum * y_sum -
-                           z_sum * z_sum);
-    hMass->Fill(fmass);
+
+    Selection_t passing;
+    rntupleBatch.SetEntryRange(firstEntry, lastEntry);
+    process_batch(rntupleBatch, selection, &passing, hMass);
+    if (caches.selection && !selection)
+      caches.selection->Record(cluster, lastEntry - firstEntry, std::move(passing));
   }
 
   auto ts_end = std::chrono::steady_clock::now();
@@ -302,9 +398,6 @@ static AnalysisTime_t analysis_rntuple(std::string_view ntuple_path,
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
           .count();
 
-  if (!histo_path.empty())
-    save_histogram(hMass.get(), histo_path);
-
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
@@ -345,45 +438,127 @@ static AnalysisTime_t analysis_rdf(ROOT::RDataFrame &df,
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
-static void Usage(const char *progname) {
-  printf("%s INPUT_PATH [HISTO_PATH]\n", progname);
-}
+// Runs the analysis of opts.input_path, either from the command line or as a
+// request to the analysis server. The resident state is owned by the caller.
+static AnalysisTime_t run_benchmark(const AnalysisOptions &opts,
+                                    const ResidentState &resident,
+                                    TH1D *hMass) {
+  std::string basename, suffix;
+  split_path(opts.input_path, &basename, &suffix);
+  auto fmt = get_file_format(suffix);
 
-int main(int argc, char **argv) {
-  auto ts_init = std::chrono::steady_clock::now();
+  // Keep the trace open until all threads are done
+  auto trace = get_read_trace(opts);
 
-  if (argc < 2) {
-    Usage(argv[0]);
-    return 1;
+  // Only fetch the listed entries, without the analysis
+  if (!opts.entry_list_path.empty()) {
+    FetchStats stats;
+    auto runtime_fetch = fetch_entries(opts, "Events", cmsSchema.GetNames(),
+                                       resident, hMass, &stats);
+    print_fetch_stats(stats);
+    return runtime_fetch;
   }
 
-  std::string input_path = argv[1];
-  std::string basename, suffix;
-  split_path(input_path, &basename, &suffix);
-  auto fmt = get_file_format(suffix);
-
-  std::string histo_path{};
-  if (argc >= 3)
-    histo_path = argv[2];
+  AnalysisCaches caches;
+  caches.metadata = resident.metadata;
+  caches.readers = resident.readers;
+  std::unique_ptr<SelectionCache> selCache;
+  if (!opts.selection_cache_dir.empty()) {
+    selCache = std::make_unique<SelectionCache>(opts.selection_cache_dir,
+                                                opts.input_path, selectionCut);
+    caches.selection = selCache.get();
+  }
+  std::unique_ptr<ColumnCache> colCache;
+  if (!opts.column_cache_dir.empty()) {
+    colCache = std::make_unique<ColumnCache>(
+        opts.column_cache_dir, opts.input_path, opts.column_cache_size);
+    caches.column = colCache.get();
+  }
 
-  AnalysisTime_t runtime_analysis;
+  AnalysisFn_t analysis;
   switch (fmt) {
   case FileFormat::rntuple: {
-    runtime_analysis = analysis_rntuple(input_path, histo_path);
+    analysis = [&](const WorkerSlice &slice, TH1D *hist) {
+      return analysis_rntuple(opts, slice, caches, hist);
+    };
   } break;
   case FileFormat::parquet: {
-    runtime_analysis = analysis_parquet(input_path, histo_path);
+    analysis = [&](const WorkerSlice &slice, TH1D *hist) {
+      return analysis_parquet(opts, slice, caches, hist);
+    };
     break;
   }
   case FileFormat::orc: {
-    runtime_analysis = analysis_orc(input_path, histo_path);
+    analysis = [&](const WorkerSlice &slice, TH1D *hist) {
+      return analysis_orc(opts, slice, caches, hist);
+    };
     break;
   }
   default:
-    std::cerr << "Invalid file format: " << suffix << std::endl;
+    throw std::invalid_argument("Invalid file format: " + suffix);
+  }
+
+  auto runtime_analysis =
+      run_analysis(opts, analysis, hMass, resident.threads);
+  if (selCache)
+    selCache->Save();
+  if (colCache) {
+    auto nUnits = colCache->GetNHits() + colCache->GetNMisses();
+    std::cerr << "column cache: " << colCache->GetNHits() << "/" << nUnits
+              << " units served from cache" << std::endl;
+  }
+
+  return runtime_analysis;
+}
+
+int main(int argc, char **argv) {
+  auto ts_init = std::chrono::steady_clock::now();
+
+  AnalysisOptions opts;
+  if (!parse_options(argc, argv, &opts)) {
+    print_usage(argv[0]);
     return 1;
   }
 
+  auto hMass =
+      std::make_unique<TH1D>("Dimuon_mass", "Dimuon_mass", 2000, 0.25, 300);
+
+  if (!opts.server_socket.empty()) {
+    AnalysisServer server(opts, run_benchmark, *hMass);
+    return server.Run();
+  }
+
+  std::shared_ptr<MetadataCache> metadataCache;
+  if (!opts.metadata_cache_dir.empty()) {
+    metadataCache = std::make_shared<MetadataCache>(opts.metadata_cache_dir,
+                                                    opts.input_path);
+  }
+
+  auto pageFaults = get_page_faults();
+  AnalysisTime_t runtime_analysis;
+  try {
+    ResidentState resident;
+    resident.metadata = metadataCache.get();
+    runtime_analysis = run_benchmark(opts, resident, hMass.get());
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if (metadataCache)
+    metadataCache->Save();
+  if (auto throttle = get_storage_throttle(opts)) {
+    std::cerr << "storage: " << throttle->GetNRequests() << " requests, "
+              << throttle->GetNBytes() << " bytes" << std::endl;
+  }
+  print_memory_pool_stats(opts, get_page_faults() - pageFaults);
+
+  if (opts.partial) {
+    save_partial_histogram(hMass.get(), opts.histo_path, opts.unit_range,
+                           runtime_analysis);
+  } else if (!opts.histo_path.empty()) {
+    save_histogram(hMass.get(), opts.histo_path);
+  }
+
   auto ts_end = std::chrono::steady_clock::now();
   auto runtime_main =
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_init)
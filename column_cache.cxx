@@ -0,0 +1,312 @@
+#include "column_cache.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#include <arrow/io/file.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'H', 'E', 'P', 'C', 'O', 'L', '0', '1'};
+constexpr std::int64_t kAlignment = 64;
+
+struct FileHeader {
+  char magic[8];
+  std::uint64_t fileSize;
+  std::int64_t fileMtime;
+  // Number of entries and of values, which differ for jagged columns
+  std::int64_t length;
+  std::int64_t nValues;
+  std::uint8_t isList;
+  std::uint8_t valueType; // arrow::Type::type
+  std::uint8_t padding[22];
+};
+static_assert(sizeof(FileHeader) == kAlignment);
+
+std::int64_t align(std::int64_t pos) {
+  return (pos + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+std::shared_ptr<arrow::DataType> get_value_type(std::uint8_t typeId) {
+  switch (static_cast<arrow::Type::type>(typeId)) {
+  case arrow::Type::INT8:
+    return arrow::int8();
+  case arrow::Type::INT16:
+    return arrow::int16();
+  case arrow::Type::INT32:
+    return arrow::int32();
+  case arrow::Type::INT64:
+    return arrow::int64();
+  case arrow::Type::UINT8:
+    return arrow::uint8();
+  case arrow::Type::UINT16:
+    return arrow::uint16();
+  case arrow::Type::UINT32:
+    return arrow::uint32();
+  case arrow::Type::UINT64:
+    return arrow::uint64();
+  case arrow::Type::FLOAT:
+    return arrow::float32();
+  case arrow::Type::DOUBLE:
+    return arrow::float64();
+  default:
+    return nullptr;
+  }
+}
+
+std::uint64_t fnv1a(const std::string &s) {
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : s) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+struct CacheFile {
+  std::string path;
+  std::uint64_t size;
+  struct timespec atime;
+};
+
+std::vector<CacheFile> list_cache_files(const std::string &cacheDir) {
+  std::vector<CacheFile> files;
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::recursive_directory_iterator(cacheDir, ec)) {
+    if (!entry.is_regular_file() || entry.path().extension() != ".col")
+      continue;
+    struct stat st;
+    if (stat(entry.path().c_str(), &st) != 0)
+      continue;
+    files.push_back({entry.path().string(), static_cast<std::uint64_t>(st.st_size),
+                     st.st_atim});
+  }
+  return files;
+}
+
+} // anonymous namespace
+
+ColumnCache::ColumnCache(const std::string &cacheDir,
+                         const std::string &inputPath, std::uint64_t maxSize)
+    : fCacheDir(cacheDir), fMaxSize(maxSize) {
+  std::error_code ec;
+  auto canonicalPath = std::filesystem::canonical(inputPath, ec);
+  auto path = ec ? std::filesystem::path(inputPath) : canonicalPath;
+  fFileSize = std::filesystem::file_size(path);
+  fFileMtime =
+      std::filesystem::last_write_time(path).time_since_epoch().count();
+
+  std::ostringstream name;
+  name << path.filename().string() << "-" << std::hex << std::setw(16)
+       << std::setfill('0') << fnv1a(path.string());
+  fInputDir = (std::filesystem::path(cacheDir) / name.str()).string();
+  std::filesystem::create_directories(fInputDir);
+
+  for (const auto &file : list_cache_files(fCacheDir))
+    fTotalSize += file.size;
+}
+
+std::string ColumnCache::GetCachePath(const std::string &column,
+                                      std::int64_t unit) const {
+  auto fileName = column + "." + std::to_string(unit) + ".col";
+  std::replace(fileName.begin(), fileName.end(), '/', '_');
+  return (std::filesystem::path(fInputDir) / fileName).string();
+}
+
+std::shared_ptr<arrow::Array> ColumnCache::Get(const std::string &column,
+                                               std::int64_t unit) {
+  auto path = GetCachePath(column, unit);
+  auto fileResult =
+      arrow::io::MemoryMappedFile::Open(path, arrow::io::FileMode::READ);
+  if (!fileResult.ok())
+    return nullptr;
+  auto file = *fileResult;
+
+  // A cache file that cannot be read is a miss
+  auto sizeResult = file->GetSize();
+  if (!sizeResult.ok() || *sizeResult < kAlignment)
+    return nullptr;
+  auto size = *sizeResult;
+  FileHeader header;
+  auto headerResult = file->ReadAt(0, sizeof(header));
+  if (!headerResult.ok() ||
+      (*headerResult)->size() < static_cast<std::int64_t>(sizeof(header)))
+    return nullptr;
+  auto headerBuf = *headerResult;
+  std::memcpy(&header, headerBuf->data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.fileSize != fFileSize || header.fileMtime != fFileMtime)
+    return nullptr;
+
+  auto valueType = get_value_type(header.valueType);
+  if (!valueType)
+    return nullptr;
+  auto byteWidth =
+      static_cast<const arrow::FixedWidthType &>(*valueType).bit_width() / 8;
+
+  std::int64_t offsetsPos = kAlignment;
+  std::int64_t offsetsSize =
+      header.isList ? (header.length + 1) * sizeof(std::int32_t) : 0;
+  std::int64_t valuesPos = align(offsetsPos + offsetsSize);
+  std::int64_t valuesSize = header.nValues * byteWidth;
+  if (valuesPos + valuesSize > size)
+    return nullptr;
+
+  // Memory-mapped buffers stay valid after the file is closed
+  auto valuesResult = file->ReadAt(valuesPos, valuesSize);
+  if (!valuesResult.ok())
+    return nullptr;
+  auto valuesBuf = *valuesResult;
+  auto valuesData =
+      arrow::ArrayData::Make(valueType, header.nValues, {nullptr, valuesBuf}, 0);
+
+  // Keep track of the last access for the LRU eviction
+  struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_OMIT}};
+  utimensat(AT_FDCWD, path.c_str(), times, 0);
+
+  if (!header.isList)
+    return arrow::MakeArray(valuesData);
+
+  auto offsetsResult = file->ReadAt(offsetsPos, offsetsSize);
+  if (!offsetsResult.ok())
+    return nullptr;
+  auto offsetsBuf = *offsetsResult;
+  auto listData = arrow::ArrayData::Make(
+      arrow::list(valueType), header.length, {nullptr, offsetsBuf}, 0);
+  listData->child_data.push_back(valuesData);
+  return arrow::MakeArray(listData);
+}
+
+void ColumnCache::Put(const std::string &column, std::int64_t unit,
+                      const arrow::Array &array) {
+  const arrow::Array *values = &array;
+  const std::int32_t *offsets = nullptr;
+  std::int64_t firstValue = 0;
+  std::int64_t nValues = array.length();
+
+  if (array.type_id() == arrow::Type::LIST) {
+    const auto &listArray = static_cast<const arrow::ListArray &>(array);
+    offsets = listArray.raw_value_offsets();
+    values = listArray.values().get();
+    firstValue = offsets[0];
+    nValues = offsets[array.length()] - offsets[0];
+  }
+
+  auto valueType = values->type_id();
+  if (!get_value_type(valueType) || array.null_count() > 0 ||
+      values->null_count() > 0)
+    return;
+  auto byteWidth =
+      static_cast<const arrow::FixedWidthType &>(*values->type()).bit_width() /
+      8;
+  auto rawValues = values->data()->buffers[1]->data() +
+                   (values->offset() + firstValue) * byteWidth;
+
+  FileHeader header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.fileSize = fFileSize;
+  header.fileMtime = fFileMtime;
+  header.length = array.length();
+  header.nValues = nValues;
+  header.isList = offsets != nullptr;
+  header.valueType = valueType;
+
+  // Write to a temporary file first, so that concurrent readers never see a
+  // partially written cache file
+  auto path = GetCachePath(column, unit);
+  std::ostringstream tmpPath;
+  tmpPath << path << ".tmp." << getpid() << "."
+          << std::hash<std::thread::id>()(std::this_thread::get_id());
+  std::int64_t written = 0;
+  {
+    std::ofstream os(tmpPath.str(), std::ios::binary | std::ios::trunc);
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    written += sizeof(header);
+    if (offsets) {
+      for (std::int64_t i = 0; i <= array.length(); ++i) {
+        std::int32_t offset = offsets[i] - offsets[0];
+        os.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+      }
+      written += (array.length() + 1) * sizeof(std::int32_t);
+    }
+    std::vector<char> padding(align(written) - written, 0);
+    os.write(padding.data(), padding.size());
+    written += padding.size();
+    os.write(reinterpret_cast<const char *>(rawValues), nValues * byteWidth);
+    written += nValues * byteWidth;
+
+    if (!os) {
+      std::filesystem::remove(tmpPath.str());
+      return;
+    }
+  }
+  std::filesystem::rename(tmpPath.str(), path);
+
+  std::lock_guard<std::mutex> guard(fLock);
+  fTotalSize += written;
+  if (fTotalSize > fMaxSize)
+    Evict();
+}
+
+void ColumnCache::Evict() {
+  auto files = list_cache_files(fCacheDir);
+  std::sort(files.begin(), files.end(),
+            [](const CacheFile &a, const CacheFile &b) {
+              return std::tie(a.atime.tv_sec, a.atime.tv_nsec) <
+                     std::tie(b.atime.tv_sec, b.atime.tv_nsec);
+            });
+
+  fTotalSize = 0;
+  for (const auto &file : files)
+    fTotalSize += file.size;
+
+  // Evict down to 90% of the limit, so that we do not have to rescan the
+  // cache for every new file
+  auto targetSize = fMaxSize / 10 * 9;
+  for (const auto &file : files) {
+    if (fTotalSize <= targetSize)
+      break;
+    std::error_code ec;
+    if (std::filesystem::remove(file.path, ec))
+      fTotalSize -= file.size;
+  }
+}
+
+std::shared_ptr<arrow::RecordBatch>
+ColumnCache::GetBatch(const std::vector<std::string> &columns,
+                      std::int64_t unit) {
+  arrow::FieldVector fields;
+  arrow::ArrayVector arrays;
+  for (const auto &column : columns) {
+    auto array = Get(column, unit);
+    if (!array) {
+      ++fNMisses;
+      return nullptr;
+    }
+    fields.push_back(arrow::field(column, array->type()));
+    arrays.push_back(std::move(array));
+  }
+
+  ++fNHits;
+  auto nRows = arrays.empty() ? 0 : arrays[0]->length();
+  return arrow::RecordBatch::Make(arrow::schema(fields), nRows, arrays);
+}
+
+void ColumnCache::PutBatch(const arrow::RecordBatch &batch,
+                           std::int64_t unit) {
+  for (int i = 0; i < batch.num_columns(); ++i) {
+    Put(batch.schema()->field(i)->name(), unit, *batch.column(i));
+  }
+}
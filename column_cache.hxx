@@ -0,0 +1,60 @@
+#ifndef COLUMN_CACHE__HXX
+#define COLUMN_CACHE__HXX
+
+#include <arrow/api.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Local cache of decoded column data.
+//
+// Every column of every unit (cluster, row group or stripe) is stored in its
+// own file, holding the raw values (and the offsets of jagged columns) as
+// 64-byte aligned arrays. Cached columns are memory-mapped and returned as
+// Arrow arrays without copying. Only columns of fixed-width numbers, or lists
+// thereof, without nulls are cached.
+//
+// The cache files of an input file record its size and modification time and
+// are ignored if they do not match. When the cache grows beyond its size
+// limit, the least recently used files are evicted.
+class ColumnCache {
+public:
+  ColumnCache(const std::string &cacheDir, const std::string &inputPath,
+              std::uint64_t maxSize);
+
+  // Returns nullptr unless all columns of the unit are cached
+  std::shared_ptr<arrow::RecordBatch>
+  GetBatch(const std::vector<std::string> &columns, std::int64_t unit);
+  void PutBatch(const arrow::RecordBatch &batch, std::int64_t unit);
+
+  // Number of units that were (not) found in the cache by GetBatch()
+  std::uint64_t GetNHits() const { return fNHits; }
+  std::uint64_t GetNMisses() const { return fNMisses; }
+
+private:
+  std::shared_ptr<arrow::Array> Get(const std::string &column,
+                                    std::int64_t unit);
+  void Put(const std::string &column, std::int64_t unit,
+           const arrow::Array &array);
+  std::string GetCachePath(const std::string &column, std::int64_t unit) const;
+  void Evict();
+
+  std::string fCacheDir;
+  std::string fInputDir;
+  std::uint64_t fFileSize = 0;
+  std::int64_t fFileMtime = 0;
+  std::uint64_t fMaxSize;
+
+  std::atomic<std::uint64_t> fNHits{0};
+  std::atomic<std::uint64_t> fNMisses{0};
+
+  // Guards fTotalSize and eviction
+  std::mutex fLock;
+  std::uint64_t fTotalSize = 0;
+};
+
+#endif // COLUMN_CACHE__HXX
@@ -0,0 +1,489 @@
+// Reads k of the N columns of a dataset and reduces every column to the sum of
+// its values, to measure how the read throughput and the initialization time
+// scale with the number of columns read. The columns are taken from the
+// `_columns.txt` file written by print_column_names.py.
+
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleView.hxx>
+
+#include <TH1D.h>
+
+#include <arrow/io/api.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/exception.h>
+#include <arrow/adapters/orc/adapter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "memory_pool.hxx"
+#include "metadata_cache.hxx"
+#include "read_trace.hxx"
+#include "reader_pool.hxx"
+#include "server.hxx"
+#include "throttled_file.hxx"
+#include "util.hxx"
+
+// Which columns to read: the first nColumns of the column list, or a random
+// subset of nColumns if a seed is given
+struct ColumnSelection {
+  std::string ntupleName;
+  std::size_t nColumns = 0;
+  bool random = false;
+  std::uint64_t seed = 0;
+};
+
+// Number of entries and of values (list elements included) read by all threads
+struct ScanStats {
+  std::atomic<std::uint64_t> nEntries = 0;
+  std::atomic<std::uint64_t> nValues = 0;
+};
+
+template <typename T>
+static double sum_values(const arrow::Array &array) {
+  using ArrowType = typename RootConversionTraits<T>::ArrowType;
+  using ArrayType = typename arrow::TypeTraits<ArrowType>::ArrayType;
+
+  const auto &values = static_cast<const ArrayType &>(array);
+  if constexpr (std::is_same_v<T, bool>) {
+    return values.true_count();
+  } else {
+    double sum = 0;
+    auto raw = values.raw_values();
+    for (std::int64_t i = 0; i < values.length(); ++i)
+      sum += raw[i];
+    return sum;
+  }
+}
+
+// Sums the values of a flat or list column. Values of other types are only
+// counted.
+static double reduce_array(const arrow::Array &array, std::uint64_t *nValues) {
+  if (array.type_id() == arrow::Type::LIST) {
+    const auto &list = static_cast<const arrow::ListArray &>(array);
+    auto first = list.value_offset(0);
+    auto values = list.values()->Slice(first, list.value_offset(list.length()) -
+                                                  first);
+    return reduce_array(*values, nValues);
+  }
+
+  *nValues += array.length();
+  double sum = 0;
+  visit_arrow_type(array.type_id(), [&](auto tag) {
+    sum = sum_values<typename decltype(tag)::Type>(array);
+  });
+  return sum;
+}
+
+// The sum of every column is filled into the bin of the column
+static void process_batch(const arrow::RecordBatch &batch, TH1D *hist,
+                          ScanStats *stats) {
+  std::uint64_t nValues = 0;
+  for (int i = 0; i < batch.num_columns(); ++i)
+    hist->Fill(i, reduce_array(*batch.column(i), &nValues));
+  stats->nEntries += batch.num_rows();
+  stats->nValues += nValues;
+}
+
+static AnalysisTime_t analysis_orc(const std::vector<std::string> &columns,
+                                   const AnalysisOptions &opts,
+                                   const WorkerSlice &slice,
+                                   const AnalysisCaches &caches, TH1D *hist,
+                                   ScanStats *stats) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto pool = get_memory_pool(opts);
+  auto input = acquire_orc(opts, caches);
+  auto &reader = input->reader;
+  auto nStripes = reader->NumberOfStripes();
+  auto stripes = get_unit_range(nStripes, slice);
+
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
+
+  for (std::int64_t stripe = stripes.first; stripe < stripes.second;
+       ++stripe) {
+    TraceContext unitContext("stripe " + std::to_string(stripe));
+    pool->CountUnit();
+    std::shared_ptr<arrow::RecordBatch> recordBatch;
+    PARQUET_ASSIGN_OR_THROW(recordBatch, reader->ReadStripe(stripe, columns));
+    process_batch(*recordBatch, hist, stats);
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_init =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_first - ts_init)
+          .count();
+  auto runtime_analyze =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
+          .count();
+
+  return std::make_pair(runtime_init, runtime_analyze);
+}
+
+static AnalysisTime_t analysis_parquet(const std::vector<std::string> &columns,
+                                       const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches,
+                                       TH1D *hist, ScanStats *stats) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto pool = get_memory_pool(opts);
+
+  auto reader = acquire_parquet(opts, caches);
+  auto row_groups = get_unit_range(reader->num_row_groups(), slice);
+  std::shared_ptr<arrow::Table> table;
+
+  const auto &schema = *reader->parquet_reader()->metadata()->schema();
+  std::vector<std::int32_t> columnIndices;
+  for (const auto &colName : columns) {
+    columnIndices.emplace_back(get_leaf_column(schema, colName));
+  }
+
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
+
+  for (std::int64_t row_group = row_groups.first;
+       row_group < row_groups.second; ++row_group) {
+    TraceContext unitContext("row group " + std::to_string(row_group));
+    pool->CountUnit();
+    PARQUET_THROW_NOT_OK(
+        reader->ReadRowGroup(row_group, columnIndices, &table));
+    std::shared_ptr<arrow::RecordBatch> batch;
+    PARQUET_ASSIGN_OR_THROW(batch, table->CombineChunksToBatch(pool));
+    process_batch(*batch, hist, stats);
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_init =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_first - ts_init)
+          .count();
+  auto runtime_analyze =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
+          .count();
+
+  return std::make_pair(runtime_init, runtime_analyze);
+}
+
+// Adds the values of the entries [firstEntry, lastEntry) of one cluster to the
+// sum of the column
+using ColumnReducer_t =
+    std::function<void(std::uint64_t firstEntry, std::uint64_t lastEntry)>;
+
+template <typename T>
+static ColumnReducer_t make_reducer(ROOT::RNTupleReader &reader,
+                                    const std::string &name, double *sum,
+                                    std::uint64_t *nValues) {
+  auto view =
+      std::make_shared<ROOT::RNTupleView<T>>(reader.GetView<T>(name));
+  return [view, sum, nValues](std::uint64_t firstEntry,
+                              std::uint64_t lastEntry) {
+    double clusterSum = 0;
+    for (auto entryId = firstEntry; entryId < lastEntry; ++entryId)
+      clusterSum += (*view)(entryId);
+    *sum += clusterSum;
+    *nValues += lastEntry - firstEntry;
+  };
+}
+
+// The elements of the entries of one cluster are stored contiguously, so they
+// are summed from the first element of the first entry to the last element of
+// the last entry
+template <typename T>
+static ColumnReducer_t make_collection_reducer(ROOT::RNTupleReader &reader,
+                                               const std::string &name,
+                                               double *sum,
+                                               std::uint64_t *nValues) {
+  auto collection = std::make_shared<ROOT::RNTupleCollectionView>(
+      reader.GetCollectionView(name));
+  auto items =
+      std::make_shared<ROOT::RNTupleView<T>>(collection->GetView<T>("_0"));
+  return [collection, items, sum, nValues](std::uint64_t firstEntry,
+                                           std::uint64_t lastEntry) {
+    if (firstEntry == lastEntry)
+      return;
+    auto first = *collection->GetCollectionRange(firstEntry).begin();
+    auto lastRange = collection->GetCollectionRange(lastEntry - 1);
+    auto end = (*lastRange.begin()).GetIndexInCluster() + lastRange.size();
+
+    double clusterSum = 0;
+    for (auto i = first.GetIndexInCluster(); i < end; ++i)
+      clusterSum += (*items)(ROOT::RNTupleLocalIndex(first.GetClusterId(), i));
+    *sum += clusterSum;
+    *nValues += end - first.GetIndexInCluster();
+  };
+}
+
+static AnalysisTime_t analysis_rntuple(const std::vector<std::string> &columns,
+                                       const std::string &ntupleName,
+                                       const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches,
+                                       TH1D *hist, ScanStats *stats) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto ntuple = acquire_rntuple(ntupleName, opts, caches);
+  const auto &desc = ntuple->GetDescriptor();
+  auto clusterBoundaries = get_cluster_boundaries(desc);
+  auto clusters = get_unit_range(clusterBoundaries.size() - 1, slice);
+
+  std::vector<double> sums(columns.size());
+  std::uint64_t nValues = 0;
+  std::vector<ColumnReducer_t> reducers;
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    const auto &name = columns[i];
+    const auto &typeName =
+        desc.GetFieldDescriptor(desc.FindFieldId(name)).GetTypeName();
+    auto valueType = get_collection_value_type(typeName);
+
+    auto found =
+        visit_root_type(valueType.empty() ? typeName : valueType, [&](auto tag) {
+          using T = typename decltype(tag)::Type;
+          reducers.push_back(
+              valueType.empty()
+                  ? make_reducer<T>(*ntuple, name, &sums[i], &nValues)
+                  : make_collection_reducer<T>(*ntuple, name, &sums[i],
+                                               &nValues));
+        });
+    if (found)
+      continue;
+
+    // Values of other types are only read and counted
+    auto view =
+        std::make_shared<ROOT::RNTupleView<void>>(ntuple->GetView<void>(name));
+    reducers.push_back([view, &nValues](std::uint64_t firstEntry,
+                                        std::uint64_t lastEntry) {
+      for (auto entryId = firstEntry; entryId < lastEntry; ++entryId)
+        (*view)(entryId);
+      nValues += lastEntry - firstEntry;
+    });
+  }
+
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
+
+  for (auto cluster = clusters.first; cluster < clusters.second; ++cluster) {
+    TraceContext unitContext("cluster " + std::to_string(cluster));
+    for (const auto &reducer : reducers)
+      reducer(clusterBoundaries[cluster], clusterBoundaries[cluster + 1]);
+  }
+  for (std::size_t i = 0; i < sums.size(); ++i)
+    hist->Fill(i, sums[i]);
+  stats->nEntries +=
+      clusterBoundaries[clusters.second] - clusterBoundaries[clusters.first];
+  stats->nValues += nValues;
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_init =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_first - ts_init)
+          .count();
+  auto runtime_analyze =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
+          .count();
+
+  return std::make_pair(runtime_init, runtime_analyze);
+}
+
+// Picks the columns to read from the column list of the dataset, keeping
+// their order in the list
+static std::vector<std::string>
+select_columns(const ColumnSelection &selection, const std::string &basename) {
+  std::vector<std::string> allColumns;
+  for (auto &name : get_column_names(basename)) {
+    // Skip the size and sub-field columns that RDataFrame adds for
+    // collections
+    if (name.rfind("R_rdf_", 0) == 0 || name.rfind('#', 0) == 0 ||
+        name.find('.') != std::string::npos)
+      continue;
+    allColumns.emplace_back(std::move(name));
+  }
+  if (allColumns.empty()) {
+    throw std::invalid_argument(
+        "No columns in " + basename +
+        "_columns.txt, write them with print_column_names.py");
+  }
+
+  auto nColumns = selection.nColumns ? selection.nColumns : allColumns.size();
+  if (nColumns > allColumns.size()) {
+    throw std::invalid_argument("Cannot read " + std::to_string(nColumns) +
+                                " columns, the dataset has " +
+                                std::to_string(allColumns.size()));
+  }
+
+  std::vector<std::string> columns;
+  if (selection.random) {
+    std::mt19937_64 rng(selection.seed);
+    std::sample(allColumns.begin(), allColumns.end(),
+                std::back_inserter(columns), nColumns, rng);
+  } else {
+    columns.assign(allColumns.begin(), allColumns.begin() + nColumns);
+  }
+  return columns;
+}
+
+// Reads the selected columns of opts.input_path, either from the command line
+// or as a request to the analysis server. The resident state is owned by the
+// caller.
+static AnalysisTime_t run_benchmark(const ColumnSelection &selection,
+                                    const AnalysisOptions &opts,
+                                    const ResidentState &resident, TH1D *hist,
+                                    ScanStats *stats) {
+  std::string basename, suffix;
+  split_path(opts.input_path, &basename, &suffix);
+  auto fmt = get_file_format(suffix);
+
+  if (!opts.selection_cache_dir.empty() || !opts.column_cache_dir.empty()) {
+    throw std::invalid_argument(
+        "The selection and column caches are not supported by the column scan");
+  }
+  if (!opts.entry_list_path.empty()) {
+    throw std::invalid_argument(
+        "Entry lists are not supported by the column scan");
+  }
+
+  auto columns = select_columns(selection, basename);
+  // One bin per column, holding the sum of its values
+  hist->SetBins(columns.size(), 0, columns.size());
+  for (std::size_t i = 0; i < columns.size(); ++i)
+    hist->GetXaxis()->SetBinLabel(i + 1, columns[i].c_str());
+
+  // Keep the trace open until all threads are done
+  auto trace = get_read_trace(opts);
+
+  AnalysisCaches caches;
+  caches.metadata = resident.metadata;
+  caches.readers = resident.readers;
+
+  AnalysisFn_t analysis;
+  switch (fmt) {
+  case FileFormat::rntuple:
+    analysis = [&](const WorkerSlice &slice, TH1D *threadHist) {
+      return analysis_rntuple(columns, selection.ntupleName, opts, slice,
+                              caches, threadHist, stats);
+    };
+    break;
+  case FileFormat::parquet:
+    analysis = [&](const WorkerSlice &slice, TH1D *threadHist) {
+      return analysis_parquet(columns, opts, slice, caches, threadHist, stats);
+    };
+    break;
+  case FileFormat::orc:
+    analysis = [&](const WorkerSlice &slice, TH1D *threadHist) {
+      return analysis_orc(columns, opts, slice, caches, threadHist, stats);
+    };
+    break;
+  default:
+    throw std::invalid_argument("Invalid file format: " + suffix);
+  }
+
+  return run_analysis(opts, analysis, hist, resident.threads);
+}
+
+// Parses K or K:SEED
+static bool parse_column_selection(std::string_view spec,
+                                   ColumnSelection *selection) {
+  try {
+    auto sep = spec.find(':');
+    selection->nColumns = std::stoull(std::string(spec.substr(0, sep)));
+    if (sep != std::string_view::npos) {
+      selection->random = true;
+      selection->seed = std::stoull(std::string(spec.substr(sep + 1)));
+    }
+  } catch (const std::logic_error &) {
+    return false;
+  }
+  return true;
+}
+
+static void print_columns_usage(const char *progname) {
+  print_usage((std::string(progname) + " NTUPLE K[:SEED]").c_str());
+  printf("\nReads the first K columns listed in INPUT_BASENAME_columns.txt, or "
+         "K random ones\ndrawn with SEED. With K = 0, all columns are read.\n");
+}
+
+int main(int argc, char **argv) {
+  auto ts_init = std::chrono::steady_clock::now();
+
+  // The ntuple name and column selection are the first arguments, the
+  // remaining ones are the usual benchmark options
+  ColumnSelection selection;
+  AnalysisOptions opts;
+  if (argc < 3 || !parse_column_selection(argv[2], &selection) ||
+      !parse_options(argc - 2, argv + 2, &opts)) {
+    print_columns_usage(argv[0]);
+    return 1;
+  }
+  selection.ntupleName = argv[1];
+
+  auto hist =
+      std::make_unique<TH1D>("columns", "Sum of the values per column", 1, 0, 1);
+
+  ScanStats stats;
+  BenchmarkFn_t benchmark = [&selection, &stats](
+                                const AnalysisOptions &requestOpts,
+                                const ResidentState &resident,
+                                TH1D *requestHist) {
+    return run_benchmark(selection, requestOpts, resident, requestHist,
+                         &stats);
+  };
+
+  if (!opts.server_socket.empty()) {
+    AnalysisServer server(opts, benchmark, *hist);
+    return server.Run();
+  }
+
+  std::shared_ptr<MetadataCache> metadataCache;
+  if (!opts.metadata_cache_dir.empty()) {
+    metadataCache = std::make_shared<MetadataCache>(opts.metadata_cache_dir,
+                                                    opts.input_path);
+  }
+
+  auto pageFaults = get_page_faults();
+  AnalysisTime_t runtime_analysis;
+  try {
+    ResidentState resident;
+    resident.metadata = metadataCache.get();
+    runtime_analysis = benchmark(opts, resident, hist.get());
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if (metadataCache)
+    metadataCache->Save();
+  if (auto throttle = get_storage_throttle(opts)) {
+    std::cerr << "storage: " << throttle->GetNRequests() << " requests, "
+              << throttle->GetNBytes() << " bytes" << std::endl;
+  }
+  print_memory_pool_stats(opts, get_page_faults() - pageFaults);
+  std::cerr << "columns: " << hist->GetNbinsX() << ", " << stats.nEntries
+            << " entries, " << stats.nValues << " values" << std::endl;
+
+  if (opts.partial) {
+    save_partial_histogram(hist.get(), opts.histo_path, opts.unit_range,
+                           runtime_analysis);
+  } else if (!opts.histo_path.empty()) {
+    save_histogram(hist.get(), opts.histo_path);
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_main =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_init)
+          .count();
+
+  std::cout << runtime_analysis.first << ", " << runtime_analysis.second << ", "
+            << runtime_main << std::endl;
+
+  return 0;
+}
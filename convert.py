@@ -25,7 +25,7 @@ def convert2orc(ak_array, output_name, events_per_cluster, uncompressed=False, m
     )
 
 
-def convert2parquet(ak_array, output_name, events_per_cluster, uncompressed=False, mirror_rntuple_settings=False):
+def convert2parquet(ak_array, output_name, events_per_cluster, uncompressed=False, mirror_rntuple_settings=False, page_index=False, dictionary_columns=None):
     compression = "NONE" if uncompressed else "ZSTD"
     ak.to_parquet(
         ak_array,
@@ -34,8 +34,10 @@ def convert2parquet(ak_array, output_name, events_per_cluster, uncompressed=Fals
         compression="NONE" if uncompressed else "ZSTD",
         compression_level=None if uncompressed else 3,
         parquet_metadata_statistics=False,
+        parquet_dictionary_encoding={column: True for column in dictionary_columns} if dictionary_columns else False,
         data_page_size=1024 * 1024 if mirror_rntuple_settings else None,
-        row_group_size=events_per_cluster if mirror_rntuple_settings else 64 * 1024 * 1024
+        row_group_size=events_per_cluster if mirror_rntuple_settings else 64 * 1024 * 1024,
+        parquet_extra_options={"write_page_index": page_index},
     )
 
 
@@ -77,6 +79,21 @@ if __name__ == "__main__":
         action="store_true",
         help="mirror rntuple's write options",
     )
+    parser.add_argument(
+        "-p",
+        "--page-index",
+        dest="page_index",
+        action="store_true",
+        help="write the page index (parquet only)",
+    )
+    parser.add_argument(
+        "-d",
+        "--dictionary",
+        dest="dictionary_columns",
+        type=lambda columns: columns.split(","),
+        default=None,
+        help="comma-separated columns to dictionary encode (parquet only)",
+    )
 
     args = parser.parse_args()
 
@@ -107,6 +124,8 @@ if __name__ == "__main__":
             events_per_cluster,
             uncompressed=args.uncompressed,
             mirror_rntuple_settings=args.mirror_rntuple,
+            page_index=args.page_index,
+            dictionary_columns=args.dictionary_columns,
         )
 
     print("---> done!")
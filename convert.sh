@@ -15,6 +15,9 @@ python convert.py DecayTree data/B2HHH.root data/B2HHH.orc -o orc
 python convert.py DecayTree data/B2HHH.root data/B2HHH_ntplcfg.parquet -o parquet -m
 python convert.py DecayTree data/B2HHH.root data/B2HHH_ntplcfg.orc -o orc -m
 
+# With the page index, for the sparse reads
+python convert.py DecayTree data/B2HHH.root data/B2HHH_pageidx.parquet -o parquet -p
+
 ############################# CMS ##############################
 
 # Without default write opts
@@ -24,3 +27,6 @@ python convert.py Events data/ttjet_signed.root data/ttjet_signed.orc -o orc
 # With RNTuple write opts mirrored
 python convert.py Events data/ttjet_signed.root data/ttjet_signed_ntplcfg.parquet -o parquet -m
 python convert.py Events data/ttjet_signed.root data/ttjet_signed_ntplcfg.orc -o orc -m
+
+# With the page index, for the sparse reads
+python convert.py Events data/ttjet_signed.root data/ttjet_signed_pageidx.parquet -o parquet -p
@@ -0,0 +1,440 @@
+// Microbenchmark of the read path of a single column at a time, split into
+// reading the (compressed) bytes from the file, decompressing the pages and
+// decoding the values. This shows which columns, codecs and encodings limit the
+// analysis kernels.
+//
+//   RNTuple: the sealed pages of every physical column are loaded one by one,
+//            decompressed with the RNTuple decompressor and unpacked by the
+//            column element (bit-packing, split, delta and zigzag encodings)
+//   Parquet: the column chunks are read as a whole, the pages are decompressed
+//            by the page reader and decoded (levels, RLE, dictionary, delta
+//            and bit-packing) by a record reader. Decoding is timed together
+//            with decompression, and the decompression time is subtracted.
+//   ORC:     the Arrow adapter does not expose the streams of a stripe, so the
+//            stripes are read one column at a time and only the time spent in
+//            reads is separated from decompression and decoding
+
+#include <ROOT/RColumnElementBase.hxx>
+#include <ROOT/RNTupleDescriptor.hxx>
+#include <ROOT/RNTupleZip.hxx>
+#include <ROOT/RPageStorage.hxx>
+
+#include <arrow/adapters/orc/adapter.h>
+#include <arrow/io/file.h>
+#include <arrow/io/memory.h>
+#include <arrow/util/byte_size.h>
+#include <arrow/util/compression.h>
+#include <parquet/column_reader.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <getopt.h>
+
+#include "util.hxx"
+
+using Clock_t = std::chrono::steady_clock;
+using Duration_t = std::chrono::duration<double, std::micro>;
+
+struct DecodeOptions {
+  std::string input_path;
+  std::string ntuple_name = "Events";
+  // Top-level fields to decode, all if empty
+  std::vector<std::string> columns;
+};
+
+// Cost of reading one column of the whole file
+struct ColumnTimes {
+  std::string name;
+  std::string encoding;
+  std::string codec;
+  std::uint64_t compressedBytes = 0;
+  // Size of the encoded values, after decompression
+  std::uint64_t uncompressedBytes = 0;
+  // In microseconds, the decompression time is negative if it is not measured
+  // separately
+  double readTime = 0;
+  double decompressTime = 0;
+  double decodeTime = 0;
+};
+
+static bool parse_decode_options(int argc, char **argv, DecodeOptions *opts) {
+  static const struct option longOptions[] = {
+      {"ntuple", required_argument, nullptr, 'n'},
+      {"columns", required_argument, nullptr, 'c'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "n:c:h", longOptions, nullptr)) != -1) {
+    switch (c) {
+    case 'n':
+      opts->ntuple_name = optarg;
+      break;
+    case 'c': {
+      std::istringstream is(optarg);
+      std::string column;
+      while (std::getline(is, column, ','))
+        opts->columns.push_back(column);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+
+  if (optind + 1 != argc)
+    return false;
+  opts->input_path = argv[optind];
+  return true;
+}
+
+static void print_decode_usage(const char *progname) {
+  printf("%s [OPTIONS] INPUT_PATH\n\n", progname);
+  printf("Options:\n");
+  printf("  -n, --ntuple NAME       name of the RNTuple (default: Events)\n");
+  printf("  -c, --columns A,B,...   columns to decode (default: all)\n");
+}
+
+static bool is_selected(const DecodeOptions &opts, const std::string &name) {
+  return opts.columns.empty() || std::find(opts.columns.begin(),
+                                           opts.columns.end(),
+                                           name) != opts.columns.end();
+}
+
+// The codec of a compressed RNTuple page, from the header of its first
+// compression block
+static std::string get_root_codec(const unsigned char *buffer) {
+  std::string magic(reinterpret_cast<const char *>(buffer), 2);
+  if (magic == "ZS")
+    return "zstd";
+  if (magic == "L4")
+    return "lz4";
+  if (magic == "ZL" || magic == "CS")
+    return "zlib";
+  if (magic == "XZ")
+    return "lzma";
+  return "unknown";
+}
+
+static void decode_rntuple_column(ROOT::Internal::RPageSource &source,
+                                  const ROOT::RNTupleDescriptor &desc,
+                                  ROOT::DescriptorId_t physicalColumnId,
+                                  ColumnTimes *times) {
+  auto type = desc.GetColumnDescriptor(physicalColumnId).GetType();
+  auto element = ROOT::Internal::RColumnElementBase::Generate<void>(type);
+  times->encoding = ROOT::Internal::RColumnElementBase::GetColumnTypeName(type);
+  times->codec = "none";
+
+  std::vector<unsigned char> sealedBuffer, packedBuffer, unpackedBuffer;
+  for (const auto &cluster : desc.GetClusterIterable()) {
+    if (!cluster.ContainsColumn(physicalColumnId))
+      continue;
+
+    ROOT::NTupleSize_t firstInCluster = 0;
+    for (const auto &pageInfo :
+         cluster.GetPageRange(physicalColumnId).GetPageInfos()) {
+      ROOT::RNTupleLocalIndex localIndex(cluster.GetId(), firstInCluster);
+      firstInCluster += pageInfo.GetNElements();
+
+      // A first call without a buffer gets the size of the sealed page
+      ROOT::Internal::RPageStorage::RSealedPage sealedPage;
+      source.LoadSealedPage(physicalColumnId, localIndex, sealedPage);
+      sealedBuffer.resize(sealedPage.GetBufferSize());
+      sealedPage.SetBuffer(sealedBuffer.data());
+      auto ts_read = Clock_t::now();
+      source.LoadSealedPage(physicalColumnId, localIndex, sealedPage);
+      auto ts_decompress = Clock_t::now();
+
+      auto nElements = sealedPage.GetNElements();
+      auto packedSize = element->GetPackedSize(nElements);
+      packedBuffer.resize(packedSize);
+      const void *packed = sealedBuffer.data();
+      if (sealedPage.GetDataSize() != packedSize) {
+        ROOT::Internal::RNTupleDecompressor::Unzip(sealedBuffer.data(),
+                                                   sealedPage.GetDataSize(),
+                                                   packedSize,
+                                                   packedBuffer.data());
+        packed = packedBuffer.data();
+      }
+      auto ts_decode = Clock_t::now();
+
+      unpackedBuffer.resize(nElements * element->GetSize());
+      element->Unpack(unpackedBuffer.data(), packed, nElements);
+      auto ts_end = Clock_t::now();
+
+      if (sealedPage.GetDataSize() != packedSize && times->codec == "none")
+        times->codec = get_root_codec(sealedBuffer.data());
+      times->compressedBytes += sealedPage.GetDataSize();
+      times->uncompressedBytes += packedSize;
+      times->readTime += Duration_t(ts_decompress - ts_read).count();
+      times->decompressTime += Duration_t(ts_decode - ts_decompress).count();
+      times->decodeTime += Duration_t(ts_end - ts_decode).count();
+    }
+  }
+}
+
+static std::vector<ColumnTimes> decode_rntuple(const DecodeOptions &opts) {
+  auto source = ROOT::Internal::RPageSource::Create(opts.ntuple_name,
+                                                    opts.input_path);
+  source->Attach();
+  auto descriptorGuard = source->GetSharedDescriptorGuard();
+  const auto &desc = descriptorGuard.GetRef();
+
+  std::vector<ColumnTimes> results;
+  // Walks the fields depth-first, one result per physical column
+  std::function<void(ROOT::DescriptorId_t, const std::string &)> visit =
+      [&](ROOT::DescriptorId_t fieldId, const std::string &name) {
+        for (const auto &column : desc.GetColumnIterable(fieldId)) {
+          if (column.IsAliasColumn())
+            continue;
+          ColumnTimes times;
+          times.name = name + "[" + std::to_string(column.GetIndex()) + "]";
+          decode_rntuple_column(*source, desc, column.GetPhysicalId(), &times);
+          results.push_back(times);
+        }
+        for (const auto &child : desc.GetFieldIterable(fieldId))
+          visit(child.GetId(), name + "." + child.GetFieldName());
+      };
+
+  for (const auto &field : desc.GetTopLevelFields()) {
+    if (is_selected(opts, field.GetFieldName()))
+      visit(field.GetId(), field.GetFieldName());
+  }
+  return results;
+}
+
+static std::vector<ColumnTimes> decode_parquet(const DecodeOptions &opts) {
+  std::shared_ptr<arrow::io::ReadableFile> file;
+  PARQUET_ASSIGN_OR_THROW(file, arrow::io::ReadableFile::Open(opts.input_path));
+  auto reader = parquet::ParquetFileReader::Open(file);
+  auto metadata = reader->metadata();
+  auto schema = metadata->schema();
+
+  std::vector<ColumnTimes> results;
+  for (int col = 0; col < schema->num_columns(); ++col) {
+    const auto *descr = schema->Column(col);
+    if (!is_selected(opts, descr->path()->ToDotVector()[0]))
+      continue;
+
+    ColumnTimes times;
+    times.name = descr->path()->ToDotString();
+    for (int rowGroup = 0; rowGroup < metadata->num_row_groups();
+         ++rowGroup) {
+      auto chunk = metadata->RowGroup(rowGroup)->ColumnChunk(col);
+      if (rowGroup == 0) {
+        for (auto encoding : chunk->encodings()) {
+          times.encoding += (times.encoding.empty() ? "" : "|") +
+                            parquet::EncodingToString(encoding);
+        }
+        times.codec =
+            arrow::util::Codec::GetCodecAsString(chunk->compression());
+      }
+
+      auto start = chunk->has_dictionary_page()
+                       ? chunk->dictionary_page_offset()
+                       : chunk->data_page_offset();
+      auto ts_read = Clock_t::now();
+      std::shared_ptr<arrow::Buffer> buffer;
+      PARQUET_ASSIGN_OR_THROW(
+          buffer, file->ReadAt(start, chunk->total_compressed_size()));
+      auto ts_decompress = Clock_t::now();
+
+      auto openPages = [&]() {
+        return parquet::PageReader::Open(
+            std::make_shared<arrow::io::BufferReader>(buffer),
+            chunk->num_values(), chunk->compression(),
+            parquet::default_reader_properties());
+      };
+      auto pages = openPages();
+      while (pages->NextPage()) {
+      }
+      auto ts_decode = Clock_t::now();
+
+      auto recordReader = parquet::internal::RecordReader::Make(
+          descr, parquet::internal::LevelInfo::ComputeLevelInfo(descr));
+      recordReader->SetPageReader(openPages());
+      recordReader->ReadRecords(metadata->RowGroup(rowGroup)->num_rows());
+      auto ts_end = Clock_t::now();
+
+      auto decompressTime = Duration_t(ts_decode - ts_decompress).count();
+      times.compressedBytes += chunk->total_compressed_size();
+      times.uncompressedBytes += chunk->total_uncompressed_size();
+      times.readTime += Duration_t(ts_decompress - ts_read).count();
+      times.decompressTime += decompressTime;
+      times.decodeTime +=
+          std::max(Duration_t(ts_end - ts_decode).count() - decompressTime, 0.);
+    }
+    results.push_back(times);
+  }
+  return results;
+}
+
+// Arrow file that counts the time spent in and the bytes returned by reads
+class TimingFile : public arrow::io::RandomAccessFile {
+public:
+  explicit TimingFile(std::shared_ptr<arrow::io::RandomAccessFile> file)
+      : fFile(std::move(file)) {}
+
+  arrow::Status Close() override { return fFile->Close(); }
+  bool closed() const override { return fFile->closed(); }
+  arrow::Result<std::int64_t> Tell() const override { return fFile->Tell(); }
+  arrow::Status Seek(std::int64_t position) override {
+    return fFile->Seek(position);
+  }
+  arrow::Result<std::int64_t> GetSize() override { return fFile->GetSize(); }
+
+  arrow::Result<std::int64_t> Read(std::int64_t nbytes, void *out) override {
+    return Time([&]() { return fFile->Read(nbytes, out); });
+  }
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  Read(std::int64_t nbytes) override {
+    return Time([&]() { return fFile->Read(nbytes); });
+  }
+  arrow::Result<std::int64_t> ReadAt(std::int64_t position, std::int64_t nbytes,
+                                     void *out) override {
+    return Time([&]() { return fFile->ReadAt(position, nbytes, out); });
+  }
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  ReadAt(std::int64_t position, std::int64_t nbytes) override {
+    return Time([&]() { return fFile->ReadAt(position, nbytes); });
+  }
+
+  void Reset() {
+    fReadTime = 0;
+    fNBytes = 0;
+  }
+  double GetReadTime() const { return fReadTime; }
+  std::uint64_t GetNBytes() const { return fNBytes; }
+
+private:
+  template <typename ReadFn>
+  std::invoke_result_t<ReadFn> Time(ReadFn read) {
+    auto ts_start = Clock_t::now();
+    auto result = read();
+    fReadTime += Duration_t(Clock_t::now() - ts_start).count();
+    if (result.ok()) {
+      if constexpr (std::is_same_v<decltype(result),
+                                   arrow::Result<std::int64_t>>)
+        fNBytes += *result;
+      else
+        fNBytes += (*result)->size();
+    }
+    return result;
+  }
+
+  std::shared_ptr<arrow::io::RandomAccessFile> fFile;
+  double fReadTime = 0;
+  std::uint64_t fNBytes = 0;
+};
+
+static std::vector<ColumnTimes> decode_orc(const DecodeOptions &opts) {
+  std::shared_ptr<arrow::io::ReadableFile> inputFile;
+  PARQUET_ASSIGN_OR_THROW(inputFile,
+                          arrow::io::ReadableFile::Open(opts.input_path));
+  auto file = std::make_shared<TimingFile>(std::move(inputFile));
+  std::unique_ptr<arrow::adapters::orc::ORCFileReader> reader;
+  PARQUET_ASSIGN_OR_THROW(reader, arrow::adapters::orc::ORCFileReader::Open(
+                                      file, arrow::default_memory_pool()));
+  std::shared_ptr<arrow::Schema> schema;
+  PARQUET_ASSIGN_OR_THROW(schema, reader->ReadSchema());
+  arrow::Compression::type compression;
+  PARQUET_ASSIGN_OR_THROW(compression, reader->GetCompression());
+  auto codec = arrow::util::Codec::GetCodecAsString(compression);
+
+  std::vector<ColumnTimes> results;
+  for (const auto &field : schema->fields()) {
+    if (!is_selected(opts, field->name()))
+      continue;
+
+    ColumnTimes times;
+    times.name = field->name();
+    times.encoding = "-";
+    times.codec = codec;
+    times.decompressTime = -1;
+    for (std::int64_t stripe = 0; stripe < reader->NumberOfStripes();
+         ++stripe) {
+      file->Reset();
+      auto ts_start = Clock_t::now();
+      std::shared_ptr<arrow::RecordBatch> batch;
+      PARQUET_ASSIGN_OR_THROW(batch,
+                              reader->ReadStripe(stripe, {field->name()}));
+      auto ts_end = Clock_t::now();
+
+      // The decoded size stands in for the size of the encoded values
+      times.compressedBytes += file->GetNBytes();
+      times.uncompressedBytes += arrow::util::TotalBufferSize(*batch);
+      times.readTime += file->GetReadTime();
+      times.decodeTime +=
+          Duration_t(ts_end - ts_start).count() - file->GetReadTime();
+    }
+    results.push_back(times);
+  }
+  return results;
+}
+
+// Bytes per microsecond to GB/s
+static double get_throughput(std::uint64_t nBytes, double time) {
+  return time > 0 ? nBytes / time / 1000 : 0;
+}
+
+int main(int argc, char **argv) {
+  DecodeOptions opts;
+  if (!parse_decode_options(argc, argv, &opts)) {
+    print_decode_usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<ColumnTimes> results;
+  try {
+    switch (get_file_format(get_path_suffix(opts.input_path))) {
+    case FileFormat::rntuple:
+      results = decode_rntuple(opts);
+      break;
+    case FileFormat::parquet:
+      results = decode_parquet(opts);
+      break;
+    case FileFormat::orc:
+      results = decode_orc(opts);
+      break;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  // One line per column: name, encoding, codec, compressed and uncompressed
+  // bytes, the read, decompression and decoding times in microseconds and the
+  // corresponding throughput in GB/s (of the compressed bytes for reading and
+  // of the uncompressed bytes otherwise)
+  for (const auto &times : results) {
+    std::cout << times.name << ", " << times.encoding << ", " << times.codec
+              << ", " << times.compressedBytes << ", "
+              << times.uncompressedBytes << ", " << times.readTime << ", ";
+    if (times.decompressTime >= 0)
+      std::cout << times.decompressTime;
+    std::cout << ", " << times.decodeTime << ", "
+              << get_throughput(times.compressedBytes, times.readTime) << ", ";
+    if (times.decompressTime >= 0)
+      std::cout << get_throughput(times.uncompressedBytes,
+                                  times.decompressTime);
+    std::cout << ", "
+              << get_throughput(times.uncompressedBytes, times.decodeTime)
+              << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include "dictionary_column.hxx"
+
+#include <parquet/column_reader.h>
+#include <parquet/metadata.h>
+
+#include <stdexcept>
+
+// Whether the chunk has a dictionary page and all of its data pages are
+// dictionary encoded. Writers that do not record the page encoding stats are
+// taken as not fully dictionary encoded.
+static bool
+is_fully_dictionary_encoded(const parquet::ColumnChunkMetaData &chunk) {
+  if (!chunk.has_dictionary_page() || chunk.encoding_stats().empty())
+    return false;
+  for (const auto &stats : chunk.encoding_stats()) {
+    if (stats.page_type != parquet::PageType::DATA_PAGE &&
+        stats.page_type != parquet::PageType::DATA_PAGE_V2)
+      continue;
+    if (stats.encoding != parquet::Encoding::PLAIN_DICTIONARY &&
+        stats.encoding != parquet::Encoding::RLE_DICTIONARY)
+      return false;
+  }
+  return true;
+}
+
+std::optional<DictionaryColumn>
+read_dictionary_column(parquet::ParquetFileReader &reader, int rowGroup,
+                       const std::string &name) {
+  auto metadata = reader.metadata();
+  auto column = get_leaf_column(*metadata->schema(), name);
+  auto descr = metadata->schema()->Column(column);
+  if (descr->physical_type() != parquet::Type::INT32)
+    return std::nullopt;
+
+  // Decided from the column chunk metadata, before a reader is created
+  if (!is_fully_dictionary_encoded(
+          *metadata->RowGroup(rowGroup)->ColumnChunk(column)))
+    return std::nullopt;
+
+  auto columnReader = std::static_pointer_cast<parquet::Int32Reader>(
+      reader.RowGroup(rowGroup)->ColumnWithExposeEncoding(
+          column, parquet::ExposedEncoding::DICTIONARY));
+  if (columnReader->GetExposedEncoding() != parquet::ExposedEncoding::DICTIONARY)
+    return std::nullopt;
+
+  const auto maxDefLevel = descr->max_definition_level();
+  const auto maxRepLevel = descr->max_repetition_level();
+  const auto nRows = metadata->RowGroup(rowGroup)->num_rows();
+
+  DictionaryColumn result;
+  result.indices.reserve(nRows);
+  if (maxRepLevel > 0)
+    result.offsets.reserve(nRows + 1);
+
+  constexpr std::int64_t kBatchSize = 64 * 1024;
+  std::vector<std::int16_t> defLevels(kBatchSize);
+  std::vector<std::int16_t> repLevels(kBatchSize);
+  std::vector<std::int32_t> indices(kBatchSize);
+  while (columnReader->HasNext()) {
+    std::int64_t nIndices = 0;
+    const std::int32_t *dictionary = nullptr;
+    std::int32_t dictionaryLength = 0;
+    auto nLevels = columnReader->ReadBatchWithDictionary(
+        kBatchSize, maxDefLevel > 0 ? defLevels.data() : nullptr,
+        maxRepLevel > 0 ? repLevels.data() : nullptr, indices.data(), &nIndices,
+        &dictionary, &dictionaryLength);
+    if (dictionary)
+      result.dictionary.assign(dictionary, dictionary + dictionaryLength);
+
+    if (maxRepLevel == 0) {
+      if (nIndices != nLevels)
+        return std::nullopt;
+      result.indices.insert(result.indices.end(), indices.begin(),
+                            indices.begin() + nIndices);
+      continue;
+    }
+
+    // A repetition level of 0 starts a new entry, a definition level below the
+    // maximum is an empty (or null) list without values
+    std::int64_t index = 0;
+    for (std::int64_t i = 0; i < nLevels; ++i) {
+      if (repLevels[i] == 0)
+        result.offsets.push_back(result.indices.size());
+      if (defLevels[i] == maxDefLevel)
+        result.indices.push_back(indices[index++]);
+    }
+  }
+  if (maxRepLevel > 0)
+    result.offsets.push_back(result.indices.size());
+
+  return result;
+}
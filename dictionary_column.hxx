@@ -0,0 +1,20 @@
+#ifndef DICTIONARY_COLUMN__HXX
+#define DICTIONARY_COLUMN__HXX
+
+#include <parquet/file_reader.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "util.hxx"
+
+// Reads the int32 column `name` of the row group as dictionary indices. Returns
+// std::nullopt if not all of its data pages are dictionary encoded, or if a
+// flat column has null values, in which case it has to be read as usual.
+std::optional<DictionaryColumn>
+read_dictionary_column(parquet::ParquetFileReader &reader, int rowGroup,
+                       const std::string &name);
+
+#endif // DICTIONARY_COLUMN__HXX
@@ -11,11 +11,25 @@
 #include <arrow/adapters/orc/adapter.h>
 #include <arrow/io/api.h>
 #include <parquet/arrow/reader.h>
+#include <parquet/exception.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
 #include <string>
 
+#include "column_cache.hxx"
+#include "dictionary_column.hxx"
+#include "memory_pool.hxx"
+#include "metadata_cache.hxx"
+#include "read_trace.hxx"
+#include "reader_pool.hxx"
+#include "selection_cache.hxx"
+#include "server.hxx"
+#include "sparse_read.hxx"
+#include "throttled_file.hxx"
 #include "util.hxx"
 
 constexpr double kKaonMassMeV = 493.677;
@@ -29,7 +43,46 @@ static double GetKE(double px, double py, double pz) {
   return sqrt(p2 + kKaonMassMeV * kKaonMassMeV);
 }
 
-const std::vector<std::string> columnNames = {
+using LhcbSchema_t = Schema<
+    double, double,
+    // H1
+    std::int32_t, double, double, double, double, double, double, std::int32_t,
+    // H2
+    std::int32_t, double, double, double, double, double, double, std::int32_t,
+    // H3
+    std::int32_t, double, double, double, double, double, double, std::int32_t>;
+
+// Column ids in lhcbSchema
+enum : std::size_t {
+  kBFlightDistance,
+  kBVertexChi2,
+  kH1Charge,
+  kH1IpChi2,
+  kH1PX,
+  kH1PY,
+  kH1PZ,
+  kH1ProbK,
+  kH1ProbPi,
+  kH1IsMuon,
+  kH2Charge,
+  kH2IpChi2,
+  kH2PX,
+  kH2PY,
+  kH2PZ,
+  kH2ProbK,
+  kH2ProbPi,
+  kH2IsMuon,
+  kH3Charge,
+  kH3IpChi2,
+  kH3PX,
+  kH3PY,
+  kH3PZ,
+  kH3ProbK,
+  kH3ProbPi,
+  kH3IsMuon,
+};
+
+const LhcbSchema_t lhcbSchema({
     "B_FlightDistance",
     "B_VertexChi2",
     "H1_Charge",
@@ -56,152 +109,162 @@ const std::vector<std::string> columnNames = {
     "H3_ProbK",
     "H3_ProbPi",
     "H3_isMuon",
+});
+
+// Columns needed to compute the B mass of the selected entries
+const std::vector<std::size_t> kinematicColumns = {
+    kH1PX, kH1PY, kH1PZ, kH2PX, kH2PY, kH2PZ, kH3PX, kH3PY, kH3PZ,
 };
 
-static AnalysisTime_t analysis_orc(const std::string &path,
-                                   const std::string &histo_path) {
-  auto ts_init = std::chrono::steady_clock::now();
-  auto hMass = std::make_unique<TH1D>("B_mass", "", 500, 5050, 5500);
+// Columns needed to evaluate the cuts and compute the B mass
+const std::vector<std::size_t> cutColumns = {
+    kH1PX,    kH1PY,     kH1PZ,     kH1ProbK, kH1ProbPi, kH1IsMuon,
+    kH2PX,    kH2PY,     kH2PZ,     kH2ProbK, kH2ProbPi, kH2IsMuon,
+    kH3PX,    kH3PY,     kH3PZ,     kH3ProbK, kH3ProbPi, kH3IsMuon,
+};
+
+// Flag columns that are read as dictionary indices from Parquet files, if
+// their column chunks are fully dictionary encoded
+const std::vector<std::size_t> isMuonColumns = {kH1IsMuon, kH2IsMuon,
+                                                kH3IsMuon};
+
+using DictionaryBatch_t =
+    ArrowBatch<LhcbSchema_t,
+               get_column_mask({kH1IsMuon, kH2IsMuon, kH3IsMuon})>;
+
+// Identifies the selection in the selection cache, to be updated whenever the
+// cuts change
+const std::string selectionCut =
+    "lhcb: !H{1,2,3}_isMuon && H{1,2,3}_ProbK >= 0.5 && H{1,2,3}_ProbPi <= 0.5";
+
+// Fills the B mass of the selected entries of the batch. Without a (cached)
+// selection, the cuts are evaluated and the passing entries are added to
+// `passing`. Compiled for every batch type, see ArrowBatch and RNTupleBatch.
+template <typename BatchT>
+static void process_batch(BatchT &batch, const Selection_t *selection,
+                          Selection_t *passing, TH1D *hMass) {
+  auto fill_mass = [&](std::int64_t entryId) {
+    double h1PX = get_column<kH1PX>(batch, entryId);
+    double h1PY = get_column<kH1PY>(batch, entryId);
+    double h1PZ = get_column<kH1PZ>(batch, entryId);
+    double h2PX = get_column<kH2PX>(batch, entryId);
+    double h2PY = get_column<kH2PY>(batch, entryId);
+    double h2PZ = get_column<kH2PZ>(batch, entryId);
+    double h3PX = get_column<kH3PX>(batch, entryId);
+    double h3PY = get_column<kH3PY>(batch, entryId);
+    double h3PZ = get_column<kH3PZ>(batch, entryId);
+
+    double b_px = h1PX + h2PX + h3PX;
+    double b_py = h1PY + h2PY + h3PY;
+    double b_pz = h1PZ + h2PZ + h3PZ;
+    double b_p2 = GetP2(b_px, b_py, b_pz);
+    double k1_E = GetKE(h1PX, h1PY, h1PZ);
+    double k2_E = GetKE(h2PX, h2PY, h2PZ);
+    double k3_E = GetKE(h3PX, h3PY, h3PZ);
+    double b_E = k1_E + k2_E + k3_E;
+    double b_mass = sqrt(b_E * b_E - b_p2);
+    hMass->Fill(b_mass);
+  };
+
+  if (selection) {
+    for (auto entryId : *selection)
+      fill_mass(entryId);
+    return;
+  }
+
+  // Evaluated once per dictionary entry for dictionary columns
+  auto is_muon = [](std::int32_t isMuon) { return isMuon != 0; };
+  auto h1IsMuon = make_column_cut<kH1IsMuon>(batch, is_muon);
+  auto h2IsMuon = make_column_cut<kH2IsMuon>(batch, is_muon);
+  auto h3IsMuon = make_column_cut<kH3IsMuon>(batch, is_muon);
 
-  arrow::MemoryPool *pool = arrow::default_memory_pool();
-  auto localFile = arrow::io::ReadableFile::Open(path, pool).ValueOrDie();
-  auto reader = arrow::adapters::orc::ORCFileReader::Open(localFile, pool).ValueOrDie();
+  for (std::int64_t entryId = 0; entryId < batch.GetNEntries(); ++entryId) {
+    if (h1IsMuon(batch, entryId) || h2IsMuon(batch, entryId) ||
+        h3IsMuon(batch, entryId))
+      continue;
+
+    constexpr double prob_k_cut = 0.5;
+    if (get_column<kH1ProbK>(batch, entryId) < prob_k_cut)
+      continue;
+    if (get_column<kH2ProbK>(batch, entryId) < prob_k_cut)
+      continue;
+    if (get_column<kH3ProbK>(batch, entryId) < prob_k_cut)
+      continue;
+
+    constexpr double prob_pi_cut = 0.5;
+    if (get_column<kH1ProbPi>(batch, entryId) > prob_pi_cut)
+      continue;
+    if (get_column<kH2ProbPi>(batch, entryId) > prob_pi_cut)
+      continue;
+    if (get_column<kH3ProbPi>(batch, entryId) > prob_pi_cut)
+      continue;
+
+    if (passing)
+      passing->push_back(entryId);
+    fill_mass(entryId);
+  }
+}
+
+static AnalysisTime_t analysis_orc(const AnalysisOptions &opts,
+                                   const WorkerSlice &slice,
+                                   const AnalysisCaches &caches, TH1D *hMass) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
 
-  auto schema = reader->ReadSchema().ValueOrDie();
+  auto pool = get_memory_pool(opts);
+  auto input = acquire_orc(opts, caches);
+  auto &reader = input->reader;
+  auto &localFile = input->file;
+  const auto &schema = input->schema;
   auto nStripes = reader->NumberOfStripes();
+  auto stripes = get_unit_range(nStripes, slice);
   std::shared_ptr<arrow::RecordBatch> recordBatch;
 
-  std::chrono::steady_clock::time_point ts_first =
-      std::chrono::steady_clock::now();
+  const ArrowBinding binding(lhcbSchema, LhcbSchema_t::GetAllColumns(),
+                             schema.get());
+  const ArrowBinding kinematicBinding(lhcbSchema, kinematicColumns,
+                                      schema.get());
 
-  for (std::int32_t stripe = 0; stripe < nStripes; ++stripe) {
-    recordBatch = reader->ReadStripe(stripe, columnNames).ValueOrDie();
-
-    auto arrH1IsMuon = std::static_pointer_cast<arrow::Int32Array>(
-        recordBatch->GetColumnByName("H1_isMuon"));
-    auto arrH2IsMuon = std::static_pointer_cast<arrow::Int32Array>(
-        recordBatch->GetColumnByName("H2_isMuon"));
-    auto arrH3IsMuon = std::static_pointer_cast<arrow::Int32Array>(
-        recordBatch->GetColumnByName("H3_isMuon"));
-
-    auto arrH1PX = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H1_PX"));
-    auto arrH1PY = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H1_PY"));
-    auto arrH1PZ = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H1_PZ"));
-    auto arrH1ProbK = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H1_ProbK"));
-    auto arrH1ProbPi = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H1_ProbPi"));
-
-    auto arrH2PX = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H2_PX"));
-    auto arrH2PY = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H2_PY"));
-    auto arrH2PZ = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H2_PZ"));
-    auto arrH2ProbK = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H2_ProbK"));
-    auto arrH2ProbPi = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H2_ProbPi"));
-
-    auto arrH3PX = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H3_PX"));
-    auto arrH3PY = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H3_PY"));
-    auto arrH3PZ = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H3_PZ"));
-    auto arrH3ProbK = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H3_ProbK"));
-    auto arrH3ProbPi = std::static_pointer_cast<arrow::DoubleArray>(
-        recordBatch->GetColumnByName("H3_ProbPi"));
-
-    auto rawH1IsMuon = arrH1IsMuon->raw_values();
-    ROOT::RVec<std::int32_t> valsH1IsMuon(rawH1IsMuon,
-                                          rawH1IsMuon + arrH1IsMuon->length());
-    auto rawH2IsMuon = arrH2IsMuon->raw_values();
-    ROOT::RVec<std::int32_t> valsH2IsMuon(rawH2IsMuon,
-                                          rawH2IsMuon + arrH2IsMuon->length());
-    auto rawH3IsMuon = arrH3IsMuon->raw_values();
-    ROOT::RVec<std::int32_t> valsH3IsMuon(rawH3IsMuon,
-                                          rawH3IsMuon + arrH3IsMuon->length());
-
-    auto rawH1PX = arrH1PX->raw_values();
-    ROOT::RVec<double> valsH1PX(rawH1PX, rawH1PX + arrH1PX->length());
-    auto rawH1PY = arrH1PY->raw_values();
-    ROOT::RVec<double> valsH1PY(rawH1PY, rawH1PY + arrH1PY->length());
-    auto rawH1PZ = arrH1PZ->raw_values();
-    ROOT::RVec<double> valsH1PZ(rawH1PZ, rawH1PZ + arrH1PZ->length());
-    auto rawH1ProbK = arrH1ProbK->raw_values();
-    ROOT::RVec<double> valsH1ProbK(rawH1ProbK,
-                                         rawH1ProbK + arrH1ProbK->length());
-    auto rawH1ProbPi = arrH1ProbPi->raw_values();
-    ROOT::RVec<double> valsH1ProbPi(rawH1ProbPi,
-                                          rawH1ProbPi + arrH1ProbPi->length());
-
-    auto rawH2PX = arrH2PX->raw_values();
-    ROOT::RVec<double> valsH2PX(rawH2PX, rawH2PX + arrH2PX->length());
-    auto rawH2PY = arrH2PY->raw_values();
-    ROOT::RVec<double> valsH2PY(rawH2PY, rawH2PY + arrH2PY->length());
-    auto rawH2PZ = arrH2PZ->raw_values();
-    ROOT::RVec<double> valsH2PZ(rawH2PZ, rawH2PZ + arrH2PZ->length());
-    auto rawH2ProbK = arrH2ProbK->raw_values();
-    ROOT::RVec<double> valsH2ProbK(rawH2ProbK,
-                                         rawH2ProbK + arrH2ProbK->length());
-    auto rawH2ProbPi = arrH2ProbPi->raw_values();
-    ROOT::RVec<double> valsH2ProbPi(rawH2ProbPi,
-                                          rawH2ProbPi + arrH2ProbPi->length());
-
-    auto rawH3PX = arrH3PX->raw_values();
-    ROOT::RVec<double> valsH3PX(rawH3PX, rawH3PX + arrH3PX->length());
-    auto rawH3PY = arrH3PY->raw_values();
-    ROOT::RVec<double> valsH3PY(rawH3PY, rawH3PY + arrH3PY->length());
-    auto rawH3PZ = arrH3PZ->raw_values();
-    ROOT::RVec<double> valsH3PZ(rawH3PZ, rawH3PZ + arrH3PZ->length());
-    auto rawH3ProbK = arrH3ProbK->raw_values();
-    ROOT::RVec<double> valsH3ProbK(rawH3ProbK,
-                                         rawH3ProbK + arrH3ProbK->length());
-    auto rawH3ProbPi = arrH3ProbPi->raw_values();
-    ROOT::RVec<double> valsH3ProbPi(rawH3ProbPi,
-                                          rawH3ProbPi + arrH3ProbPi->length());
-
-    for (std::int64_t entryId = 0; entryId < recordBatch->num_rows(); ++entryId) {
-      if (valsH1IsMuon[entryId] || valsH2IsMuon[entryId] ||
-          valsH3IsMuon[entryId]) {
-        continue;
-      }
+  // The ORC adapter does not expose the stream offsets within a stripe, so we
+  // can only prefetch entire stripes. Only do so if all columns are read.
+  bool prefetchStripes =
+      opts.io == IoBackend::uring &&
+      static_cast<int>(LhcbSchema_t::kNColumns) == schema->num_fields();
 
-      constexpr double prob_k_cut = 0.5;
-      if (valsH1ProbK[entryId] < prob_k_cut)
-        continue;
-      if (valsH2ProbK[entryId] < prob_k_cut)
-        continue;
-      if (valsH3ProbK[entryId] < prob_k_cut)
-        continue;
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
 
-      constexpr double prob_pi_cut = 0.5;
-      if (valsH1ProbPi[entryId] > prob_pi_cut)
-        continue;
-      if (valsH2ProbPi[entryId] > prob_pi_cut)
-        continue;
-      if (valsH3ProbPi[entryId] > prob_pi_cut)
-        continue;
+  for (std::int64_t stripe = stripes.first; stripe < stripes.second;
+       ++stripe) {
+    TraceContext unitContext("stripe " + std::to_string(stripe));
+    pool->CountUnit();
+    const Selection_t *selection = caches.selection ? caches.selection->Find(stripe) : nullptr;
+    if (selection && selection->empty())
+      continue;
 
-      double b_px = valsH1PX[entryId] + valsH2PX[entryId] + valsH3PX[entryId];
-      double b_py = valsH1PY[entryId] + valsH2PY[entryId] + valsH3PY[entryId];
-      double b_pz = valsH1PZ[entryId] + valsH2PZ[entryId] + valsH3PZ[entryId];
-      double b_p2 = GetP2(b_px, b_py, b_pz);
-      double k1_E =
-      GetKE(valsH1PX[entryId], valsH1PY[entryId], valsH1PZ[entryId]);
-      double k2_E =
-      GetKE(valsH2PX[entryId], valsH2PY[entryId], valsH2PZ[entryId]);
-      double k3_E =
-      GetKE(valsH3PX[entryId], valsH3PY[entryId], valsH3PZ[entryId]);
-      double b_E = k1_E + k2_E + k3_E;
-      double b_mass = sqrt(b_E * b_E - b_p2);
-      hMass->Fill(b_mass);
+    const auto &readBinding = selection ? kinematicBinding : binding;
+    const auto &readColumns = readBinding.GetColumnNames();
+    recordBatch = caches.column ? caches.column->GetBatch(readColumns, stripe)
+                                : nullptr;
+    if (!recordBatch) {
+      if (prefetchStripes && !selection) {
+        auto info = reader->GetStripeInformation(stripe);
+        auto st = localFile->WillNeed({{info.offset, info.length}});
+        if (!st.ok()) {
+          throw std::runtime_error("could not prefetch stripe");
+        }
+      }
+      PARQUET_ASSIGN_OR_THROW(recordBatch,
+                              reader->ReadStripe(stripe, readColumns));
+      if (caches.column)
+        caches.column->PutBatch(*recordBatch, stripe);
     }
+
+    Selection_t passing;
+    ArrowBatch batch(readBinding, *recordBatch);
+    process_batch(batch, selection, &passing, hMass);
+    if (caches.selection && !selection)
+      caches.selection->Record(stripe, recordBatch->num_rows(), std::move(passing));
   }
 
   auto ts_end = std::chrono::steady_clock::now();
@@ -212,30 +275,21 @@ static AnalysisTime_t analysis_orc(const std::string &path,
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
           .count();
 
-  if (!histo_path.empty())
-    save_histogram(hMass.get(), histo_path);
-
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
-static AnalysisTime_t analysis_parquet(const std::string &path,
-                                       const std::string &histo_path) {
+static AnalysisTime_t analysis_parquet(const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches, TH1D *hMass) {
   auto ts_init = std::chrono::steady_clock::now();
-  auto hMass = std::make_unique<TH1D>("B_mass", "", 500, 5050, 5500);
+  TraceContext traceContext("open");
 
   arrow::Status st;
-  arrow::MemoryPool *pool = arrow::default_memory_pool();
-
-  parquet::arrow::FileReaderBuilder reader_builder;
-  st = reader_builder.OpenFile(path);
-  if (!st.ok()) {
-    throw std::runtime_error("could not create reader builder");
-  }
-  reader_builder.memory_pool(pool);
+  auto pool = get_memory_pool(opts);
 
-  auto reader = reader_builder.Build().ValueOrDie();
-  reader->set_use_threads(false);
+  auto reader = acquire_parquet(opts, caches);
   auto n_row_groups = reader->num_row_groups();
+  auto row_groups = get_unit_range(n_row_groups, slice);
   std::shared_ptr<arrow::Table> table;
 
   std::shared_ptr<arrow::Schema> schema;
@@ -244,144 +298,73 @@ static AnalysisTime_t analysis_parquet(const std::string &path,
     throw std::runtime_error("could not get schema");
   }
 
-  std::vector<std::int32_t> columns;
-  for (const auto colName : columnNames) {
-    columns.emplace_back(schema->GetFieldIndex(colName));
+  const ArrowBinding binding(lhcbSchema, LhcbSchema_t::GetAllColumns(),
+                             schema.get());
+  const ArrowBinding kinematicBinding(lhcbSchema, kinematicColumns,
+                                      schema.get());
+  // Without the isMuon columns, which are read as dictionary indices instead
+  std::vector<std::size_t> nonDictionaryColumns;
+  for (auto column : LhcbSchema_t::GetAllColumns()) {
+    if (std::find(isMuonColumns.begin(), isMuonColumns.end(), column) ==
+        isMuonColumns.end())
+      nonDictionaryColumns.push_back(column);
   }
+  const ArrowBinding nonDictionaryBinding(lhcbSchema, nonDictionaryColumns,
+                                          schema.get());
 
   std::chrono::steady_clock::time_point ts_first =
       std::chrono::steady_clock::now();
 
-  for (std::int32_t row_group = 0; row_group < n_row_groups; ++row_group) {
-    auto st = reader->ReadRowGroup(row_group, columns, &table);
-    assert(st.ok());
-
-    auto arrH1IsMuon = std::static_pointer_cast<arrow::Int32Array>(
-        table->GetColumnByName("H1_isMuon")->chunk(0));
-    auto arrH2IsMuon = std::static_pointer_cast<arrow::Int32Array>(
-        table->GetColumnByName("H2_isMuon")->chunk(0));
-    auto arrH3IsMuon = std::static_pointer_cast<arrow::Int32Array>(
-        table->GetColumnByName("H3_isMuon")->chunk(0));
-
-    auto arrH1PX = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H1_PX")->chunk(0));
-    auto arrH1PY = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H1_PY")->chunk(0));
-    auto arrH1PZ = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H1_PZ")->chunk(0));
-    auto arrH1ProbK = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H1_ProbK")->chunk(0));
-    auto arrH1ProbPi = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H1_ProbPi")->chunk(0));
-
-    auto arrH2PX = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H2_PX")->chunk(0));
-    auto arrH2PY = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H2_PY")->chunk(0));
-    auto arrH2PZ = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H2_PZ")->chunk(0));
-    auto arrH2ProbK = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H2_ProbK")->chunk(0));
-    auto arrH2ProbPi = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H2_ProbPi")->chunk(0));
-
-    auto arrH3PX = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H3_PX")->chunk(0));
-    auto arrH3PY = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H3_PY")->chunk(0));
-    auto arrH3PZ = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H3_PZ")->chunk(0));
-    auto arrH3ProbK = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H3_ProbK")->chunk(0));
-    auto arrH3ProbPi = std::static_pointer_cast<arrow::DoubleArray>(
-        table->GetColumnByName("H3_ProbPi")->chunk(0));
-
-    auto rawH1IsMuon = arrH1IsMuon->raw_values();
-    ROOT::RVec<std::int32_t> valsH1IsMuon(rawH1IsMuon,
-                                          rawH1IsMuon + arrH1IsMuon->length());
-    auto rawH2IsMuon = arrH2IsMuon->raw_values();
-    ROOT::RVec<std::int32_t> valsH2IsMuon(rawH2IsMuon,
-                                          rawH2IsMuon + arrH2IsMuon->length());
-    auto rawH3IsMuon = arrH3IsMuon->raw_values();
-    ROOT::RVec<std::int32_t> valsH3IsMuon(rawH3IsMuon,
-                                          rawH3IsMuon + arrH3IsMuon->length());
-
-    auto rawH1PX = arrH1PX->raw_values();
-    ROOT::RVec<double> valsH1PX(rawH1PX, rawH1PX + arrH1PX->length());
-    auto rawH1PY = arrH1PY->raw_values();
-    ROOT::RVec<double> valsH1PY(rawH1PY, rawH1PY + arrH1PY->length());
-    auto rawH1PZ = arrH1PZ->raw_values();
-    ROOT::RVec<double> valsH1PZ(rawH1PZ, rawH1PZ + arrH1PZ->length());
-    auto rawH1ProbK = arrH1ProbK->raw_values();
-    ROOT::RVec<double> valsH1ProbK(rawH1ProbK,
-                                         rawH1ProbK + arrH1ProbK->length());
-    auto rawH1ProbPi = arrH1ProbPi->raw_values();
-    ROOT::RVec<double> valsH1ProbPi(rawH1ProbPi,
-                                          rawH1ProbPi + arrH1ProbPi->length());
-
-    auto rawH2PX = arrH2PX->raw_values();
-    ROOT::RVec<double> valsH2PX(rawH2PX, rawH2PX + arrH2PX->length());
-    auto rawH2PY = arrH2PY->raw_values();
-    ROOT::RVec<double> valsH2PY(rawH2PY, rawH2PY + arrH2PY->length());
-    auto rawH2PZ = arrH2PZ->raw_values();
-    ROOT::RVec<double> valsH2PZ(rawH2PZ, rawH2PZ + arrH2PZ->length());
-    auto rawH2ProbK = arrH2ProbK->raw_values();
-    ROOT::RVec<double> valsH2ProbK(rawH2ProbK,
-                                         rawH2ProbK + arrH2ProbK->length());
-    auto rawH2ProbPi = arrH2ProbPi->raw_values();
-    ROOT::RVec<double> valsH2ProbPi(rawH2ProbPi,
-                                          rawH2ProbPi + arrH2ProbPi->length());
-
-    auto rawH3PX = arrH3PX->raw_values();
-    ROOT::RVec<double> valsH3PX(rawH3PX, rawH3PX + arrH3PX->length());
-    auto rawH3PY = arrH3PY->raw_values();
-    ROOT::RVec<double> valsH3PY(rawH3PY, rawH3PY + arrH3PY->length());
-    auto rawH3PZ = arrH3PZ->raw_values();
-    ROOT::RVec<double> valsH3PZ(rawH3PZ, rawH3PZ + arrH3PZ->length());
-    auto rawH3ProbK = arrH3ProbK->raw_values();
-    ROOT::RVec<double> valsH3ProbK(rawH3ProbK,
-                                         rawH3ProbK + arrH3ProbK->length());
-    auto rawH3ProbPi = arrH3ProbPi->raw_values();
-    ROOT::RVec<double> valsH3ProbPi(rawH3ProbPi,
-                                          rawH3ProbPi + arrH3ProbPi->length());
-
-    for (std::int64_t entryId = 0; entryId < table->num_rows(); ++entryId) {
-
-      if (valsH1IsMuon[entryId] || valsH2IsMuon[entryId] ||
-          valsH3IsMuon[entryId]) {
-        continue;
-      }
-
-      constexpr double prob_k_cut = 0.5;
-      if (valsH1ProbK[entryId] < prob_k_cut)
-        continue;
-      if (valsH2ProbK[entryId] < prob_k_cut)
-        continue;
-      if (valsH3ProbK[entryId] < prob_k_cut)
-        continue;
+  for (std::int64_t row_group = row_groups.first;
+       row_group < row_groups.second; ++row_group) {
+    TraceContext unitContext("row group " + std::to_string(row_group));
+    pool->CountUnit();
+    const Selection_t *selection =
+        caches.selection ? caches.selection->Find(row_group) : nullptr;
+    if (selection && selection->empty())
+      continue;
 
-      constexpr double prob_pi_cut = 0.5;
-      if (valsH1ProbPi[entryId] > prob_pi_cut)
-        continue;
-      if (valsH2ProbPi[entryId] > prob_pi_cut)
-        continue;
-      if (valsH3ProbPi[entryId] > prob_pi_cut)
-        continue;
+    // The column cache holds complete batches, so the dictionary indices are
+    // only used without it
+    std::vector<DictionaryColumn> isMuonValues;
+    if (!selection && !caches.column) {
+      for (auto column : isMuonColumns) {
+        auto values = read_dictionary_column(
+            *reader->parquet_reader(), row_group, lhcbSchema.GetName(column));
+        if (!values)
+          break;
+        isMuonValues.emplace_back(std::move(*values));
+      }
+    }
+    bool useDictionaries = isMuonValues.size() == isMuonColumns.size();
+
+    const auto &readBinding = selection         ? kinematicBinding
+                              : useDictionaries ? nonDictionaryBinding
+                                                : binding;
+    auto batch = caches.column
+                     ? caches.column->GetBatch(readBinding.GetColumnNames(),
+                                               row_group)
+                     : nullptr;
+    if (!batch) {
+      PARQUET_THROW_NOT_OK(reader->ReadRowGroup(
+          row_group, readBinding.GetFieldIndices(), &table));
+      PARQUET_ASSIGN_OR_THROW(batch, table->CombineChunksToBatch(pool));
+      if (caches.column)
+        caches.column->PutBatch(*batch, row_group);
+    }
 
-      double b_px = valsH1PX[entryId] + valsH2PX[entryId] + valsH3PX[entryId];
-      double b_py = valsH1PY[entryId] + valsH2PY[entryId] + valsH3PY[entryId];
-      double b_pz = valsH1PZ[entryId] + valsH2PZ[entryId] + valsH3PZ[entryId];
-      double b_p2 = GetP2(b_px, b_py, b_pz);
-      double k1_E =
-      GetKE(valsH1PX[entryId], valsH1PY[entryId], valsH1PZ[entryId]);
-      double k2_E =
-      GetKE(valsH2PX[entryId], valsH2PY[entryId], valsH2PZ[entryId]);
-      double k3_E =
-      GetKE(valsH3PX[entryId], valsH3PY[entryId], valsH3PZ[entryId]);
-      double b_E = k1_E + k2_E + k3_E;
-      double b_mass = sqrt(b_E * b_E - b_p2);
-      hMass->Fill(b_mass);
+    Selection_t passing;
+    if (useDictionaries) {
+      DictionaryBatch_t dictionaryBatch(readBinding, *batch);
+      for (std::size_t i = 0; i < isMuonColumns.size(); ++i)
+        dictionaryBatch.SetDictionaryColumn(isMuonColumns[i], isMuonValues[i]);
+      process_batch(dictionaryBatch, selection, &passing, hMass);
+    } else {
+      ArrowBatch arrowBatch(readBinding, *batch);
+      process_batch(arrowBatch, selection, &passing, hMass);
     }
+    if (caches.selection && !selection)
+      caches.selection->Record(row_group, batch->num_rows(), std::move(passing));
   }
 
   auto ts_end = std::chrono::steady_clock::now();
@@ -392,75 +375,71 @@ static AnalysisTime_t analysis_parquet(const std::string &path,
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
           .count();
 
-  if (!histo_path.empty())
-    save_histogram(hMass.get(), histo_path);
-
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
-static AnalysisTime_t analysis_rntuple(const std::string &path,
-                                       const std::string &histo_path) {
+static AnalysisTime_t analysis_rntuple(const AnalysisOptions &opts,
+                                       const WorkerSlice &slice,
+                                       const AnalysisCaches &caches, TH1D *hMass) {
   auto ts_init = std::chrono::steady_clock::now();
-  auto hMass = std::make_unique<TH1D>("B_mass", "", 500, 5050, 5500);
+  TraceContext traceContext("open");
+
+  auto ntuple = acquire_rntuple("DecayTree", opts, caches);
+  auto clusterBoundaries = get_cluster_boundaries(ntuple->GetDescriptor());
+  auto clusters = get_unit_range(clusterBoundaries.size() - 1, slice);
+
+  // Only create views for the selection columns if they are needed, so that
+  // their pages are not loaded otherwise. With the column cache, the views are
+  // not used at all.
+  bool needCuts = false;
+  for (auto cluster = clusters.first;
+       cluster < clusters.second && !caches.column && !needCuts; ++cluster) {
+    needCuts = !caches.selection || !caches.selection->Find(cluster);
+  }
 
-  auto ntuple = ROOT::RNTupleReader::Open("DecayTree", path);
+  RNTupleBatch<LhcbSchema_t> rntupleBatch(
+      lhcbSchema, *ntuple, needCuts ? cutColumns : kinematicColumns);
+  // Used with the column cache, in schema order
+  const ArrowBinding binding(lhcbSchema, LhcbSchema_t::GetAllColumns());
+  const ArrowBinding kinematicBinding(lhcbSchema, kinematicColumns);
 
-  auto viewH1IsMuon = ntuple->GetView<int>("H1_isMuon");
-  auto viewH2IsMuon = ntuple->GetView<int>("H2_isMuon");
-  auto viewH3IsMuon = ntuple->GetView<int>("H3_isMuon");
+  std::chrono::steady_clock::time_point ts_first =
+      std::chrono::steady_clock::now();
 
-  auto viewH1PX = ntuple->GetView<double>("H1_PX");
-  auto viewH1PY = ntuple->GetView<double>("H1_PY");
-  auto viewH1PZ = ntuple->GetView<double>("H1_PZ");
-  auto viewH1ProbK = ntuple->GetView<double>("H1_ProbK");
-  auto viewH1ProbPi = ntuple->GetView<double>("H1_ProbPi");
+  for (auto cluster = clusters.first; cluster < clusters.second; ++cluster) {
+    TraceContext unitContext("cluster " + std::to_string(cluster));
+    auto firstEntry = clusterBoundaries[cluster];
+    auto lastEntry = clusterBoundaries[cluster + 1];
 
-  auto viewH2PX = ntuple->GetView<double>("H2_PX");
-  auto viewH2PY = ntuple->GetView<double>("H2_PY");
-  auto viewH2PZ = ntuple->GetView<double>("H2_PZ");
-  auto viewH2ProbK = ntuple->GetView<double>("H2_ProbK");
-  auto viewH2ProbPi = ntuple->GetView<double>("H2_ProbPi");
+    const Selection_t *selection =
+        caches.selection ? caches.selection->Find(cluster) : nullptr;
 
-  auto viewH3PX = ntuple->GetView<double>("H3_PX");
-  auto viewH3PY = ntuple->GetView<double>("H3_PY");
-  auto viewH3PZ = ntuple->GetView<double>("H3_PZ");
-  auto viewH3ProbK = ntuple->GetView<double>("H3_ProbK");
-  auto viewH3ProbPi = ntuple->GetView<double>("H3_ProbPi");
+    // The column cache is filled and read per cluster, as Arrow arrays
+    if (caches.column) {
+      if (selection && selection->empty())
+        continue;
+      const auto &readBinding = selection ? kinematicBinding : binding;
+      const auto &readColumns = readBinding.GetColumnNames();
+      auto batch = caches.column->GetBatch(readColumns, cluster);
+      if (!batch) {
+        batch = read_rntuple_batch(*ntuple, readColumns, firstEntry, lastEntry);
+        caches.column->PutBatch(*batch, cluster);
+      }
 
-  unsigned nevents = 0;
-  std::chrono::steady_clock::time_point ts_first =
-      std::chrono::steady_clock::now();
-  for (auto i : ntuple->GetEntryRange()) {
-    if (viewH1IsMuon(i) || viewH2IsMuon(i) || viewH3IsMuon(i)) {
+      Selection_t passing;
+      ArrowBatch arrowBatch(readBinding, *batch);
+      process_batch(arrowBatch, selection, &passing, hMass);
+      if (caches.selection && !selection)
+        caches.selection->Record(cluster, lastEntry - firstEntry,
+                                 std::move(passing));
       continue;
     }
 
-    constexpr double prob_k_cut = 0.5;
-    if (viewH1ProbK(i) < prob_k_cut)
-      continue;
-    if (viewH2ProbK(i) < prob_k_cut)
-      continue;
-    if (viewH3ProbK(i) < prob_k_cut)
-      continue;
-
-    constexpr double prob_pi_cut = 0.5;
-    if (viewH1ProbPi(i) > prob_pi_cut)
-      continue;
-    if (viewH2ProbPi(i) > prob_pi_cut)
-      continue;
-    if (viewH3ProbPi(i) > prob_pi_cut)
-      continue;
-
-    double b_px = viewH1PX(i) + viewH2PX(i) + viewH3PX(i);
-    double b_py = viewH1PY(i) + viewH2PY(i) + viewH3PY(i);
-    double b_pz = viewH1PZ(i) + viewH2PZ(i) + viewH3PZ(i);
-    double b_p2 = GetP2(b_px, b_py, b_pz);
-    double k1_E = GetKE(viewH1PX(i), viewH1PY(i), viewH1PZ(i));
-    double k2_E = GetKE(viewH2PX(i), viewH2PY(i), viewH2PZ(i));
-    double k3_E = GetKE(viewH3PX(i), viewH3PY(i), viewH3PZ(i));
-    double b_E = k1_E + k2_E + k3_E;
-    double b_mass = sqrt(b_E * b_E - b_p2);
-    hMass->Fill(b_mass);
+    Selection_t passing;
+    rntupleBatch.SetEntryRange(firstEntry, lastEntry);
+    process_batch(rntupleBatch, selection, &passing, hMass);
+    if (caches.selection && !selection)
+      caches.selection->Record(cluster, lastEntry - firstEntry, std::move(passing));
   }
 
   auto ts_end = std::chrono::steady_clock::now();
@@ -471,9 +450,6 @@ static AnalysisTime_t analysis_rntuple(const std::string &path,
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
           .count();
 
-  if (!histo_path.empty())
-    save_histogram(hMass.get(), histo_path);
-
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
@@ -535,43 +511,125 @@ static AnalysisTime_t analysis_rdf(ROOT::RDataFrame &frame,
   return std::make_pair(runtime_init, runtime_analyze);
 }
 
-static void Usage(const char *progname) {
-  printf("%s INPUT_PATH [HISTO_PATH]\n", progname);
-}
-
-int main(int argc, char **argv) {
-  auto ts_init = std::chrono::steady_clock::now();
-
-  if (argc < 2) {
-    Usage(argv[0]);
-    return 1;
-  }
-
-  std::string input_path = argv[1];
+// Runs the analysis of opts.input_path, either from the command line or as a
+// request to the analysis server. The resident state is owned by the caller.
+static AnalysisTime_t run_benchmark(const AnalysisOptions &opts,
+                                    const ResidentState &resident,
+                                    TH1D *hMass) {
   std::string basename, suffix;
-  split_path(input_path, &basename, &suffix);
+  split_path(opts.input_path, &basename, &suffix);
   auto fmt = get_file_format(suffix);
 
-  std::string histo_path{};
-  if (argc >= 3)
-    histo_path = argv[2];
+  // Keep the trace open until all threads are done
+  auto trace = get_read_trace(opts);
+
+  // Only fetch the listed entries, without the analysis
+  if (!opts.entry_list_path.empty()) {
+    FetchStats stats;
+    auto runtime_fetch =
+        fetch_entries(opts, "DecayTree", lhcbSchema.GetNames(), resident,
+                      hMass, &stats);
+    print_fetch_stats(stats);
+    return runtime_fetch;
+  }
 
-  AnalysisTime_t runtime_analysis;
+  AnalysisCaches caches;
+  caches.metadata = resident.metadata;
+  caches.readers = resident.readers;
+  std::unique_ptr<SelectionCache> selCache;
+  if (!opts.selection_cache_dir.empty()) {
+    selCache = std::make_unique<SelectionCache>(opts.selection_cache_dir,
+                                                opts.input_path, selectionCut);
+    caches.selection = selCache.get();
+  }
+  std::unique_ptr<ColumnCache> colCache;
+  if (!opts.column_cache_dir.empty()) {
+    colCache = std::make_unique<ColumnCache>(
+        opts.column_cache_dir, opts.input_path, opts.column_cache_size);
+    caches.column = colCache.get();
+  }
+
+  AnalysisFn_t analysis;
   switch (fmt) {
   case FileFormat::rntuple: {
-    runtime_analysis = analysis_rntuple(input_path, histo_path);
+    analysis = [&](const WorkerSlice &slice, TH1D *hist) {
+      return analysis_rntuple(opts, slice, caches, hist);
+    };
   } break;
   case FileFormat::orc: {
-    runtime_analysis = analysis_orc(input_path, histo_path);
+    analysis = [&](const WorkerSlice &slice, TH1D *hist) {
+      return analysis_orc(opts, slice, caches, hist);
+    };
   } break;
   case FileFormat::parquet: {
-    runtime_analysis = analysis_parquet(input_path, histo_path);
+    analysis = [&](const WorkerSlice &slice, TH1D *hist) {
+      return analysis_parquet(opts, slice, caches, hist);
+    };
   } break;
   default:
-    std::cerr << "Invalid file format: " << suffix << std::endl;
+    throw std::invalid_argument("Invalid file format: " + suffix);
+  }
+
+  auto runtime_analysis =
+      run_analysis(opts, analysis, hMass, resident.threads);
+  if (selCache)
+    selCache->Save();
+  if (colCache) {
+    auto nUnits = colCache->GetNHits() + colCache->GetNMisses();
+    std::cerr << "column cache: " << colCache->GetNHits() << "/" << nUnits
+              << " units served from cache" << std::endl;
+  }
+
+  return runtime_analysis;
+}
+
+int main(int argc, char **argv) {
+  auto ts_init = std::chrono::steady_clock::now();
+
+  AnalysisOptions opts;
+  if (!parse_options(argc, argv, &opts)) {
+    print_usage(argv[0]);
     return 1;
   }
 
+  auto hMass = std::make_unique<TH1D>("B_mass", "", 500, 5050, 5500);
+
+  if (!opts.server_socket.empty()) {
+    AnalysisServer server(opts, run_benchmark, *hMass);
+    return server.Run();
+  }
+
+  std::shared_ptr<MetadataCache> metadataCache;
+  if (!opts.metadata_cache_dir.empty()) {
+    metadataCache = std::make_shared<MetadataCache>(opts.metadata_cache_dir,
+                                                    opts.input_path);
+  }
+
+  auto pageFaults = get_page_faults();
+  AnalysisTime_t runtime_analysis;
+  try {
+    ResidentState resident;
+    resident.metadata = metadataCache.get();
+    runtime_analysis = run_benchmark(opts, resident, hMass.get());
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if (metadataCache)
+    metadataCache->Save();
+  if (auto throttle = get_storage_throttle(opts)) {
+    std::cerr << "storage: " << throttle->GetNRequests() << " requests, "
+              << throttle->GetNBytes() << " bytes" << std::endl;
+  }
+  print_memory_pool_stats(opts, get_page_faults() - pageFaults);
+
+  if (opts.partial) {
+    save_partial_histogram(hMass.get(), opts.histo_path, opts.unit_range,
+                           runtime_analysis);
+  } else if (!opts.histo_path.empty()) {
+    save_histogram(hMass.get(), opts.histo_path);
+  }
+
   auto ts_end = std::chrono::steady_clock::now();
   auto runtime_main =
       std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_init)
@@ -0,0 +1,33 @@
+import argparse
+import random
+
+import pyarrow.parquet as pq
+from pyarrow import orc
+
+parser = argparse.ArgumentParser(
+    prog="make_entry_list",
+    description="write a random entry list for the --entry-list option",
+)
+parser.add_argument(
+    "input_path", help="Parquet or ORC file to take the number of entries from"
+)
+parser.add_argument(
+    "density", type=float, help="fraction of the entries to select, e.g. 0.001"
+)
+parser.add_argument("output_path", help="path to write the entry list to")
+parser.add_argument(
+    "-s", "--seed", dest="seed", type=int, default=42, help="random seed"
+)
+
+args = parser.parse_args()
+
+if args.input_path.endswith(".orc"):
+    n_entries = orc.ORCFile(args.input_path).nrows
+else:
+    n_entries = pq.ParquetFile(args.input_path).metadata.num_rows
+
+n_selected = min(max(1, round(n_entries * args.density)), n_entries)
+entries = sorted(random.Random(args.seed).sample(range(n_entries), n_selected))
+
+with open(args.output_path, "w") as f:
+    [f.write(f"{entry}\n") for entry in entries]
@@ -0,0 +1,235 @@
+#include "memory_pool.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+namespace {
+
+constexpr std::size_t kPageSize = 4096;
+constexpr std::size_t kHugePageSize = 2 * 1024 * 1024;
+// Blocks beyond this are unmapped instead of cached
+constexpr std::size_t kMaxCachedBytes = 1024ULL * 1024 * 1024;
+
+std::uint8_t *map_block(std::size_t size, bool hugePages) {
+  if (!hugePages) {
+    void *block = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return block == MAP_FAILED ? nullptr : static_cast<std::uint8_t *>(block);
+  }
+
+  // Huge pages are only used for 2 MiB aligned ranges, so map more and trim
+  void *mapped = mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED)
+    return nullptr;
+  auto start = reinterpret_cast<std::uintptr_t>(mapped);
+  auto aligned = (start + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  if (aligned > start)
+    munmap(mapped, aligned - start);
+  if (auto tail = start + kHugePageSize - aligned; tail > 0)
+    munmap(reinterpret_cast<void *>(aligned + size), tail);
+  madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+  return reinterpret_cast<std::uint8_t *>(aligned);
+}
+
+class Stopwatch {
+public:
+  explicit Stopwatch(std::atomic<std::uint64_t> &total)
+      : fTotal(total), fStart(std::chrono::steady_clock::now()) {}
+  ~Stopwatch() {
+    fTotal += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - fStart)
+                  .count();
+  }
+
+private:
+  std::atomic<std::uint64_t> &fTotal;
+  std::chrono::steady_clock::time_point fStart;
+};
+
+} // anonymous namespace
+
+ArenaMemoryPool::ArenaMemoryPool(bool hugePages) : fHugePages(hugePages) {}
+
+ArenaMemoryPool::~ArenaMemoryPool() { ReleaseUnused(); }
+
+std::size_t ArenaMemoryPool::GetBlockSize(std::int64_t size) const {
+  if (fHugePages)
+    return (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  // Eight size classes per power of two, so that at most 1/8 is wasted
+  std::size_t power = 1;
+  while (power < static_cast<std::size_t>(size))
+    power *= 2;
+  auto step = std::max(power / 8, kPageSize);
+  return (size + step - 1) / step * step;
+}
+
+void ArenaMemoryPool::UpdateStats(std::int64_t diff) {
+  auto allocated = fBytesAllocated += diff;
+  auto max = fMaxMemory.load();
+  while (allocated > max && !fMaxMemory.compare_exchange_weak(max, allocated)) {
+  }
+  if (diff > 0) {
+    fTotalBytesAllocated += diff;
+    ++fNAllocations;
+  }
+}
+
+arrow::Status ArenaMemoryPool::Allocate(std::int64_t size,
+                                        std::int64_t alignment,
+                                        std::uint8_t **out) {
+  if (size < kMinBlockSize)
+    return arrow::system_memory_pool()->Allocate(size, alignment, out);
+  if (alignment > static_cast<std::int64_t>(kPageSize))
+    return arrow::Status::Invalid("unsupported alignment ", alignment);
+
+  auto blockSize = GetBlockSize(size);
+  *out = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(fLock);
+    auto &blocks = fFreeBlocks[blockSize];
+    if (!blocks.empty()) {
+      *out = blocks.back();
+      blocks.pop_back();
+      fNCachedBytes -= blockSize;
+    }
+  }
+  if (!*out)
+    *out = map_block(blockSize, fHugePages);
+  if (!*out)
+    return arrow::Status::OutOfMemory("could not map ", blockSize, " bytes");
+
+  UpdateStats(size);
+  return arrow::Status::OK();
+}
+
+arrow::Status ArenaMemoryPool::Reallocate(std::int64_t oldSize,
+                                          std::int64_t newSize,
+                                          std::int64_t alignment,
+                                          std::uint8_t **ptr) {
+  if (oldSize < kMinBlockSize && newSize < kMinBlockSize) {
+    return arrow::system_memory_pool()->Reallocate(oldSize, newSize, alignment,
+                                                   ptr);
+  }
+  if (oldSize >= kMinBlockSize && newSize >= kMinBlockSize &&
+      GetBlockSize(oldSize) == GetBlockSize(newSize)) {
+    UpdateStats(newSize - oldSize);
+    return arrow::Status::OK();
+  }
+
+  std::uint8_t *block;
+  ARROW_RETURN_NOT_OK(Allocate(newSize, alignment, &block));
+  std::memcpy(block, *ptr, std::min(oldSize, newSize));
+  Free(*ptr, oldSize, alignment);
+  *ptr = block;
+  return arrow::Status::OK();
+}
+
+void ArenaMemoryPool::Free(std::uint8_t *buffer, std::int64_t size,
+                           std::int64_t alignment) {
+  if (size < kMinBlockSize) {
+    arrow::system_memory_pool()->Free(buffer, size, alignment);
+    return;
+  }
+
+  UpdateStats(-size);
+  auto blockSize = GetBlockSize(size);
+  {
+    std::lock_guard<std::mutex> guard(fLock);
+    if (fNCachedBytes + blockSize <= kMaxCachedBytes) {
+      fFreeBlocks[blockSize].push_back(buffer);
+      fNCachedBytes += blockSize;
+      return;
+    }
+  }
+  munmap(buffer, blockSize);
+}
+
+void ArenaMemoryPool::ReleaseUnused() {
+  std::lock_guard<std::mutex> guard(fLock);
+  for (auto &[blockSize, blocks] : fFreeBlocks) {
+    for (auto block : blocks)
+      munmap(block, blockSize);
+  }
+  fFreeBlocks.clear();
+  fNCachedBytes = 0;
+}
+
+arrow::Status ProfilingMemoryPool::Allocate(std::int64_t size,
+                                            std::int64_t alignment,
+                                            std::uint8_t **out) {
+  Stopwatch stopwatch(fAllocatorTime);
+  return fPool->Allocate(size, alignment, out);
+}
+
+arrow::Status ProfilingMemoryPool::Reallocate(std::int64_t oldSize,
+                                              std::int64_t newSize,
+                                              std::int64_t alignment,
+                                              std::uint8_t **ptr) {
+  Stopwatch stopwatch(fAllocatorTime);
+  return fPool->Reallocate(oldSize, newSize, alignment, ptr);
+}
+
+void ProfilingMemoryPool::Free(std::uint8_t *buffer, std::int64_t size,
+                               std::int64_t alignment) {
+  Stopwatch stopwatch(fAllocatorTime);
+  fPool->Free(buffer, size, alignment);
+}
+
+ProfilingMemoryPool *get_memory_pool(const AnalysisOptions &opts) {
+  // Never destroyed, as buffers may be freed during static destruction
+  static auto defaultPool = new ProfilingMemoryPool(arrow::default_memory_pool());
+  static auto systemPool = new ProfilingMemoryPool(arrow::system_memory_pool());
+  static auto arenaPool = new ProfilingMemoryPool(new ArenaMemoryPool(false));
+  static auto hugeArenaPool =
+      new ProfilingMemoryPool(new ArenaMemoryPool(true));
+
+  arrow::MemoryPool *pool;
+  switch (opts.memory_pool) {
+  case MemoryPoolBackend::arrow:
+    return defaultPool;
+  case MemoryPoolBackend::system:
+    return systemPool;
+  case MemoryPoolBackend::jemalloc: {
+    if (!arrow::jemalloc_memory_pool(&pool).ok())
+      throw std::invalid_argument("Arrow was built without jemalloc");
+    static auto jemallocPool = new ProfilingMemoryPool(pool);
+    return jemallocPool;
+  }
+  case MemoryPoolBackend::mimalloc: {
+    if (!arrow::mimalloc_memory_pool(&pool).ok())
+      throw std::invalid_argument("Arrow was built without mimalloc");
+    static auto mimallocPool = new ProfilingMemoryPool(pool);
+    return mimallocPool;
+  }
+  case MemoryPoolBackend::arena:
+    return arenaPool;
+  case MemoryPoolBackend::arena_huge:
+    return hugeArenaPool;
+  }
+  return defaultPool;
+}
+
+std::uint64_t get_page_faults() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt + usage.ru_majflt;
+}
+
+void print_memory_pool_stats(const AnalysisOptions &opts,
+                             std::uint64_t nPageFaults) {
+  auto pool = get_memory_pool(opts);
+  auto nUnits = pool->GetNUnits();
+  if (nUnits == 0)
+    return;
+  std::cerr << "memory pool: " << pool->backend_name() << ", " << nUnits
+            << " units, " << nPageFaults / nUnits
+            << " page faults per unit, " << pool->GetAllocatorTime() / nUnits
+            << " us allocating per unit" << std::endl;
+}
@@ -0,0 +1,113 @@
+#ifndef MEMORY_POOL__HXX
+#define MEMORY_POOL__HXX
+
+#include <arrow/memory_pool.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "util.hxx"
+
+// Arrow memory pool that keeps the large buffers it frees, and hands them out
+// again for allocations of the same size class. Reading a unit allocates about
+// the same buffers as reading the previous one, so after the first unit they
+// are recycled instead of being mapped and faulted in again. Allocations below
+// kMinBlockSize are served by the system allocator.
+class ArenaMemoryPool : public arrow::MemoryPool {
+public:
+  static constexpr std::int64_t kMinBlockSize = 64 * 1024;
+
+  // With hugePages, the blocks are aligned and sized to 2 MiB and backed by
+  // transparent huge pages
+  explicit ArenaMemoryPool(bool hugePages);
+  ~ArenaMemoryPool() override;
+
+  arrow::Status Allocate(std::int64_t size, std::int64_t alignment,
+                         std::uint8_t **out) override;
+  arrow::Status Reallocate(std::int64_t oldSize, std::int64_t newSize,
+                           std::int64_t alignment, std::uint8_t **ptr) override;
+  void Free(std::uint8_t *buffer, std::int64_t size,
+            std::int64_t alignment) override;
+  // Unmaps the cached blocks
+  void ReleaseUnused() override;
+
+  std::int64_t bytes_allocated() const override { return fBytesAllocated; }
+  std::int64_t max_memory() const override { return fMaxMemory; }
+  std::int64_t total_bytes_allocated() const override {
+    return fTotalBytesAllocated;
+  }
+  std::int64_t num_allocations() const override { return fNAllocations; }
+  std::string backend_name() const override {
+    return fHugePages ? "arena-huge" : "arena";
+  }
+
+private:
+  std::size_t GetBlockSize(std::int64_t size) const;
+  void UpdateStats(std::int64_t diff);
+
+  bool fHugePages;
+  std::mutex fLock;
+  // Cached blocks by size
+  std::unordered_map<std::size_t, std::vector<std::uint8_t *>> fFreeBlocks;
+  std::size_t fNCachedBytes = 0;
+  std::atomic<std::int64_t> fBytesAllocated = 0;
+  std::atomic<std::int64_t> fMaxMemory = 0;
+  std::atomic<std::int64_t> fTotalBytesAllocated = 0;
+  std::atomic<std::int64_t> fNAllocations = 0;
+};
+
+// Forwards to another memory pool, counting the time spent in it and the units
+// (clusters, row groups or stripes) read with it
+class ProfilingMemoryPool : public arrow::MemoryPool {
+public:
+  explicit ProfilingMemoryPool(arrow::MemoryPool *pool) : fPool(pool) {}
+
+  arrow::Status Allocate(std::int64_t size, std::int64_t alignment,
+                         std::uint8_t **out) override;
+  arrow::Status Reallocate(std::int64_t oldSize, std::int64_t newSize,
+                           std::int64_t alignment, std::uint8_t **ptr) override;
+  void Free(std::uint8_t *buffer, std::int64_t size,
+            std::int64_t alignment) override;
+  void ReleaseUnused() override { fPool->ReleaseUnused(); }
+
+  std::int64_t bytes_allocated() const override {
+    return fPool->bytes_allocated();
+  }
+  std::int64_t max_memory() const override { return fPool->max_memory(); }
+  std::int64_t total_bytes_allocated() const override {
+    return fPool->total_bytes_allocated();
+  }
+  std::int64_t num_allocations() const override {
+    return fPool->num_allocations();
+  }
+  std::string backend_name() const override { return fPool->backend_name(); }
+
+  void CountUnit() { ++fNUnits; }
+  std::uint64_t GetNUnits() const { return fNUnits; }
+  // In microseconds
+  std::uint64_t GetAllocatorTime() const { return fAllocatorTime / 1000; }
+
+private:
+  arrow::MemoryPool *fPool;
+  std::atomic<std::uint64_t> fNUnits = 0;
+  // In nanoseconds
+  std::atomic<std::uint64_t> fAllocatorTime = 0;
+};
+
+// Returns the (process-wide) memory pool of the backend in opts.memory_pool.
+// Throws std::invalid_argument if Arrow was built without it.
+ProfilingMemoryPool *get_memory_pool(const AnalysisOptions &opts);
+
+// Minor and major page faults of the process so far
+std::uint64_t get_page_faults();
+
+// Prints the page faults and the allocator time per unit to stderr, if any
+// units were read with the memory pool
+void print_memory_pool_stats(const AnalysisOptions &opts,
+                             std::uint64_t nPageFaults);
+
+#endif // MEMORY_POOL__HXX
@@ -0,0 +1,129 @@
+// Combines the partial histograms written with `--partial` by the workers of
+// a distributed run, see partition and run_distributed.sh
+
+#include <TFile.h>
+#include <TH1D.h>
+#include <TKey.h>
+#include <TParameter.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "util.hxx"
+
+// Contents of one partial file
+struct PartialResult {
+  std::string path;
+  std::unique_ptr<TH1D> hist;
+  UnitRange_t units;
+  AnalysisTime_t runtime;
+};
+
+static std::int64_t read_parameter(TFile &file, const char *name) {
+  auto parameter = file.Get<TParameter<Long64_t>>(name);
+  if (!parameter)
+    throw std::runtime_error(std::string(file.GetName()) + ": no " + name);
+  return parameter->GetVal();
+}
+
+static PartialResult read_partial(const std::string &path) {
+  std::unique_ptr<TFile> file(TFile::Open(path.c_str()));
+  if (!file || file->IsZombie())
+    throw std::runtime_error("could not open " + path);
+
+  PartialResult result;
+  result.path = path;
+  for (auto key : TRangeDynCast<TKey>(file->GetListOfKeys())) {
+    if (auto hist = key->ReadObject<TH1D>()) {
+      result.hist.reset(hist);
+      result.hist->SetDirectory(nullptr);
+      break;
+    }
+  }
+  if (!result.hist)
+    throw std::runtime_error(path + ": no histogram");
+  result.units = {read_parameter(*file, "first_unit"),
+                  read_parameter(*file, "last_unit")};
+  result.runtime = {read_parameter(*file, "runtime_init"),
+                    read_parameter(*file, "runtime_analyze")};
+  return result;
+}
+
+static void print_merge_usage(const char *progname) {
+  printf("%s OUTPUT_PATH PARTIAL_PATH...\n\n", progname);
+  printf("Adds up the histograms of the partial files. With a .root "
+         "OUTPUT_PATH, the result\nis written as another partial file, "
+         "otherwise as an image.\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argv[1][0] == '-') {
+    print_merge_usage(argv[0]);
+    return 1;
+  }
+  std::string outputPath = argv[1];
+
+  std::vector<PartialResult> partials;
+  try {
+    for (int i = 2; i < argc; ++i)
+      partials.emplace_back(read_partial(argv[i]));
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  // Overlapping ranges would count entries twice
+  std::sort(partials.begin(), partials.end(),
+            [](const auto &a, const auto &b) { return a.units < b.units; });
+  for (std::size_t i = 1; i < partials.size(); ++i) {
+    if (partials[i].units.first < partials[i - 1].units.second) {
+      std::cerr << partials[i - 1].path << " and " << partials[i].path
+                << " have overlapping unit ranges" << std::endl;
+      return 1;
+    }
+  }
+
+  auto hist = std::unique_ptr<TH1D>(
+      static_cast<TH1D *>(partials.front().hist->Clone()));
+  hist->SetDirectory(nullptr);
+  for (std::size_t i = 1; i < partials.size(); ++i)
+    hist->Add(partials[i].hist.get());
+
+  // The workers run concurrently, so the slowest one determines the run time
+  AnalysisTime_t runtime{0, 0};
+  std::uint64_t totalAnalyze = 0;
+  for (const auto &partial : partials) {
+    runtime.first = std::max(runtime.first, partial.runtime.first);
+    runtime.second = std::max(runtime.second, partial.runtime.second);
+    totalAnalyze += partial.runtime.second;
+  }
+
+  UnitRange_t units{partials.front().units.first,
+                    partials.back().units.second};
+  if (get_path_suffix(outputPath) == "root")
+    save_partial_histogram(hist.get(), outputPath, units, runtime);
+  else
+    save_histogram(hist.get(), outputPath);
+
+  // Ratio of the slowest worker's analysis time to the mean, 1 if balanced
+  double imbalance =
+      totalAnalyze ? static_cast<double>(runtime.second) * partials.size() /
+                         totalAnalyze
+                   : 1.;
+  std::cerr << "merge: " << partials.size() << " partials, "
+            << hist->GetEntries() << " entries, imbalance " << imbalance
+            << std::endl;
+
+  // The maximum init and analysis time over the workers, and the sum of the
+  // analysis times
+  std::cout << runtime.first << ", " << runtime.second << ", " << totalAnalyze
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,315 @@
+#include "metadata_cache.hxx"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <arrow/buffer.h>
+#include <arrow/io/memory.h>
+#include <parquet/exception.h>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'H', 'E', 'P', 'M', 'E', 'T', '0', '1'};
+
+std::uint64_t fnv1a(const std::string &s) {
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : s) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+template <typename T> void write_pod(std::ostream &os, const T &val) {
+  os.write(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+template <typename T> bool read_pod(std::istream &is, T *val) {
+  return static_cast<bool>(is.read(reinterpret_cast<char *>(val), sizeof(*val)));
+}
+
+void write_string(std::ostream &os, const std::string &s) {
+  write_pod<std::uint64_t>(os, s.size());
+  os.write(s.data(), s.size());
+}
+
+bool read_string(std::istream &is, std::string *s) {
+  std::uint64_t size;
+  if (!read_pod(is, &size) || size > (1ULL << 32))
+    return false;
+  s->resize(size);
+  return static_cast<bool>(is.read(s->data(), size));
+}
+
+// Adds a range to the map, keeping the longer one if a range at the same
+// offset exists already
+void add_range(std::map<std::uint64_t, std::string> *ranges,
+               std::uint64_t offset, std::string data) {
+  auto &range = (*ranges)[offset];
+  if (data.size() > range.size())
+    range = std::move(data);
+}
+
+} // anonymous namespace
+
+MetadataCache::MetadataCache(const std::string &cacheDir,
+                             const std::string &inputPath) {
+  std::error_code ec;
+  auto canonicalPath = std::filesystem::canonical(inputPath, ec);
+  auto path = ec ? std::filesystem::path(inputPath) : canonicalPath;
+  fInputPath = path.string();
+  fFileSize = std::filesystem::file_size(path);
+  fFileMtime =
+      std::filesystem::last_write_time(path).time_since_epoch().count();
+
+  std::ostringstream name;
+  name << path.filename().string() << "-" << std::hex << std::setw(16)
+       << std::setfill('0') << fnv1a(fInputPath) << ".meta";
+  fCachePath = (std::filesystem::path(cacheDir) / name.str()).string();
+
+  fLoaded = Load();
+  if (!fLoaded) {
+    fRanges.clear();
+    fParquetMetadata.clear();
+  }
+}
+
+bool MetadataCache::Load() {
+  std::ifstream is(fCachePath, std::ios::binary);
+  if (!is)
+    return false;
+
+  char magic[sizeof(kMagic)];
+  if (!is.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+    return false;
+
+  std::string inputPath;
+  std::uint64_t fileSize;
+  std::int64_t fileMtime;
+  if (!read_string(is, &inputPath) || !read_pod(is, &fileSize) ||
+      !read_pod(is, &fileMtime))
+    return false;
+  if (inputPath != fInputPath || fileSize != fFileSize ||
+      fileMtime != fFileMtime)
+    return false;
+
+  if (!read_string(is, &fParquetMetadata))
+    return false;
+
+  std::uint64_t nRanges;
+  if (!read_pod(is, &nRanges))
+    return false;
+  for (std::uint64_t i = 0; i < nRanges; ++i) {
+    std::uint64_t offset;
+    std::string data;
+    if (!read_pod(is, &offset) || !read_string(is, &data) ||
+        offset + data.size() > fFileSize)
+      return false;
+    fRanges[offset] = std::move(data);
+  }
+
+  return true;
+}
+
+std::shared_ptr<parquet::FileMetaData> MetadataCache::GetParquetMetadata() {
+  if (fParquetMetadata.empty())
+    return nullptr;
+
+  // Parsed only once, the metadata is shared by the readers of all threads
+  std::call_once(fParseParquetMetadata, [this]() {
+    std::uint32_t length = fParquetMetadata.size();
+    fParsedParquetMetadata =
+        parquet::FileMetaData::Make(fParquetMetadata.data(), &length);
+  });
+  return fParsedParquetMetadata;
+}
+
+void MetadataCache::PutParquetMetadata(const parquet::FileMetaData &metadata) {
+  std::shared_ptr<arrow::io::BufferOutputStream> sink;
+  PARQUET_ASSIGN_OR_THROW(sink, arrow::io::BufferOutputStream::Create());
+  metadata.WriteTo(sink.get());
+  std::shared_ptr<arrow::Buffer> buffer;
+  PARQUET_ASSIGN_OR_THROW(buffer, sink->Finish());
+
+  std::lock_guard<std::mutex> guard(fLock);
+  fRecordedParquetMetadata = buffer->ToString();
+}
+
+std::shared_ptr<MetadataCachingFile>
+MetadataCache::WrapFile(std::shared_ptr<arrow::io::RandomAccessFile> file) {
+  return std::make_shared<MetadataCachingFile>(shared_from_this(),
+                                               std::move(file), !fLoaded);
+}
+
+std::unique_ptr<MetadataCachingRawFile>
+MetadataCache::WrapRawFile(std::unique_ptr<ROOT::Internal::RRawFile> file) {
+  return std::make_unique<MetadataCachingRawFile>(shared_from_this(),
+                                                  std::move(file), !fLoaded);
+}
+
+bool MetadataCache::Lookup(std::uint64_t offset, std::size_t nbytes,
+                           void *out) const {
+  auto itr = fRanges.upper_bound(offset);
+  if (itr == fRanges.begin())
+    return false;
+  --itr;
+  if (itr->first + itr->second.size() < offset + nbytes)
+    return false;
+  std::memcpy(out, itr->second.data() + (offset - itr->first), nbytes);
+  return true;
+}
+
+void MetadataCache::Record(std::uint64_t offset, const void *data,
+                           std::size_t nbytes) {
+  std::lock_guard<std::mutex> guard(fLock);
+  add_range(&fRecordedRanges, offset,
+            std::string(static_cast<const char *>(data), nbytes));
+}
+
+void MetadataCache::Save() {
+  std::lock_guard<std::mutex> guard(fLock);
+  if (fRecordedRanges.empty() && fRecordedParquetMetadata.empty())
+    return;
+
+  // The loaded ranges may be in use by concurrent readers, so they are merged
+  // into a copy
+  auto ranges = fRanges;
+  for (auto &[offset, data] : fRecordedRanges)
+    add_range(&ranges, offset, std::move(data));
+  fRecordedRanges.clear();
+  auto parquetMetadata = fRecordedParquetMetadata.empty()
+                             ? fParquetMetadata
+                             : std::move(fRecordedParquetMetadata);
+  fRecordedParquetMetadata.clear();
+
+  std::filesystem::create_directories(
+      std::filesystem::path(fCachePath).parent_path());
+
+  // Write to a temporary file first, so that concurrent runs never see a
+  // partially written cache file
+  std::ostringstream tmpPath;
+  tmpPath << fCachePath << ".tmp." << getpid() << "."
+          << std::hash<std::thread::id>()(std::this_thread::get_id());
+  {
+    std::ofstream os(tmpPath.str(), std::ios::binary | std::ios::trunc);
+    os.write(kMagic, sizeof(kMagic));
+    write_string(os, fInputPath);
+    write_pod(os, fFileSize);
+    write_pod(os, fFileMtime);
+    write_string(os, parquetMetadata);
+
+    write_pod<std::uint64_t>(os, ranges.size());
+    for (const auto &[offset, data] : ranges) {
+      write_pod(os, offset);
+      write_string(os, data);
+    }
+
+    if (!os) {
+      std::remove(tmpPath.str().c_str());
+      throw std::runtime_error("could not write metadata cache " + fCachePath);
+    }
+  }
+  std::filesystem::rename(tmpPath.str(), fCachePath);
+}
+
+bool MetadataCache::IsStale() const {
+  std::error_code ec;
+  auto fileSize = std::filesystem::file_size(fInputPath, ec);
+  if (ec)
+    return true;
+  auto fileMtime = std::filesystem::last_write_time(fInputPath, ec);
+  return ec || fileSize != fFileSize ||
+         fileMtime.time_since_epoch().count() != fFileMtime;
+}
+
+arrow::Result<std::int64_t> MetadataCachingFile::GetSize() {
+  if (fCache->IsLoaded())
+    return fCache->GetFileSize();
+  return fFile->GetSize();
+}
+
+arrow::Result<std::int64_t>
+MetadataCachingFile::ReadAt(std::int64_t position, std::int64_t nbytes,
+                            void *out) {
+  if (fCache->Lookup(position, nbytes, out))
+    return nbytes;
+
+  ARROW_ASSIGN_OR_RAISE(auto nread, fFile->ReadAt(position, nbytes, out));
+  if (fRecording)
+    fCache->Record(position, out, nread);
+  return nread;
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>>
+MetadataCachingFile::ReadAt(std::int64_t position, std::int64_t nbytes) {
+  if (fCache->IsLoaded()) {
+    ARROW_ASSIGN_OR_RAISE(auto buffer, arrow::AllocateBuffer(nbytes));
+    if (fCache->Lookup(position, nbytes, buffer->mutable_data()))
+      return std::shared_ptr<arrow::Buffer>(std::move(buffer));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto result, fFile->ReadAt(position, nbytes));
+  if (fRecording)
+    fCache->Record(position, result->data(), result->size());
+  return result;
+}
+
+arrow::Future<std::shared_ptr<arrow::Buffer>>
+MetadataCachingFile::ReadAsync(const arrow::io::IOContext &ctx,
+                               std::int64_t position, std::int64_t nbytes) {
+  // While recording, go through ReadAt() so that the data is recorded
+  if (fRecording)
+    return arrow::io::RandomAccessFile::ReadAsync(ctx, position, nbytes);
+
+  if (fCache->IsLoaded()) {
+    auto buffer = arrow::AllocateBuffer(nbytes);
+    if (buffer.ok() &&
+        fCache->Lookup(position, nbytes, (*buffer)->mutable_data())) {
+      return arrow::Future<std::shared_ptr<arrow::Buffer>>::MakeFinished(
+          std::shared_ptr<arrow::Buffer>(std::move(*buffer)));
+    }
+  }
+  return fFile->ReadAsync(ctx, position, nbytes);
+}
+
+MetadataCachingRawFile::MetadataCachingRawFile(
+    std::shared_ptr<MetadataCache> cache,
+    std::unique_ptr<ROOT::Internal::RRawFile> file, bool recording)
+    : ROOT::Internal::RRawFile(file->GetUrl(), ROptions()),
+      fCache(std::move(cache)), fFile(std::move(file)), fRecording(recording) {
+  // The wrapped file does its own buffering
+  fOptions.fBlockSize = 0;
+}
+
+std::unique_ptr<ROOT::Internal::RRawFile>
+MetadataCachingRawFile::Clone() const {
+  return std::make_unique<MetadataCachingRawFile>(fCache, fFile->Clone(),
+                                                  false);
+}
+
+size_t MetadataCachingRawFile::ReadAtImpl(void *buffer, size_t nbytes,
+                                          std::uint64_t offset) {
+  if (fCache->Lookup(offset, nbytes, buffer))
+    return nbytes;
+
+  auto nread = fFile->ReadAt(buffer, nbytes, offset);
+  if (fRecording)
+    fCache->Record(offset, buffer, nread);
+  return nread;
+}
+
+std::uint64_t MetadataCachingRawFile::GetSizeImpl() {
+  if (fCache->IsLoaded())
+    return fCache->GetFileSize();
+  return fFile->GetSize();
+}
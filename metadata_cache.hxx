@@ -0,0 +1,160 @@
+#ifndef METADATA_CACHE__HXX
+#define METADATA_CACHE__HXX
+
+#include <ROOT/RRawFile.hxx>
+#include <arrow/io/interfaces.h>
+#include <arrow/util/future.h>
+#include <parquet/metadata.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class MetadataCachingFile;
+class MetadataCachingRawFile;
+
+// Sidecar cache of the metadata read when opening an input file.
+//
+// For Parquet, the serialized FileMetaData is stored and handed to the reader,
+// which then does not read the footer at all. The ORC adapter and RNTuple
+// reader do not accept pre-parsed metadata, so instead the byte ranges read
+// while opening the file (postscript and footer, or anchor, header, footer
+// and page lists) are recorded and served from memory in subsequent runs.
+//
+// The cache file records the size and modification time of the input file and
+// is discarded if either differs.
+//
+// Wrapped files keep the cache alive, as they may outlive the run that opened
+// them (e.g. in the reader pool of the analysis server), so the cache must be
+// owned by a std::shared_ptr.
+class MetadataCache : public std::enable_shared_from_this<MetadataCache> {
+public:
+  MetadataCache(const std::string &cacheDir, const std::string &inputPath);
+
+  // Returns nullptr if no metadata is cached
+  std::shared_ptr<parquet::FileMetaData> GetParquetMetadata();
+  void PutParquetMetadata(const parquet::FileMetaData &metadata);
+
+  // Wrap a file such that cached ranges are served from memory. If nothing is
+  // cached yet, reads are recorded until StopRecording() is called on the
+  // returned file.
+  std::shared_ptr<MetadataCachingFile>
+  WrapFile(std::shared_ptr<arrow::io::RandomAccessFile> file);
+  std::unique_ptr<MetadataCachingRawFile>
+  WrapRawFile(std::unique_ptr<ROOT::Internal::RRawFile> file);
+
+  void Save();
+
+  bool IsLoaded() const { return fLoaded; }
+  // Whether the input file changed since the cache was created
+  bool IsStale() const;
+  std::uint64_t GetFileSize() const { return fFileSize; }
+  // Copies [offset, offset + nbytes) to out if it is fully cached
+  bool Lookup(std::uint64_t offset, std::size_t nbytes, void *out) const;
+  void Record(std::uint64_t offset, const void *data, std::size_t nbytes);
+
+private:
+  bool Load();
+
+  std::string fCachePath;
+  std::string fInputPath;
+  std::uint64_t fFileSize = 0;
+  std::int64_t fFileMtime = 0;
+
+  // Read from the cache file, immutable afterwards
+  bool fLoaded = false;
+  std::map<std::uint64_t, std::string> fRanges;
+  std::string fParquetMetadata;
+
+  std::once_flag fParseParquetMetadata;
+  std::shared_ptr<parquet::FileMetaData> fParsedParquetMetadata;
+
+  std::mutex fLock;
+  std::map<std::uint64_t, std::string> fRecordedRanges;
+  std::string fRecordedParquetMetadata;
+};
+
+// Arrow file that serves reads from the metadata cache if possible
+class MetadataCachingFile : public arrow::io::RandomAccessFile {
+public:
+  MetadataCachingFile(std::shared_ptr<MetadataCache> cache,
+                      std::shared_ptr<arrow::io::RandomAccessFile> file,
+                      bool recording)
+      : fCache(std::move(cache)), fFile(std::move(file)),
+        fRecording(recording) {}
+
+  void StopRecording() { fRecording = false; }
+
+  arrow::Status Close() override { return fFile->Close(); }
+  bool closed() const override { return fFile->closed(); }
+  arrow::Result<std::int64_t> Tell() const override { return fFile->Tell(); }
+  arrow::Status Seek(std::int64_t position) override {
+    return fFile->Seek(position);
+  }
+  arrow::Result<std::int64_t> GetSize() override;
+
+  arrow::Result<std::int64_t> Read(std::int64_t nbytes, void *out) override {
+    return fFile->Read(nbytes, out);
+  }
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  Read(std::int64_t nbytes) override {
+    return fFile->Read(nbytes);
+  }
+
+  using arrow::io::RandomAccessFile::ReadAsync;
+  using arrow::io::RandomAccessFile::ReadAt;
+  using arrow::io::RandomAccessFile::ReadManyAsync;
+  arrow::Result<std::int64_t> ReadAt(std::int64_t position,
+                                     std::int64_t nbytes, void *out) override;
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  ReadAt(std::int64_t position, std::int64_t nbytes) override;
+  arrow::Future<std::shared_ptr<arrow::Buffer>>
+  ReadAsync(const arrow::io::IOContext &ctx, std::int64_t position,
+            std::int64_t nbytes) override;
+  std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+  ReadManyAsync(const arrow::io::IOContext &ctx,
+                const std::vector<arrow::io::ReadRange> &ranges) override {
+    return fFile->ReadManyAsync(ctx, ranges);
+  }
+  arrow::Status
+  WillNeed(const std::vector<arrow::io::ReadRange> &ranges) override {
+    return fFile->WillNeed(ranges);
+  }
+
+private:
+  std::shared_ptr<MetadataCache> fCache;
+  std::shared_ptr<arrow::io::RandomAccessFile> fFile;
+  bool fRecording;
+};
+
+// ROOT raw file that serves reads from the metadata cache if possible
+class MetadataCachingRawFile : public ROOT::Internal::RRawFile {
+public:
+  MetadataCachingRawFile(std::shared_ptr<MetadataCache> cache,
+                         std::unique_ptr<ROOT::Internal::RRawFile> file,
+                         bool recording);
+
+  void StopRecording() { fRecording = false; }
+
+  std::unique_ptr<ROOT::Internal::RRawFile> Clone() const override;
+  int GetFeatures() const override { return fFile->GetFeatures(); }
+
+protected:
+  void OpenImpl() override {}
+  size_t ReadAtImpl(void *buffer, size_t nbytes,
+                    std::uint64_t offset) override;
+  // Vector reads are only used for page data, which is never cached
+  void ReadVImpl(RIOVec *ioVec, unsigned int nReq) override {
+    fFile->ReadV(ioVec, nReq);
+  }
+  std::uint64_t GetSizeImpl() override;
+
+private:
+  std::shared_ptr<MetadataCache> fCache;
+  std::unique_ptr<ROOT::Internal::RRawFile> fFile;
+  bool fRecording;
+};
+
+#endif // METADATA_CACHE__HXX
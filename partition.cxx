@@ -0,0 +1,200 @@
+// Splits the clusters, row groups or stripes of a file into contiguous ranges
+// of about the same size, one per worker. The resulting work plan is run with
+// `--unit-range FIRST:LAST --partial` per worker, and the partial histograms
+// are combined by `merge`, see run_distributed.sh.
+
+#include <ROOT/RNTupleDescriptor.hxx>
+#include <ROOT/RNTupleReader.hxx>
+
+#include <arrow/adapters/orc/adapter.h>
+#include <arrow/io/file.h>
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "util.hxx"
+
+struct PartitionOptions {
+  std::string input_path;
+  std::string ntuple_name = "Events";
+  unsigned n_workers = 1;
+  // Balance the number of entries instead of the bytes on storage
+  bool by_entries = false;
+};
+
+// Size of one cluster, row group or stripe
+struct UnitSize {
+  std::uint64_t nEntries = 0;
+  std::uint64_t nBytes = 0;
+};
+
+static bool parse_partition_options(int argc, char **argv,
+                                    PartitionOptions *opts) {
+  static const struct option longOptions[] = {
+      {"ntuple", required_argument, nullptr, 'n'},
+      {"entries", no_argument, nullptr, 'e'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "n:eh", longOptions, nullptr)) != -1) {
+    switch (c) {
+    case 'n':
+      opts->ntuple_name = optarg;
+      break;
+    case 'e':
+      opts->by_entries = true;
+      break;
+    default:
+      return false;
+    }
+  }
+
+  if (optind + 2 != argc)
+    return false;
+  opts->n_workers = std::stoul(argv[optind++]);
+  opts->input_path = argv[optind];
+  return opts->n_workers > 0;
+}
+
+static void print_partition_usage(const char *progname) {
+  printf("%s [OPTIONS] N_WORKERS INPUT_PATH\n\n", progname);
+  printf("Options:\n");
+  printf("  -n, --ntuple NAME       name of the RNTuple (default: Events)\n");
+  printf("  -e, --entries           balance the number of entries instead of "
+         "the bytes on storage\n");
+}
+
+// In the order of the entries, like get_cluster_boundaries
+static std::vector<UnitSize> get_rntuple_units(const PartitionOptions &opts) {
+  auto reader =
+      ROOT::RNTupleReader::Open(opts.ntuple_name, opts.input_path);
+  const auto &desc = reader->GetDescriptor();
+
+  std::vector<std::pair<std::uint64_t, UnitSize>> clusters;
+  for (const auto &cluster : desc.GetClusterIterable()) {
+    clusters.push_back({cluster.GetFirstEntryIndex(),
+                        {cluster.GetNEntries(), cluster.GetNBytesOnStorage()}});
+  }
+  std::sort(clusters.begin(), clusters.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  std::vector<UnitSize> units;
+  for (const auto &[firstEntry, size] : clusters)
+    units.push_back(size);
+  return units;
+}
+
+static std::vector<UnitSize> get_parquet_units(const PartitionOptions &opts) {
+  auto reader = parquet::ParquetFileReader::OpenFile(opts.input_path);
+  auto metadata = reader->metadata();
+
+  std::vector<UnitSize> units;
+  for (int i = 0; i < metadata->num_row_groups(); ++i) {
+    auto rowGroup = metadata->RowGroup(i);
+    units.push_back({static_cast<std::uint64_t>(rowGroup->num_rows()),
+                     static_cast<std::uint64_t>(
+                         rowGroup->total_compressed_size())});
+  }
+  return units;
+}
+
+static std::vector<UnitSize> get_orc_units(const PartitionOptions &opts) {
+  auto file = arrow::io::ReadableFile::Open(opts.input_path).ValueOrDie();
+  auto reader = arrow::adapters::orc::ORCFileReader::Open(
+                    file, arrow::default_memory_pool())
+                    .ValueOrDie();
+
+  std::vector<UnitSize> units;
+  for (std::int64_t i = 0; i < reader->NumberOfStripes(); ++i) {
+    auto info = reader->GetStripeInformation(i);
+    units.push_back({static_cast<std::uint64_t>(info.num_rows),
+                     static_cast<std::uint64_t>(info.length)});
+  }
+  return units;
+}
+
+// Places the boundary between worker k - 1 and k at the unit boundary closest
+// to k / nWorkers of the total weight, so that the ranges stay contiguous
+static std::vector<UnitRange_t>
+partition_units(const std::vector<std::uint64_t> &weights, unsigned nWorkers) {
+  std::vector<std::uint64_t> prefix(weights.size() + 1, 0);
+  for (std::size_t i = 0; i < weights.size(); ++i)
+    prefix[i + 1] = prefix[i] + weights[i];
+  const auto total = prefix.back();
+
+  std::vector<UnitRange_t> ranges;
+  std::int64_t first = 0;
+  for (unsigned k = 1; k <= nWorkers; ++k) {
+    std::int64_t last = weights.size();
+    if (k < nWorkers) {
+      auto target = static_cast<double>(total) * k / nWorkers;
+      last = std::lower_bound(prefix.begin(), prefix.end(), target) -
+             prefix.begin();
+      if (last > 0 && target - prefix[last - 1] < prefix[last] - target)
+        --last;
+      last = std::clamp<std::int64_t>(last, first, weights.size());
+    }
+    ranges.push_back({first, last});
+    first = last;
+  }
+  return ranges;
+}
+
+int main(int argc, char **argv) {
+  PartitionOptions opts;
+  if (!parse_partition_options(argc, argv, &opts)) {
+    print_partition_usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<UnitSize> units;
+  try {
+    switch (get_file_format(get_path_suffix(opts.input_path))) {
+    case FileFormat::rntuple:
+      units = get_rntuple_units(opts);
+      break;
+    case FileFormat::parquet:
+      units = get_parquet_units(opts);
+      break;
+    case FileFormat::orc:
+      units = get_orc_units(opts);
+      break;
+    }
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<std::uint64_t> weights;
+  for (const auto &unit : units)
+    weights.push_back(opts.by_entries ? unit.nEntries : unit.nBytes);
+
+  // One line per worker: worker index, first and last (exclusive) unit, and
+  // the number of entries and bytes on storage of its units. Workers may get
+  // empty ranges if there are fewer units than workers.
+  auto ranges = partition_units(weights, opts.n_workers);
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    UnitSize size;
+    for (auto unit = ranges[i].first; unit < ranges[i].second; ++unit) {
+      size.nEntries += units[unit].nEntries;
+      size.nBytes += units[unit].nBytes;
+    }
+    std::cout << i << ", " << ranges[i].first << ", " << ranges[i].second
+              << ", " << size.nEntries << ", " << size.nBytes << std::endl;
+  }
+
+  std::cerr << "partition: " << units.size() << " units, "
+            << opts.n_workers << " workers" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,82 @@
+import matplotlib.pyplot as plt
+import argparse
+import pandas as pd
+
+plt.rcParams.update({
+    "font.family": "sans-serif",
+    "text.usetex": True,
+    "axes.autolimit_mode": "round_numbers"
+})
+
+FORMATS = ["root", "orc", "parquet"]
+LABELS = {"root": "RNTuple", "orc": "ORC", "parquet": "Parquet"}
+COLORS = {"root": "tab:orange", "orc": "tab:red", "parquet": "tab:blue"}
+
+
+def load_scaling(results_dir, input_base, fmt, mode, affinity):
+    df = pd.read_csv(f"{results_dir}/{input_base}_{fmt}_{mode}_{affinity}.csv")
+    df["analysis"] /= 1e6
+    df_mean = df.groupby("threads").mean()
+    t1 = df_mean.analysis.loc[1]
+    if mode == "strong":
+        # Fixed amount of work: ideal runtime shrinks as 1/n
+        df_mean["speedup"] = t1 / df_mean.analysis
+    else:
+        # Work grows with n: ideal runtime stays constant
+        df_mean["speedup"] = df_mean.index * t1 / df_mean.analysis
+    df_mean["efficiency"] = df_mean.speedup / df_mean.index
+    return df_mean
+
+
+def plot_scaling(results_dir, input_base, mode, affinity):
+    fig, (ax_speedup, ax_eff) = plt.subplots(1, 2, figsize=(6, 2.5))
+
+    for fmt in FORMATS:
+        try:
+            df = load_scaling(results_dir, input_base, fmt, mode, affinity)
+        except FileNotFoundError:
+            continue
+        print(f"{input_base} ({LABELS[fmt]}, {mode} scaling, {affinity}):")
+        print(df[["analysis", "speedup", "efficiency"]])
+
+        ax_speedup.plot(df.index, df.speedup, marker=".", color=COLORS[fmt],
+                        label=LABELS[fmt])
+        ax_eff.plot(df.index, df.efficiency, marker=".", color=COLORS[fmt],
+                    label=LABELS[fmt])
+
+    threads = ax_speedup.get_xlim()
+    ax_speedup.plot(threads, threads, linestyle="--", color="gray", linewidth=0.7)
+    ax_eff.axhline(1, linestyle="--", color="gray", linewidth=0.7)
+
+    ax_speedup.set_xlabel("Threads", fontdict={"size": 12})
+    ax_speedup.set_ylabel("Scaled speedup" if mode == "weak" else "Speedup",
+                          fontdict={"size": 12})
+    ax_eff.set_xlabel("Threads", fontdict={"size": 12})
+    ax_eff.set_ylabel("Parallel efficiency", fontdict={"size": 12})
+    ax_eff.set_ylim(0, 1.1)
+    ax_eff.legend()
+
+    fig.tight_layout()
+    fig.savefig(f"output/scaling_{input_base}_{mode}_{affinity}.png", bbox_inches="tight")
+    fig.savefig(f"output/scaling_{input_base}_{mode}_{affinity}.pdf", bbox_inches="tight")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        prog="plot_scaling", description="plot the strong and weak scaling results"
+    )
+    parser.add_argument(
+        "results_dir", default="./results/scaling", help="path to the scaling results directory"
+    )
+    parser.add_argument(
+        "-a", "--affinity",
+        dest="affinity",
+        default="compact",
+        choices=["none", "compact", "scatter", "numa"],
+        help="thread affinity policy of the runs to plot",
+    )
+    args = parser.parse_args()
+
+    for input_base in ["B2HHH", "B2HHH_ntplcfg", "ttjet_signed", "ttjet_signed_ntplcfg"]:
+        for mode in ["strong", "weak"]:
+            plot_scaling(args.results_dir, input_base, mode, args.affinity)
@@ -0,0 +1,50 @@
+import argparse
+import socket
+import sys
+
+parser = argparse.ArgumentParser(
+    prog="query",
+    description="send an analysis request to a benchmark started with --listen",
+)
+parser.add_argument("socket_path", help="Unix socket the benchmark listens on")
+parser.add_argument(
+    "request",
+    nargs=argparse.REMAINDER,
+    help="benchmark arguments: [OPTIONS] INPUT_PATH [HISTO_PATH]",
+)
+parser.add_argument(
+    "-b",
+    "--bins",
+    dest="bins_path",
+    help="path to write the histogram bins to as CSV (low edge, content)",
+)
+
+args = parser.parse_args()
+
+with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+    s.connect(args.socket_path)
+    s.sendall((" ".join(args.request) + "\n").encode())
+    s.shutdown(socket.SHUT_WR)
+    response = b""
+    while chunk := s.recv(65536):
+        response += chunk
+
+lines = response.decode().splitlines()
+status, _, timings = lines[0].partition(" ")
+if status != "OK":
+    print(timings, file=sys.stderr)
+    sys.exit(1)
+
+# Same output as a standalone run: init, analysis, main
+print(timings)
+
+if args.bins_path != None:
+    n_bins, low, high = lines[1].split()
+    n_bins, low, high = int(n_bins), float(low), float(high)
+    contents = lines[2].split()
+    width = (high - low) / n_bins
+    with open(args.bins_path, "w") as f:
+        f.write("low_edge,content\n")
+        # Skip the underflow and overflow bins
+        for i in range(1, n_bins + 1):
+            f.write(f"{low + (i - 1) * width},{contents[i]}\n")
@@ -0,0 +1,215 @@
+#include "read_trace.hxx"
+
+#include <ROOT/RNTupleDescriptor.hxx>
+#include <arrow/buffer.h>
+#include <parquet/metadata.h>
+#include <parquet/schema.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+thread_local std::string gContext;
+
+// Small numbers are easier to read in the trace than thread ids
+unsigned get_thread_number() {
+  static std::atomic<unsigned> nThreads{0};
+  thread_local unsigned threadNumber = nThreads++;
+  return threadNumber;
+}
+
+} // anonymous namespace
+
+std::shared_ptr<ReadTrace> ReadTrace::Get(const std::string &path) {
+  if (path.empty())
+    return nullptr;
+
+  static std::mutex lock;
+  static std::map<std::string, std::weak_ptr<ReadTrace>> traces;
+  std::lock_guard<std::mutex> guard(lock);
+  auto trace = traces[path].lock();
+  if (!trace) {
+    trace = std::make_shared<ReadTrace>(path);
+    traces[path] = trace;
+  }
+  return trace;
+}
+
+ReadTrace::ReadTrace(const std::string &path)
+    : fStart(std::chrono::steady_clock::now()),
+      fOutput(path, std::ios::trunc) {
+  if (!fOutput)
+    throw std::runtime_error("could not open trace " + path);
+  fOutput << "timestamp,thread,op,offset,length,context,columns\n";
+}
+
+void ReadTrace::Record(const char *op, std::uint64_t offset,
+                       std::uint64_t length) {
+  auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - fStart)
+                       .count();
+  auto thread = get_thread_number();
+  const auto &context = TraceContext::Get();
+
+  std::lock_guard<std::mutex> guard(fLock);
+  fOutput << timestamp << "," << thread << "," << op << "," << offset << ","
+          << length << "," << context << "," << GetColumns(offset, length)
+          << "\n";
+}
+
+void ReadTrace::AddColumnRange(std::uint64_t offset, std::uint64_t length,
+                               const std::string &column) {
+  if (length == 0)
+    return;
+  std::lock_guard<std::mutex> guard(fLock);
+  fColumnRanges[offset] = {offset + length, column};
+}
+
+std::string ReadTrace::GetColumns(std::uint64_t offset,
+                                  std::uint64_t length) const {
+  auto it = fColumnRanges.upper_bound(offset);
+  if (it != fColumnRanges.begin() && std::prev(it)->second.first > offset)
+    --it;
+
+  std::vector<const std::string *> columns;
+  for (; it != fColumnRanges.end() && it->first < offset + length; ++it) {
+    const auto &column = it->second.second;
+    if (std::none_of(columns.begin(), columns.end(),
+                     [&](const std::string *c) { return *c == column; }))
+      columns.push_back(&column);
+  }
+
+  std::string result;
+  for (const auto *column : columns) {
+    if (!result.empty())
+      result += "|";
+    result += *column;
+  }
+  return result;
+}
+
+void add_rntuple_column_ranges(ReadTrace &trace,
+                               const ROOT::RNTupleDescriptor &desc) {
+  std::function<void(ROOT::DescriptorId_t, const std::string &)> visit =
+      [&](ROOT::DescriptorId_t fieldId, const std::string &name) {
+        for (const auto &column : desc.GetColumnIterable(fieldId)) {
+          if (column.IsAliasColumn())
+            continue;
+          auto physicalColumnId = column.GetPhysicalId();
+          for (const auto &cluster : desc.GetClusterIterable()) {
+            if (!cluster.ContainsColumn(physicalColumnId))
+              continue;
+            for (const auto &pageInfo :
+                 cluster.GetPageRange(physicalColumnId).GetPageInfos()) {
+              const auto &locator = pageInfo.GetLocator();
+              trace.AddColumnRange(locator.GetPosition<std::uint64_t>(),
+                                   locator.GetNBytesOnStorage(), name);
+            }
+          }
+        }
+        for (const auto &child : desc.GetFieldIterable(fieldId))
+          visit(child.GetId(), name);
+      };
+
+  for (const auto &field : desc.GetTopLevelFields())
+    visit(field.GetId(), field.GetFieldName());
+}
+
+void add_parquet_column_ranges(ReadTrace &trace,
+                               const parquet::FileMetaData &metadata) {
+  const auto *schema = metadata.schema();
+  for (int rowGroup = 0; rowGroup < metadata.num_row_groups(); ++rowGroup) {
+    auto rowGroupMetadata = metadata.RowGroup(rowGroup);
+    for (int i = 0; i < rowGroupMetadata->num_columns(); ++i) {
+      auto chunk = rowGroupMetadata->ColumnChunk(i);
+      // The dictionary page, if any, comes first
+      auto start = chunk->has_dictionary_page()
+                       ? chunk->dictionary_page_offset()
+                       : chunk->data_page_offset();
+      trace.AddColumnRange(start, chunk->total_compressed_size(),
+                           schema->Column(i)->path()->ToDotVector()[0]);
+    }
+  }
+}
+
+TraceContext::TraceContext(std::string context)
+    : fPrevious(std::move(gContext)) {
+  gContext = std::move(context);
+}
+
+TraceContext::~TraceContext() { gContext = std::move(fPrevious); }
+
+const std::string &TraceContext::Get() { return gContext; }
+
+arrow::Result<std::int64_t> TracingFile::Read(std::int64_t nbytes, void *out) {
+  ARROW_ASSIGN_OR_RAISE(auto position, fFile->Tell());
+  fTrace->Record("read", position, nbytes);
+  return fFile->Read(nbytes, out);
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>>
+TracingFile::Read(std::int64_t nbytes) {
+  ARROW_ASSIGN_OR_RAISE(auto position, fFile->Tell());
+  fTrace->Record("read", position, nbytes);
+  return fFile->Read(nbytes);
+}
+
+arrow::Result<std::int64_t>
+TracingFile::ReadAt(std::int64_t position, std::int64_t nbytes, void *out) {
+  fTrace->Record("read", position, nbytes);
+  return fFile->ReadAt(position, nbytes, out);
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>>
+TracingFile::ReadAt(std::int64_t position, std::int64_t nbytes) {
+  fTrace->Record("read", position, nbytes);
+  return fFile->ReadAt(position, nbytes);
+}
+
+arrow::Future<std::shared_ptr<arrow::Buffer>>
+TracingFile::ReadAsync(const arrow::io::IOContext &ctx, std::int64_t position,
+                       std::int64_t nbytes) {
+  fTrace->Record("async", position, nbytes);
+  return fFile->ReadAsync(ctx, position, nbytes);
+}
+
+std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+TracingFile::ReadManyAsync(const arrow::io::IOContext &ctx,
+                           const std::vector<arrow::io::ReadRange> &ranges) {
+  for (const auto &range : ranges)
+    fTrace->Record("async", range.offset, range.length);
+  return fFile->ReadManyAsync(ctx, ranges);
+}
+
+arrow::Status
+TracingFile::WillNeed(const std::vector<arrow::io::ReadRange> &ranges) {
+  for (const auto &range : ranges)
+    fTrace->Record("prefetch", range.offset, range.length);
+  return fFile->WillNeed(ranges);
+}
+
+TracingRawFile::TracingRawFile(std::unique_ptr<ROOT::Internal::RRawFile> file,
+                               std::shared_ptr<ReadTrace> trace,
+                               const ROptions &options)
+    : ROOT::Internal::RRawFile(file->GetUrl(), options),
+      fFile(std::move(file)), fTrace(std::move(trace)) {}
+
+std::unique_ptr<ROOT::Internal::RRawFile> TracingRawFile::Clone() const {
+  return std::make_unique<TracingRawFile>(fFile->Clone(), fTrace, fOptions);
+}
+
+size_t TracingRawFile::ReadAtImpl(void *buffer, size_t nbytes,
+                                  std::uint64_t offset) {
+  fTrace->Record("read", offset, nbytes);
+  return fFile->ReadAt(buffer, nbytes, offset);
+}
+
+void TracingRawFile::ReadVImpl(RIOVec *ioVec, unsigned int nReq) {
+  for (unsigned int i = 0; i < nReq; ++i)
+    fTrace->Record("readv", ioVec[i].fOffset, ioVec[i].fSize);
+  fFile->ReadV(ioVec, nReq);
+}
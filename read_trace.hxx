@@ -0,0 +1,145 @@
+#ifndef READ_TRACE__HXX
+#define READ_TRACE__HXX
+
+#include <ROOT/RRawFile.hxx>
+#include <arrow/io/interfaces.h>
+#include <arrow/result.h>
+#include <arrow/util/future.h>
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace ROOT {
+class RNTupleDescriptor;
+}
+namespace parquet {
+class FileMetaData;
+}
+
+// Log of the reads issued to the storage, written as CSV with the columns
+//
+//   timestamp,thread,op,offset,length,context,columns
+//
+// where timestamp is in microseconds since the trace was opened, thread is a
+// small per-thread number, op is one of read, readv, async or prefetch,
+// context is the label set by the innermost TraceContext of the issuing thread
+// (e.g. the cluster, row group or stripe being read), and columns lists the
+// columns whose data the read touches, separated by '|'. Columns are known
+// from the byte ranges added by the readers: the RNTuple pages and the Parquet
+// column chunks. The streams of ORC stripes are not exposed by the Arrow
+// adapter, so ORC reads carry no columns. The trace can be replayed and
+// summarized with the replay tool.
+class ReadTrace {
+public:
+  // Traces are shared per output path, the file is complete once the last
+  // user releases it
+  static std::shared_ptr<ReadTrace> Get(const std::string &path);
+
+  explicit ReadTrace(const std::string &path);
+
+  void Record(const char *op, std::uint64_t offset, std::uint64_t length);
+
+  // Attributes the given byte range of the input file to a column
+  void AddColumnRange(std::uint64_t offset, std::uint64_t length,
+                      const std::string &column);
+
+private:
+  // The columns of the ranges overlapping the read, fLock must be held
+  std::string GetColumns(std::uint64_t offset, std::uint64_t length) const;
+
+  std::chrono::steady_clock::time_point fStart;
+  std::mutex fLock;
+  std::ofstream fOutput;
+  // Column ranges by offset, as end offset and column name
+  std::map<std::uint64_t, std::pair<std::uint64_t, std::string>>
+      fColumnRanges;
+};
+
+// Add the page locations of all columns, by top-level field name
+void add_rntuple_column_ranges(ReadTrace &trace,
+                               const ROOT::RNTupleDescriptor &desc);
+// Add the column chunks of all row groups, by top-level field name
+void add_parquet_column_ranges(ReadTrace &trace,
+                               const parquet::FileMetaData &metadata);
+
+// Labels the reads issued by the current thread during its lifetime
+class TraceContext {
+public:
+  explicit TraceContext(std::string context);
+  ~TraceContext();
+
+  static const std::string &Get();
+
+private:
+  std::string fPrevious;
+};
+
+// Arrow file that records its reads in a trace
+class TracingFile : public arrow::io::RandomAccessFile {
+public:
+  TracingFile(std::shared_ptr<arrow::io::RandomAccessFile> file,
+              std::shared_ptr<ReadTrace> trace)
+      : fFile(std::move(file)), fTrace(std::move(trace)) {}
+
+  arrow::Status Close() override { return fFile->Close(); }
+  bool closed() const override { return fFile->closed(); }
+  arrow::Result<std::int64_t> Tell() const override { return fFile->Tell(); }
+  arrow::Status Seek(std::int64_t position) override {
+    return fFile->Seek(position);
+  }
+  arrow::Result<std::int64_t> GetSize() override { return fFile->GetSize(); }
+
+  arrow::Result<std::int64_t> Read(std::int64_t nbytes, void *out) override;
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  Read(std::int64_t nbytes) override;
+
+  using arrow::io::RandomAccessFile::ReadAsync;
+  using arrow::io::RandomAccessFile::ReadAt;
+  using arrow::io::RandomAccessFile::ReadManyAsync;
+  arrow::Result<std::int64_t> ReadAt(std::int64_t position,
+                                     std::int64_t nbytes, void *out) override;
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  ReadAt(std::int64_t position, std::int64_t nbytes) override;
+  // Recorded when issued, in the context of the calling thread
+  arrow::Future<std::shared_ptr<arrow::Buffer>>
+  ReadAsync(const arrow::io::IOContext &ctx, std::int64_t position,
+            std::int64_t nbytes) override;
+  std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+  ReadManyAsync(const arrow::io::IOContext &ctx,
+                const std::vector<arrow::io::ReadRange> &ranges) override;
+  arrow::Status
+  WillNeed(const std::vector<arrow::io::ReadRange> &ranges) override;
+
+private:
+  std::shared_ptr<arrow::io::RandomAccessFile> fFile;
+  std::shared_ptr<ReadTrace> fTrace;
+};
+
+// ROOT raw file that records its reads in a trace
+class TracingRawFile : public ROOT::Internal::RRawFile {
+public:
+  TracingRawFile(std::unique_ptr<ROOT::Internal::RRawFile> file,
+                 std::shared_ptr<ReadTrace> trace, const ROptions &options);
+
+  std::unique_ptr<ROOT::Internal::RRawFile> Clone() const override;
+  int GetFeatures() const override { return fFile->GetFeatures(); }
+
+protected:
+  void OpenImpl() override {}
+  size_t ReadAtImpl(void *buffer, size_t nbytes,
+                    std::uint64_t offset) override;
+  void ReadVImpl(RIOVec *ioVec, unsigned int nReq) override;
+  std::uint64_t GetSizeImpl() override { return fFile->GetSize(); }
+
+private:
+  std::unique_ptr<ROOT::Internal::RRawFile> fFile;
+  std::shared_ptr<ReadTrace> fTrace;
+};
+
+#endif // READ_TRACE__HXX
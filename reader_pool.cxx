@@ -0,0 +1,113 @@
+#include "reader_pool.hxx"
+
+#include <parquet/exception.h>
+
+#include <filesystem>
+#include <sstream>
+
+#include "memory_pool.hxx"
+#include "metadata_cache.hxx"
+#include "read_trace.hxx"
+
+std::unique_ptr<OrcInput> open_orc(const AnalysisOptions &opts,
+                                   MetadataCache *metadataCache) {
+  auto input = std::make_unique<OrcInput>();
+  input->file = open_input_file(opts.input_path, opts);
+  std::shared_ptr<MetadataCachingFile> cachingFile;
+  if (metadataCache) {
+    cachingFile = metadataCache->WrapFile(input->file);
+    input->file = cachingFile;
+  }
+  PARQUET_ASSIGN_OR_THROW(input->reader,
+                          arrow::adapters::orc::ORCFileReader::Open(
+                              input->file, get_memory_pool(opts)));
+  PARQUET_ASSIGN_OR_THROW(input->schema, input->reader->ReadSchema());
+  if (cachingFile)
+    cachingFile->StopRecording();
+  return input;
+}
+
+std::unique_ptr<parquet::arrow::FileReader>
+open_parquet(const AnalysisOptions &opts, MetadataCache *metadataCache) {
+  std::shared_ptr<parquet::FileMetaData> metadata;
+  if (metadataCache)
+    metadata = metadataCache->GetParquetMetadata();
+
+  parquet::arrow::FileReaderBuilder builder;
+  PARQUET_THROW_NOT_OK(builder.Open(open_input_file(opts.input_path, opts),
+                                    parquet::default_reader_properties(),
+                                    metadata));
+  builder.memory_pool(get_memory_pool(opts));
+  builder.properties(get_arrow_reader_properties(opts));
+
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  PARQUET_ASSIGN_OR_THROW(reader, builder.Build());
+  reader->set_use_threads(false);
+  if (metadataCache && !metadata)
+    metadataCache->PutParquetMetadata(*reader->parquet_reader()->metadata());
+  if (auto trace = get_read_trace(opts))
+    add_parquet_column_ranges(*trace, *reader->parquet_reader()->metadata());
+  return reader;
+}
+
+std::string ReaderPool::GetKey(const std::string &kind,
+                               const AnalysisOptions &opts) {
+  // A rewritten input is opened again
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(opts.input_path, ec);
+
+  std::ostringstream os;
+  os << kind << "\n"
+     << opts.input_path << "\n"
+     << (ec ? 0 : mtime.time_since_epoch().count()) << "\n"
+     << static_cast<int>(opts.io) << " " << opts.io_depth << " "
+     << static_cast<int>(opts.memory_pool) << "\n"
+     << opts.storage_latency_ms << " " << opts.storage_bandwidth << " "
+     << opts.storage_max_requests << "\n"
+     << opts.trace_path;
+  return os.str();
+}
+
+std::shared_ptr<void> ReaderPool::Take(const std::string &key) {
+  std::lock_guard<std::mutex> guard(fLock);
+  auto it = fIdle.find(key);
+  if (it == fIdle.end() || it->second.empty())
+    return nullptr;
+  auto reader = std::move(it->second.back());
+  it->second.pop_back();
+  return reader;
+}
+
+void ReaderPool::Give(const std::string &key, std::shared_ptr<void> reader) {
+  std::lock_guard<std::mutex> guard(fLock);
+  fIdle[key].emplace_back(std::move(reader));
+}
+
+std::shared_ptr<OrcInput> acquire_orc(const AnalysisOptions &opts,
+                                      const AnalysisCaches &caches) {
+  auto open = [&]() { return open_orc(opts, caches.metadata); };
+  if (!caches.readers)
+    return open();
+  return caches.readers->Acquire<OrcInput>("orc", opts, open);
+}
+
+std::shared_ptr<parquet::arrow::FileReader>
+acquire_parquet(const AnalysisOptions &opts, const AnalysisCaches &caches) {
+  auto open = [&]() { return open_parquet(opts, caches.metadata); };
+  if (!caches.readers)
+    return open();
+  return caches.readers->Acquire<parquet::arrow::FileReader>("parquet", opts,
+                                                             open);
+}
+
+std::shared_ptr<ROOT::RNTupleReader>
+acquire_rntuple(std::string_view ntupleName, const AnalysisOptions &opts,
+                const AnalysisCaches &caches) {
+  auto open = [&]() {
+    return open_rntuple(ntupleName, opts.input_path, opts, caches.metadata);
+  };
+  if (!caches.readers)
+    return open();
+  return caches.readers->Acquire<ROOT::RNTupleReader>(
+      "rntuple " + std::string(ntupleName), opts, open);
+}
@@ -0,0 +1,79 @@
+#ifndef READER_POOL__HXX
+#define READER_POOL__HXX
+
+#include <ROOT/RNTupleReader.hxx>
+#include <arrow/adapters/orc/adapter.h>
+#include <arrow/io/interfaces.h>
+#include <parquet/arrow/reader.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "util.hxx"
+
+class MetadataCache;
+
+// An ORC reader and the file it reads from, which is also used for prefetching
+struct OrcInput {
+  std::shared_ptr<arrow::io::RandomAccessFile> file;
+  std::unique_ptr<arrow::adapters::orc::ORCFileReader> reader;
+  std::shared_ptr<arrow::Schema> schema;
+};
+
+// Open the input file of opts, serving the metadata from the cache if given.
+// Throw if the file cannot be opened.
+std::unique_ptr<OrcInput> open_orc(const AnalysisOptions &opts,
+                                   MetadataCache *metadataCache = nullptr);
+std::unique_ptr<parquet::arrow::FileReader>
+open_parquet(const AnalysisOptions &opts,
+             MetadataCache *metadataCache = nullptr);
+
+// Readers of the input files that stay open between the requests of the
+// analysis server, so that only the first request of an input opens it. A
+// reader is used by one analysis thread at a time: Acquire() takes an idle one
+// or opens a new one, and the returned handle puts it back when released.
+//
+// Readers are kept by input path, its modification time, and the options that
+// determine how the file is opened (I/O backend, memory pool, emulated storage
+// and read trace).
+class ReaderPool {
+public:
+  template <typename ReaderT>
+  std::shared_ptr<ReaderT>
+  Acquire(const std::string &kind, const AnalysisOptions &opts,
+          const std::function<std::unique_ptr<ReaderT>()> &open) {
+    auto key = GetKey(kind, opts);
+    auto reader = Take(key);
+    if (!reader)
+      reader = std::shared_ptr<ReaderT>(open());
+    auto raw = static_cast<ReaderT *>(reader.get());
+    return std::shared_ptr<ReaderT>(
+        raw, [this, key, reader](ReaderT *) { Give(key, reader); });
+  }
+
+private:
+  static std::string GetKey(const std::string &kind,
+                            const AnalysisOptions &opts);
+  std::shared_ptr<void> Take(const std::string &key);
+  void Give(const std::string &key, std::shared_ptr<void> reader);
+
+  std::mutex fLock;
+  // Idle readers, by key
+  std::map<std::string, std::vector<std::shared_ptr<void>>> fIdle;
+};
+
+// Take an idle reader of the input from the pool if given, otherwise open it
+std::shared_ptr<OrcInput> acquire_orc(const AnalysisOptions &opts,
+                                      const AnalysisCaches &caches);
+std::shared_ptr<parquet::arrow::FileReader>
+acquire_parquet(const AnalysisOptions &opts, const AnalysisCaches &caches);
+std::shared_ptr<ROOT::RNTupleReader>
+acquire_rntuple(std::string_view ntupleName, const AnalysisOptions &opts,
+                const AnalysisCaches &caches);
+
+#endif // READER_POOL__HXX
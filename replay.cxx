@@ -0,0 +1,358 @@
+// Summarizes and replays a read trace recorded with --trace, see ReadTrace
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+struct TracedRead {
+  std::uint64_t timestamp; // us
+  unsigned thread;
+  std::string op;
+  std::uint64_t offset;
+  std::uint64_t length;
+  std::string context;
+  // Columns touched by the read, separated by '|'
+  std::string columns;
+};
+
+struct ReplayOptions {
+  std::string trace_path;
+  std::string input_path;
+  // Issue the reads back to back instead of at their recorded time
+  bool asap = false;
+  bool stats_only = false;
+  // Threads that issue the asynchronous reads and prefetches
+  unsigned io_threads = 8;
+};
+
+static bool parse_options(int argc, char **argv, ReplayOptions *opts) {
+  static const struct option longOptions[] = {
+      {"asap", no_argument, nullptr, 'a'},
+      {"stats-only", no_argument, nullptr, 'n'},
+      {"io-threads", required_argument, nullptr, 'j'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "anj:h", longOptions, nullptr)) != -1) {
+    switch (c) {
+    case 'a':
+      opts->asap = true;
+      break;
+    case 'n':
+      opts->stats_only = true;
+      break;
+    case 'j':
+      opts->io_threads = std::max(std::stoul(optarg), 1ul);
+      break;
+    default:
+      return false;
+    }
+  }
+
+  if (optind >= argc)
+    return false;
+  opts->trace_path = argv[optind++];
+  if (optind < argc)
+    opts->input_path = argv[optind++];
+
+  return opts->stats_only || !opts->input_path.empty();
+}
+
+static void print_usage(const char *progname) {
+  printf("%s [OPTIONS] TRACE_PATH [INPUT_PATH]\n\n", progname);
+  printf("Options:\n");
+  printf("  -a, --asap              issue the reads back to back instead of "
+         "with the recorded timing\n");
+  printf("  -n, --stats-only        only print the trace statistics\n");
+  printf("  -j, --io-threads N      threads issuing the asynchronous reads "
+         "(default: 8)\n");
+}
+
+static bool read_trace(const std::string &path,
+                       std::vector<TracedRead> *reads) {
+  std::ifstream is(path);
+  std::string line;
+  // Traces without the columns field are still accepted
+  if (!std::getline(is, line) ||
+      (line != "timestamp,thread,op,offset,length,context,columns" &&
+       line != "timestamp,thread,op,offset,length,context"))
+    return false;
+
+  while (std::getline(is, line)) {
+    std::istringstream fields(line);
+    std::string timestamp, thread, offset, length;
+    TracedRead read;
+    if (!std::getline(fields, timestamp, ',') ||
+        !std::getline(fields, thread, ',') ||
+        !std::getline(fields, read.op, ',') ||
+        !std::getline(fields, offset, ',') ||
+        !std::getline(fields, length, ','))
+      return false;
+    std::getline(fields, read.context, ',');
+    std::getline(fields, read.columns);
+    read.timestamp = std::stoull(timestamp);
+    read.thread = std::stoul(thread);
+    read.offset = std::stoull(offset);
+    read.length = std::stoull(length);
+    reads->push_back(std::move(read));
+  }
+
+  // Records are written in the order their writers got the lock, which may
+  // differ slightly from the order the reads were issued in
+  std::stable_sort(reads->begin(), reads->end(),
+                   [](const TracedRead &a, const TracedRead &b) {
+                     return a.timestamp < b.timestamp;
+                   });
+  return true;
+}
+
+static std::string format_size(std::uint64_t size) {
+  const char *units[] = {"B", "KiB", "MiB", "GiB"};
+  unsigned unit = 0;
+  while (size >= 1024 && size % 1024 == 0 && unit < 3) {
+    size /= 1024;
+    ++unit;
+  }
+  return std::to_string(size) + " " + units[unit];
+}
+
+static void print_statistics(const std::vector<TracedRead> &reads) {
+  std::map<std::string, std::pair<std::uint64_t, std::uint64_t>> byOp;
+  std::uint64_t nBytes = 0;
+  for (const auto &read : reads) {
+    byOp[read.op].first++;
+    byOp[read.op].second += read.length;
+    nBytes += read.length;
+  }
+
+  auto duration = reads.empty() ? 0 : reads.back().timestamp;
+  printf("requests: %zu, bytes: %lu, recorded duration: %lu us\n",
+         reads.size(), nBytes, duration);
+  for (const auto &[op, counts] : byOp)
+    printf("  %-10s %10lu requests %14lu bytes\n", op.c_str(), counts.first,
+           counts.second);
+
+  // A read touching several columns counts for all of them
+  std::map<std::string, std::pair<std::uint64_t, std::uint64_t>> byColumn;
+  for (const auto &read : reads) {
+    std::istringstream columns(read.columns);
+    for (std::string column; std::getline(columns, column, '|');) {
+      byColumn[column].first++;
+      byColumn[column].second += read.length;
+    }
+  }
+  if (!byColumn.empty()) {
+    printf("\nrequests by column:\n");
+    for (const auto &[column, counts] : byColumn)
+      printf("  %-30s %10lu requests %14lu bytes\n", column.c_str(),
+             counts.first, counts.second);
+  }
+
+  // Request sizes in power-of-two buckets, starting at 4 KiB
+  std::map<std::uint64_t, std::uint64_t> sizeBuckets;
+  for (const auto &read : reads) {
+    std::uint64_t bucket = 4096;
+    while (bucket < read.length)
+      bucket *= 2;
+    sizeBuckets[bucket]++;
+  }
+  printf("\nrequest sizes:\n");
+  for (const auto &[bucket, count] : sizeBuckets) {
+    printf("  <= %-10s %10lu (%5.1f%%)\n", format_size(bucket).c_str(), count,
+           100. * count / reads.size());
+  }
+
+  // Distance between the end of a read and the start of the next one issued by
+  // the same thread
+  std::map<unsigned, const TracedRead *> lastRead;
+  std::vector<std::uint64_t> seekDistances;
+  std::uint64_t nSequential = 0, nForward = 0, nBackward = 0;
+  for (const auto &read : reads) {
+    auto &last = lastRead[read.thread];
+    if (last) {
+      auto end = static_cast<std::int64_t>(last->offset + last->length);
+      auto distance = static_cast<std::int64_t>(read.offset) - end;
+      if (distance == 0)
+        ++nSequential;
+      else if (distance > 0)
+        ++nForward;
+      else
+        ++nBackward;
+      seekDistances.push_back(std::abs(distance));
+    }
+    last = &read;
+  }
+
+  if (seekDistances.empty())
+    return;
+  std::sort(seekDistances.begin(), seekDistances.end());
+  double meanDistance = 0;
+  for (auto distance : seekDistances)
+    meanDistance += distance;
+  meanDistance /= seekDistances.size();
+  auto nSeeks = seekDistances.size();
+  printf("\nseeks (per thread):\n");
+  printf("  sequential %10lu (%5.1f%%)\n", nSequential,
+         100. * nSequential / nSeeks);
+  printf("  forward    %10lu (%5.1f%%)\n", nForward, 100. * nForward / nSeeks);
+  printf("  backward   %10lu (%5.1f%%)\n", nBackward,
+         100. * nBackward / nSeeks);
+  printf("  distance   median %lu B, mean %.0f B, max %lu B\n",
+         seekDistances[nSeeks / 2], meanDistance, seekDistances.back());
+}
+
+// Issues the asynchronous reads, without blocking the replaying thread
+class IoPool {
+public:
+  IoPool(int fd, unsigned nThreads) : fFd(fd) {
+    for (unsigned i = 0; i < nThreads; ++i)
+      fThreads.emplace_back(&IoPool::Work, this);
+  }
+
+  ~IoPool() { Finish(); }
+
+  // Waits for the outstanding reads and returns the number of bytes read
+  std::uint64_t Finish() {
+    {
+      std::lock_guard<std::mutex> guard(fLock);
+      fStopping = true;
+    }
+    fCond.notify_all();
+    for (auto &t : fThreads)
+      t.join();
+    fThreads.clear();
+    return fNBytes;
+  }
+
+  void Submit(const TracedRead *read) {
+    {
+      std::lock_guard<std::mutex> guard(fLock);
+      fQueue.push_back(read);
+    }
+    fCond.notify_one();
+  }
+
+private:
+  void Work() {
+    std::vector<char> buffer;
+    while (true) {
+      const TracedRead *read;
+      {
+        std::unique_lock<std::mutex> lock(fLock);
+        fCond.wait(lock, [this]() { return fStopping || !fQueue.empty(); });
+        if (fQueue.empty())
+          return;
+        read = fQueue.front();
+        fQueue.pop_front();
+      }
+      buffer.resize(std::max<std::size_t>(buffer.size(), read->length));
+      auto n = pread(fFd, buffer.data(), read->length, read->offset);
+      if (n > 0)
+        fNBytes += n;
+    }
+  }
+
+  int fFd;
+  std::vector<std::thread> fThreads;
+  std::mutex fLock;
+  std::condition_variable fCond;
+  std::deque<const TracedRead *> fQueue;
+  bool fStopping = false;
+  std::atomic<std::uint64_t> fNBytes{0};
+};
+
+// Returns the wall-clock time of the replay in microseconds
+static std::uint64_t replay(const ReplayOptions &opts,
+                            const std::vector<TracedRead> &reads,
+                            std::uint64_t *bytesRead) {
+  int fd = open(opts.input_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("could not open " + opts.input_path);
+
+  // Every recorded thread is replayed by its own thread
+  std::map<unsigned, std::vector<const TracedRead *>> readsByThread;
+  for (const auto &read : reads)
+    readsByThread[read.thread].push_back(&read);
+
+  std::atomic<std::uint64_t> nBytes{0};
+  auto ts_start = std::chrono::steady_clock::now();
+  {
+    IoPool ioPool(fd, opts.io_threads);
+    std::vector<std::thread> threads;
+    for (const auto &[thread, threadReads] : readsByThread) {
+      threads.emplace_back([&, &threadReads = threadReads]() {
+        std::vector<char> buffer;
+        for (const auto *read : threadReads) {
+          if (!opts.asap) {
+            std::this_thread::sleep_until(
+                ts_start + std::chrono::microseconds(read->timestamp));
+          }
+          if (read->op == "async" || read->op == "prefetch") {
+            ioPool.Submit(read);
+            continue;
+          }
+          buffer.resize(std::max<std::size_t>(buffer.size(), read->length));
+          auto n = pread(fd, buffer.data(), read->length, read->offset);
+          if (n > 0)
+            nBytes += n;
+        }
+      });
+    }
+    for (auto &t : threads)
+      t.join();
+    nBytes += ioPool.Finish();
+  }
+  auto ts_end = std::chrono::steady_clock::now();
+
+  close(fd);
+  *bytesRead = nBytes;
+  return std::chrono::duration_cast<std::chrono::microseconds>(ts_end -
+                                                               ts_start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  ReplayOptions opts;
+  if (!parse_options(argc, argv, &opts)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<TracedRead> reads;
+  if (!read_trace(opts.trace_path, &reads)) {
+    std::cerr << "Invalid trace: " << opts.trace_path << std::endl;
+    return 1;
+  }
+
+  print_statistics(reads);
+  if (opts.stats_only)
+    return 0;
+
+  std::uint64_t bytesRead;
+  auto runtime = replay(opts, reads, &bytesRead);
+  printf("\nreplay (%s): %lu bytes in %lu us (%.1f MB/s)\n",
+         opts.asap ? "asap" : "recorded timing", bytesRead, runtime,
+         runtime > 0 ? static_cast<double>(bytesRead) / runtime : 0.);
+
+  return 0;
+}
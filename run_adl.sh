@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/adl
+BENCHMARK_FORMATS="root orc parquet"
+N_RUNS=5
+QUERIES=${QUERIES:-"q1 q2 q3 q4 q5 q6 q7 q8"}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  INPUT_BASE=$1
+
+  echo "***** adl *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    for query in $QUERIES; do
+      RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_${fmt}_$query.csv
+      echo -ne "running $INPUT_BASE $query for $fmt..."
+      echo "init,analysis,main" > $RESULTS_FILE
+      for i in $(seq 1 $N_RUNS); do
+        ./clear_page_cache
+        ./adl $query $INPUT_FILE >> $RESULTS_FILE
+      done
+      echo -e " \tdone!"
+    done
+  done
+}
+
+run ttjet_signed
+run ttjet_signed_ntplcfg
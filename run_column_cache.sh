@@ -0,0 +1,68 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/column_cache
+CACHE_DIR=${CACHE_DIR:-/data/ssdext4/fdegeus/column_cache}
+BENCHMARK_FORMATS="root orc parquet"
+N_RUNS=5
+
+mkdir -p $RESULTS_DIR
+
+# Runs the benchmark once and appends "mode,hit_rate,init,analysis,main" to
+# the results file
+function run_once() {
+  MODE=$1
+  shift
+
+  ./clear_page_cache
+  timings=$("$@" 2> $RESULTS_DIR/stderr.log)
+  hit_rate=$(sed -n 's|^column cache: \([0-9]*\)/\([0-9]*\) .*|\1 \2|p' \
+    $RESULTS_DIR/stderr.log | awk '{ if ($2 > 0) print $1 / $2; else print 0 }')
+  echo "$MODE,${hit_rate:-0},$timings" | tr -d ' ' >> $RESULTS_FILE
+}
+
+function run() {
+  PROG=$1
+  INPUT_BASE=$2
+
+  echo "***** $PROG *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_$fmt.csv
+    echo -ne "running $INPUT_BASE column cache benchmarks for $fmt..."
+    echo "mode,hit_rate,init,analysis,main" > $RESULTS_FILE
+
+    for i in $(seq 1 $N_RUNS); do
+      run_once decode ./$PROG $INPUT_FILE
+    done
+
+    rm -rf $CACHE_DIR
+    run_once fill ./$PROG --column-cache $CACHE_DIR $INPUT_FILE
+    for i in $(seq 1 $N_RUNS); do
+      run_once cached ./$PROG --column-cache $CACHE_DIR $INPUT_FILE
+    done
+    echo -e " \tdone!"
+
+    # Speedup of the cached runs over decoding the source format
+    awk -F, 'NR > 1 { sum[$1] += $5; n[$1]++; hits[$1] += $2 }
+      END {
+        printf "  hit rate %.2f, speedup %.2fx\n",
+          hits["cached"] / n["cached"],
+          (sum["decode"] / n["decode"]) / (sum["cached"] / n["cached"])
+      }' $RESULTS_FILE
+  done
+}
+
+run lhcb B2HHH
+run lhcb B2HHH_ntplcfg
+
+run cms ttjet_signed
+run cms ttjet_signed_ntplcfg
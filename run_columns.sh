@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/columns
+BENCHMARK_FORMATS="root orc parquet"
+N_RUNS=3
+# Random subsets are drawn with the same seeds for every format
+SEEDS=${SEEDS:-"1 2 3"}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  NTUPLE_NAME=$1
+  INPUT_BASE=$2
+  COLUMN_COUNTS=$3
+
+  COLUMNS_FILE=$DATA_DIR/${INPUT_BASE}_columns.txt
+  if [ ! -f "$COLUMNS_FILE" ]; then
+    python print_column_names.py $NTUPLE_NAME $DATA_DIR/$INPUT_BASE.root -o $COLUMNS_FILE
+  fi
+
+  echo "***** columns *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_$fmt.csv
+    echo -ne "running $INPUT_BASE column scans for $fmt..."
+    echo "columns,seed,entries,values,init,analysis,main" > $RESULTS_FILE
+    for k in $COLUMN_COUNTS; do
+      # The first k columns, then random subsets of k columns
+      for seed in fixed $SEEDS; do
+        selection=$k
+        if [ "$seed" != "fixed" ]; then
+          selection=$k:$seed
+        fi
+        for i in $(seq 1 $N_RUNS); do
+          ./clear_page_cache
+          timings=$(./columns $NTUPLE_NAME $selection $INPUT_FILE \
+            2> $RESULTS_DIR/stderr.log)
+          stats=$(sed -n 's|^columns: [0-9]*, \([0-9]*\) entries, \([0-9]*\) values|\1,\2|p' \
+            $RESULTS_DIR/stderr.log)
+          echo "$k,$seed,$stats,$timings" | tr -d ' ' >> $RESULTS_FILE
+        done
+      done
+    done
+    echo -e " \tdone!"
+  done
+}
+
+run DecayTree B2HHH "1 2 4 8 16 26"
+run Events ttjet_signed "1 2 4 8 16 32 64 128 256 512 0"
@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/decode
+N_RUNS=3
+CODECS=${CODECS:-"none zstd lz4 zlib"}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  NTUPLE_NAME=$1
+  INPUT_BASE=$2
+
+  INPUT_FILE=$DATA_DIR/${INPUT_BASE}_ntplcfg.parquet
+  if [ ! -f "$INPUT_FILE" ]; then
+    echo "$INPUT_FILE does not exist, skipping"
+    return
+  fi
+
+  for fmt in root parquet orc; do
+    # Parquet is also written with every column dictionary encoded, to cover
+    # the dictionary decoding path
+    ENCODINGS=plain
+    if [ $fmt = parquet ]; then
+      ENCODINGS="plain dictionary"
+    fi
+
+    for codec in $CODECS; do
+      for encoding in $ENCODINGS; do
+        WRITE_OPTS=""
+        if [ $encoding = dictionary ]; then
+          WRITE_OPTS="-d all"
+        fi
+
+        # Every codec is written with the write benchmark, using the settings
+        # of convert.py -m
+        DECODE_FILE=$RESULTS_DIR/${INPUT_BASE}_${codec}_$encoding.$fmt
+        ./write -n $NTUPLE_NAME -c $codec $WRITE_OPTS $INPUT_FILE $DECODE_FILE > /dev/null 2>&1
+
+        RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_${fmt}_${codec}_$encoding.csv
+        echo -ne "running $INPUT_BASE decode benchmarks for $fmt ($codec, $encoding)..."
+        echo "column,encoding,codec,compressed_bytes,uncompressed_bytes,read,decompress,decode,read_gbps,decompress_gbps,decode_gbps" > $RESULTS_FILE
+        for i in $(seq 1 $N_RUNS); do
+          ./clear_page_cache
+          ./decode -n $NTUPLE_NAME $DECODE_FILE | tr -d ' ' >> $RESULTS_FILE
+        done
+        rm -f $DECODE_FILE
+        echo -e " \tdone!"
+      done
+    done
+  done
+}
+
+run DecayTree B2HHH
+run Events ttjet_signed
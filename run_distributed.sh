@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/distributed
+BENCHMARK_FORMATS="root orc parquet"
+N_RUNS=3
+# Local worker processes standing in for nodes
+N_WORKERS=${N_WORKERS:-"1 2 4 8"}
+# Threads per worker
+N_THREADS=${N_THREADS:-1}
+# Balance the work plan by bytes on storage, or by entries with "-e"
+PARTITION_FLAGS=${PARTITION_FLAGS:-""}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  PROG=$1
+  NTUPLE_NAME=$2
+  INPUT_BASE=$3
+
+  echo "***** $PROG *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_$fmt.csv
+    PARTIAL_DIR=$RESULTS_DIR/partials
+    echo -ne "running $INPUT_BASE distributed benchmarks for $fmt..."
+    echo "workers,threads,wall,init,analysis,analysis_sum,imbalance" > $RESULTS_FILE
+    for n in $N_WORKERS; do
+      ./partition $PARTITION_FLAGS -n $NTUPLE_NAME $n $INPUT_FILE \
+        > $RESULTS_DIR/plan.csv 2> $RESULTS_DIR/stderr.log
+      for i in $(seq 1 $N_RUNS); do
+        ./clear_page_cache
+        rm -rf $PARTIAL_DIR
+        mkdir -p $PARTIAL_DIR
+
+        start=$(date +%s%N)
+        pids=""
+        while IFS=, read -r worker first last entries bytes; do
+          # More workers than units
+          if [ $first -eq $last ]; then
+            continue
+          fi
+          ./$PROG -t $N_THREADS --unit-range $((first)):$((last)) --partial \
+            $INPUT_FILE $PARTIAL_DIR/$((worker)).root \
+            > $PARTIAL_DIR/$((worker)).csv 2> $PARTIAL_DIR/$((worker)).log &
+          pids="$pids $!"
+        done < <(tr -d ' ' < $RESULTS_DIR/plan.csv)
+        for pid in $pids; do
+          wait $pid
+        done
+        end=$(date +%s%N)
+
+        timings=$(./merge $RESULTS_DIR/${INPUT_BASE}_$fmt.png \
+          $PARTIAL_DIR/*.root 2> $RESULTS_DIR/stderr.log)
+        imbalance=$(sed -n 's|^merge: .* imbalance \([0-9.e+-]*\)$|\1|p' \
+          $RESULTS_DIR/stderr.log)
+        echo "$n,$N_THREADS,$(((end - start) / 1000)),$timings,$imbalance" | tr -d ' ' >> $RESULTS_FILE
+      done
+    done
+    rm -rf $PARTIAL_DIR
+    echo -e " \tdone!"
+  done
+}
+
+run lhcb DecayTree B2HHH
+run lhcb DecayTree B2HHH_ntplcfg
+run cms Events ttjet_signed
+run cms Events ttjet_signed_ntplcfg
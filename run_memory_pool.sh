@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/memory_pool
+# The memory pool only applies to the Arrow-based readers
+BENCHMARK_FORMATS="orc parquet"
+N_RUNS=3
+MEMORY_POOLS=${MEMORY_POOLS:-"default system jemalloc mimalloc arena arena-huge"}
+N_THREADS=${N_THREADS:-1}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  PROG=$1
+  INPUT_BASE=$2
+
+  echo "***** $PROG *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_$fmt.csv
+    echo -ne "running $INPUT_BASE memory pool benchmarks for $fmt..."
+    echo "memory_pool,threads,units,page_faults,allocator_time,init,analysis,main" > $RESULTS_FILE
+    for pool in $MEMORY_POOLS; do
+      for i in $(seq 1 $N_RUNS); do
+        ./clear_page_cache
+        # Pools that Arrow was built without are skipped
+        if ! timings=$(./$PROG --memory-pool $pool -t $N_THREADS $INPUT_FILE \
+          2> $RESULTS_DIR/stderr.log); then
+          break
+        fi
+        stats=$(sed -n 's|^memory pool: [^,]*, \([0-9]*\) units, \([0-9]*\) page faults per unit, \([0-9]*\) us allocating per unit|\1,\2,\3|p' \
+          $RESULTS_DIR/stderr.log)
+        echo "$pool,$N_THREADS,$stats,$timings" | tr -d ' ' >> $RESULTS_FILE
+      done
+    done
+    echo -e " \tdone!"
+  done
+}
+
+run lhcb B2HHH
+run lhcb B2HHH_ntplcfg
+run cms ttjet_signed
+run cms ttjet_signed_ntplcfg
@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/metadata_cache
+CACHE_DIR=${CACHE_DIR:-/data/ssdext4/fdegeus/metadata_cache}
+BENCHMARK_FORMATS="root orc parquet"
+N_RUNS=5
+
+mkdir -p $RESULTS_DIR
+
+# Runs the benchmark once and appends "mode,init,analysis,main" to the results
+# file
+function run_once() {
+  MODE=$1
+  shift
+
+  ./clear_page_cache
+  timings=$("$@" 2> $RESULTS_DIR/stderr.log)
+  echo "$MODE,$timings" | tr -d ' ' >> $RESULTS_FILE
+}
+
+function run() {
+  PROG=$1
+  INPUT_BASE=$2
+
+  echo "***** $PROG *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_$fmt.csv
+    echo -ne "running $INPUT_BASE metadata cache benchmarks for $fmt..."
+    echo "mode,init,analysis,main" > $RESULTS_FILE
+
+    for i in $(seq 1 $N_RUNS); do
+      run_once nocache ./$PROG $INPUT_FILE
+    done
+
+    rm -rf $CACHE_DIR
+    run_once fill ./$PROG --metadata-cache $CACHE_DIR $INPUT_FILE
+    for i in $(seq 1 $N_RUNS); do
+      run_once cached ./$PROG --metadata-cache $CACHE_DIR $INPUT_FILE
+    done
+    echo -e " \tdone!"
+
+    # Mean init time with and without the cache
+    awk -F, 'NR > 1 { sum[$1] += $2; n[$1]++ }
+      END {
+        printf "  init %.0f us uncached, %.0f us cached (%.2fx)\n",
+          sum["nocache"] / n["nocache"], sum["cached"] / n["cached"],
+          (sum["nocache"] / n["nocache"]) / (sum["cached"] / n["cached"])
+      }' $RESULTS_FILE
+  done
+}
+
+run lhcb B2HHH
+run lhcb B2HHH_ntplcfg
+
+run cms ttjet_signed
+run cms ttjet_signed_ntplcfg
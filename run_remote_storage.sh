@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/remote_storage
+BENCHMARK_FORMATS="root orc parquet"
+N_RUNS=3
+# Per-read latencies (ms) of the emulated storage
+LATENCIES=${LATENCIES:-"0 1 5 10 20"}
+BANDWIDTH=${BANDWIDTH:-1000}
+MAX_REQUESTS=${MAX_REQUESTS:-0}
+IO=${IO:-sync}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  PROG=$1
+  INPUT_BASE=$2
+
+  echo "***** $PROG ($BANDWIDTH MB/s, $IO I/O) *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_${fmt}_${IO}.csv
+    echo -ne "running $INPUT_BASE remote storage benchmarks for $fmt..."
+    echo "latency,requests,bytes,init,analysis,main" > $RESULTS_FILE
+    for latency in $LATENCIES; do
+      for i in $(seq 1 $N_RUNS); do
+        ./clear_page_cache
+        timings=$(./$PROG --latency $latency --bandwidth $BANDWIDTH \
+          --max-requests $MAX_REQUESTS --io $IO $INPUT_FILE \
+          2> $RESULTS_DIR/stderr.log)
+        requests=$(sed -n 's|^storage: \([0-9]*\) requests, \([0-9]*\) bytes|\1,\2|p' \
+          $RESULTS_DIR/stderr.log)
+        echo "$latency,$requests,$timings" | tr -d ' ' >> $RESULTS_FILE
+      done
+    done
+    echo -e " \tdone!"
+  done
+}
+
+run lhcb B2HHH
+run lhcb B2HHH_ntplcfg
+
+run cms ttjet_signed
+run cms ttjet_signed_ntplcfg
@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/scaling
+BENCHMARK_FORMATS="root orc parquet"
+N_RUNS=3
+AFFINITY=${AFFINITY:-compact}
+MAX_THREADS=${MAX_THREADS:-$(nproc)}
+
+mkdir -p $RESULTS_DIR
+
+# Powers of two up to MAX_THREADS, always including MAX_THREADS itself
+function thread_counts() {
+  t=1
+  while [ $t -lt $MAX_THREADS ]; do
+    echo $t
+    t=$((t * 2))
+  done
+  echo $MAX_THREADS
+}
+
+function run() {
+  PROG=$1
+  INPUT_BASE=$2
+  MODE=$3
+
+  MODE_FLAGS=""
+  if [ "$MODE" = "weak" ]; then
+    MODE_FLAGS="--weak-scaling"
+  fi
+
+  echo "***** $PROG ($MODE scaling, $AFFINITY affinity) *****"
+  for fmt in $BENCHMARK_FORMATS; do
+    INPUT_FILE=$DATA_DIR/$INPUT_BASE.$fmt
+
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_${fmt}_${MODE}_${AFFINITY}.csv
+    echo -ne "running $INPUT_BASE $MODE scaling benchmarks for $fmt..."
+    echo "threads,init,analysis,main" > $RESULTS_FILE
+    for n in $(thread_counts); do
+      cmd="./$PROG -t $n -a $AFFINITY $MODE_FLAGS $INPUT_FILE"
+      for i in $(seq 1 $N_RUNS); do
+        ./clear_page_cache
+        echo -n "$n, " >> $RESULTS_FILE
+        $cmd >> $RESULTS_FILE
+      done
+    done
+    echo -e " \tdone!"
+  done
+}
+
+for mode in strong weak; do
+  run lhcb B2HHH $mode
+  run lhcb B2HHH_ntplcfg $mode
+
+  run cms ttjet_signed $mode
+  run cms ttjet_signed_ntplcfg $mode
+done
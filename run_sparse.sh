@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/sparse
+N_RUNS=3
+# Fractions of the entries in the entry list, from 0.001% to 10%
+DENSITIES=${DENSITIES:-"0.00001 0.0001 0.001 0.01 0.1"}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  PROG=$1
+  INPUT_BASE=$2
+
+  echo "***** $PROG *****"
+  # Parquet is read from the file with the page index
+  for INPUT_FILE in $DATA_DIR/$INPUT_BASE.root $DATA_DIR/$INPUT_BASE.orc \
+    $DATA_DIR/${INPUT_BASE}_pageidx.parquet; do
+    if [ ! -f "$INPUT_FILE" ]; then
+      echo "$INPUT_FILE does not exist, skipping"
+      continue
+    fi
+
+    fmt=${INPUT_FILE##*.}
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_$fmt.csv
+    echo -ne "running $INPUT_BASE sparse read benchmarks for $fmt..."
+    echo "density,entries,units,mean_latency,median_latency,p99_latency,bytes_per_entry,init,analysis,main" > $RESULTS_FILE
+    for density in $DENSITIES; do
+      ENTRY_LIST=$RESULTS_DIR/${INPUT_BASE}_$density.txt
+      # The same entries for every format
+      if [ ! -f "$ENTRY_LIST" ]; then
+        python make_entry_list.py $DATA_DIR/$INPUT_BASE.orc $density $ENTRY_LIST
+      fi
+      for i in $(seq 1 $N_RUNS); do
+        ./clear_page_cache
+        timings=$(./$PROG --entry-list $ENTRY_LIST $INPUT_FILE \
+          2> $RESULTS_DIR/stderr.log)
+        stats=$(sed -n 's|^entries: \([0-9]*\) in \([0-9]*\) units, latency: mean \([0-9]*\) us, median \([0-9]*\) us, p99 \([0-9]*\) us, \([0-9]*\) bytes per entry|\1,\2,\3,\4,\5,\6|p' \
+          $RESULTS_DIR/stderr.log)
+        echo "$density,$stats,$timings" | tr -d ' ' >> $RESULTS_FILE
+      done
+    done
+    echo -e " \tdone!"
+  done
+}
+
+run lhcb B2HHH
+run cms ttjet_signed
@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+
+set -e
+
+DATA_DIR=/data/ssdext4/fdegeus/escience25
+RESULTS_DIR=./results/write
+N_RUNS=3
+CODECS=${CODECS:-"none zstd lz4 zlib"}
+LEVELS=${LEVELS:-"1 3 5"}
+# Entries per cluster, row group or stripe, 0 mirrors the input
+UNIT_SIZES=${UNIT_SIZES:-"0 10000 100000 1000000"}
+N_THREADS=${N_THREADS:-1}
+
+mkdir -p $RESULTS_DIR
+
+function run() {
+  NTUPLE_NAME=$1
+  INPUT_BASE=$2
+
+  # The input is read into memory before writing, so its format does not
+  # affect the results
+  INPUT_FILE=$DATA_DIR/${INPUT_BASE}_ntplcfg.parquet
+  if [ ! -f "$INPUT_FILE" ]; then
+    echo "$INPUT_FILE does not exist, skipping"
+    return
+  fi
+
+  for fmt in root parquet orc; do
+    RESULTS_FILE=$RESULTS_DIR/${INPUT_BASE}_$fmt.csv
+    OUTPUT_FILE=$RESULTS_DIR/$INPUT_BASE.$fmt
+    echo -ne "running $INPUT_BASE write benchmarks for $fmt..."
+    echo "codec,level,unit_size,threads,write,cpu,peak_memory,file_size,throughput" > $RESULTS_FILE
+    for codec in $CODECS; do
+      levels=$LEVELS
+      # ORC has no compression levels
+      if [ "$codec" == "none" ] || [ "$fmt" == "orc" ]; then
+        levels=-1
+      fi
+      for level in $levels; do
+        for unit_size in $UNIT_SIZES; do
+          for i in $(seq 1 $N_RUNS); do
+            rm -f $OUTPUT_FILE
+            results=$(./write -n $NTUPLE_NAME -c $codec -l $level -u $unit_size \
+              -t $N_THREADS $INPUT_FILE $OUTPUT_FILE 2> $RESULTS_DIR/stderr.log)
+            echo "$codec,$level,$unit_size,$N_THREADS,$results" | tr -d ' ' >> $RESULTS_FILE
+          done
+        done
+      done
+    done
+    rm -f $OUTPUT_FILE
+    echo -e " \tdone!"
+  done
+}
+
+run DecayTree B2HHH
+run Events ttjet_signed
@@ -0,0 +1,241 @@
+#include "selection_cache.hxx"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'H', 'E', 'P', 'S', 'E', 'L', '0', '1'};
+
+// How the passing entries of a unit are stored in the cache file
+enum Encoding : std::uint8_t {
+  kBitmap = 0,     // one bit per entry of the unit
+  kDeltaVarint = 1 // distances between passing entries, LEB128-encoded
+};
+
+std::uint64_t fnv1a(const std::string &s,
+                    std::uint64_t hash = 0xcbf29ce484222325ULL) {
+  for (unsigned char c : s) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+template <typename T> void write_pod(std::ostream &os, const T &val) {
+  os.write(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+template <typename T> bool read_pod(std::istream &is, T *val) {
+  return static_cast<bool>(is.read(reinterpret_cast<char *>(val), sizeof(*val)));
+}
+
+void write_string(std::ostream &os, const std::string &s) {
+  write_pod<std::uint64_t>(os, s.size());
+  os.write(s.data(), s.size());
+}
+
+bool read_string(std::istream &is, std::string *s) {
+  std::uint64_t size;
+  if (!read_pod(is, &size) || size > (1 << 20))
+    return false;
+  s->resize(size);
+  return static_cast<bool>(is.read(s->data(), size));
+}
+
+std::vector<std::uint8_t> encode_bitmap(std::uint64_t nEntries,
+                                        const Selection_t &passing) {
+  std::vector<std::uint8_t> bytes((nEntries + 7) / 8);
+  for (auto entry : passing)
+    bytes[entry / 8] |= (1 << (entry % 8));
+  return bytes;
+}
+
+std::vector<std::uint8_t> encode_delta_varint(const Selection_t &passing) {
+  std::vector<std::uint8_t> bytes;
+  std::uint32_t prev = 0;
+  for (auto entry : passing) {
+    std::uint32_t delta = entry - prev;
+    prev = entry;
+    do {
+      std::uint8_t b = delta & 0x7f;
+      delta >>= 7;
+      bytes.push_back(delta ? (b | 0x80) : b);
+    } while (delta);
+  }
+  return bytes;
+}
+
+bool decode(Encoding encoding, std::uint64_t nEntries,
+            const std::vector<std::uint8_t> &bytes, Selection_t *passing) {
+  switch (encoding) {
+  case kBitmap:
+    if (bytes.size() != (nEntries + 7) / 8)
+      return false;
+    for (std::uint64_t entry = 0; entry < nEntries; ++entry) {
+      if (bytes[entry / 8] & (1 << (entry % 8)))
+        passing->push_back(entry);
+    }
+    return true;
+  case kDeltaVarint: {
+    std::uint32_t entry = 0;
+    std::uint32_t delta = 0;
+    unsigned shift = 0;
+    for (auto b : bytes) {
+      delta |= static_cast<std::uint32_t>(b & 0x7f) << shift;
+      shift += 7;
+      if (b & 0x80)
+        continue;
+      entry += delta;
+      if (entry >= nEntries)
+        return false;
+      passing->push_back(entry);
+      delta = 0;
+      shift = 0;
+    }
+    return shift == 0;
+  }
+  }
+  return false;
+}
+
+} // anonymous namespace
+
+SelectionCache::SelectionCache(const std::string &cacheDir,
+                               const std::string &inputPath,
+                               const std::string &cut)
+    : fCut(cut) {
+  std::error_code ec;
+  auto canonicalPath = std::filesystem::canonical(inputPath, ec);
+  fInputPath = ec ? inputPath : canonicalPath.string();
+  fFileSize = std::filesystem::file_size(fInputPath);
+  fFileMtime = std::filesystem::last_write_time(fInputPath)
+                   .time_since_epoch()
+                   .count();
+
+  // One cache file per input file and cut, a changed input file replaces the
+  // previous cache file
+  std::ostringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0')
+       << fnv1a(fCut, fnv1a(fInputPath)) << ".sel";
+  fCachePath = (std::filesystem::path(cacheDir) / name.str()).string();
+
+  if (!Load())
+    fLoaded.clear();
+}
+
+bool SelectionCache::Load() {
+  std::ifstream is(fCachePath, std::ios::binary);
+  if (!is)
+    return false;
+
+  char magic[sizeof(kMagic)];
+  if (!is.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+    return false;
+
+  std::string inputPath, cut;
+  std::uint64_t fileSize;
+  std::int64_t fileMtime;
+  if (!read_string(is, &inputPath) || !read_pod(is, &fileSize) ||
+      !read_pod(is, &fileMtime) || !read_string(is, &cut))
+    return false;
+  if (inputPath != fInputPath || fileSize != fFileSize ||
+      fileMtime != fFileMtime || cut != fCut)
+    return false;
+
+  std::uint64_t nUnits;
+  if (!read_pod(is, &nUnits))
+    return false;
+  for (std::uint64_t i = 0; i < nUnits; ++i) {
+    std::int64_t unit;
+    Entry entry;
+    std::uint8_t encoding;
+    std::uint64_t nBytes;
+    if (!read_pod(is, &unit) || !read_pod(is, &entry.nEntries) ||
+        !read_pod(is, &encoding) || !read_pod(is, &nBytes) ||
+        nBytes > entry.nEntries + 8)
+      return false;
+    std::vector<std::uint8_t> bytes(nBytes);
+    if (!is.read(reinterpret_cast<char *>(bytes.data()), nBytes))
+      return false;
+    if (!decode(static_cast<Encoding>(encoding), entry.nEntries, bytes,
+                &entry.passing))
+      return false;
+    fLoaded[unit] = std::move(entry);
+  }
+
+  return true;
+}
+
+const Selection_t *SelectionCache::Find(std::int64_t unit) const {
+  auto itr = fLoaded.find(unit);
+  if (itr == fLoaded.end())
+    return nullptr;
+  return &itr->second.passing;
+}
+
+void SelectionCache::Record(std::int64_t unit, std::uint64_t nEntries,
+                            Selection_t passing) {
+  std::lock_guard<std::mutex> guard(fLock);
+  auto &entry = fRecorded[unit];
+  entry.nEntries = nEntries;
+  entry.passing = std::move(passing);
+}
+
+void SelectionCache::Save() {
+  std::lock_guard<std::mutex> guard(fLock);
+  if (fRecorded.empty())
+    return;
+
+  fLoaded.merge(fRecorded);
+  fRecorded.clear();
+
+  std::filesystem::create_directories(
+      std::filesystem::path(fCachePath).parent_path());
+
+  // Write to a temporary file first, so that concurrent runs never see a
+  // partially written cache file
+  std::ostringstream tmpPath;
+  tmpPath << fCachePath << ".tmp." << getpid() << "."
+          << std::hash<std::thread::id>()(std::this_thread::get_id());
+  {
+    std::ofstream os(tmpPath.str(), std::ios::binary | std::ios::trunc);
+    os.write(kMagic, sizeof(kMagic));
+    write_string(os, fInputPath);
+    write_pod(os, fFileSize);
+    write_pod(os, fFileMtime);
+    write_string(os, fCut);
+
+    write_pod<std::uint64_t>(os, fLoaded.size());
+    for (const auto &[unit, entry] : fLoaded) {
+      auto bytes = encode_delta_varint(entry.passing);
+      Encoding encoding = kDeltaVarint;
+      if (bytes.size() > (entry.nEntries + 7) / 8) {
+        bytes = encode_bitmap(entry.nEntries, entry.passing);
+        encoding = kBitmap;
+      }
+
+      write_pod(os, unit);
+      write_pod(os, entry.nEntries);
+      write_pod<std::uint8_t>(os, encoding);
+      write_pod<std::uint64_t>(os, bytes.size());
+      os.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    if (!os) {
+      std::remove(tmpPath.str().c_str());
+      throw std::runtime_error("could not write selection cache " + fCachePath);
+    }
+  }
+  std::filesystem::rename(tmpPath.str(), fCachePath);
+}
@@ -0,0 +1,52 @@
+#ifndef SELECTION_CACHE__HXX
+#define SELECTION_CACHE__HXX
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Entries of one unit (cluster, row group or stripe) that pass the event
+// selection, as offsets from the first entry of the unit
+using Selection_t = std::vector<std::uint32_t>;
+
+// Sidecar cache of per-unit selection results.
+//
+// The cache file for an input file and cut lives in the cache directory and
+// records the size and modification time of the input. If either of them or
+// the cut definition differ, the cached selection is discarded. Lookups are
+// lock-free, results of the current run can be recorded concurrently and are
+// written out by Save().
+class SelectionCache {
+public:
+  SelectionCache(const std::string &cacheDir, const std::string &inputPath,
+                 const std::string &cut);
+
+  // Returns nullptr if the selection for the unit is not cached
+  const Selection_t *Find(std::int64_t unit) const;
+  void Record(std::int64_t unit, std::uint64_t nEntries, Selection_t passing);
+  void Save();
+
+private:
+  struct Entry {
+    std::uint64_t nEntries = 0;
+    Selection_t passing;
+  };
+
+  bool Load();
+
+  std::string fCachePath;
+  std::string fInputPath;
+  std::string fCut;
+  std::uint64_t fFileSize = 0;
+  std::int64_t fFileMtime = 0;
+
+  // Read from the cache file, immutable afterwards
+  std::map<std::int64_t, Entry> fLoaded;
+
+  std::mutex fLock;
+  std::map<std::int64_t, Entry> fRecorded;
+};
+
+#endif // SELECTION_CACHE__HXX
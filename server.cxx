@@ -0,0 +1,282 @@
+#include "server.hxx"
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metadata_cache.hxx"
+
+namespace {
+
+// Requests are a single line of command line arguments
+constexpr std::size_t kMaxRequestSize = 64 * 1024;
+
+volatile std::sig_atomic_t gStopRequested = 0;
+
+void handle_signal(int) { gStopRequested = 1; }
+
+bool write_all(int fd, const std::string &data) {
+  std::size_t written = 0;
+  while (written < data.size()) {
+    auto n = send(fd, data.data() + written, data.size() - written,
+                  MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+bool read_line(int fd, std::string *line) {
+  char buf[4096];
+  while (line->find('\n') == std::string::npos) {
+    auto n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return false;
+    if (n == 0)
+      break;
+    line->append(buf, n);
+    if (line->size() > kMaxRequestSize)
+      return false;
+  }
+  line->resize(std::min(line->find('\n'), line->size()));
+  return true;
+}
+
+} // anonymous namespace
+
+AnalysisServer::AnalysisServer(const AnalysisOptions &defaults,
+                               BenchmarkFn_t benchmark,
+                               const TH1D &histTemplate)
+    : fSocketPath(defaults.server_socket), fDefaults(defaults),
+      fBenchmark(std::move(benchmark)),
+      fHistTemplate(std::make_unique<TH1D>(histTemplate)) {
+  fHistTemplate->SetDirectory(nullptr);
+  fHistTemplate->Reset();
+
+  // The input and histogram are given per request
+  fDefaults.input_path.clear();
+  fDefaults.histo_path.clear();
+  fDefaults.server_socket.clear();
+}
+
+int AnalysisServer::Run() {
+  const auto &socketPath = fSocketPath;
+  ROOT::EnableThreadSafety();
+  TH1::AddDirectory(false);
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << socketPath << std::endl;
+    return 1;
+  }
+  std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socketPath.c_str());
+  if (listenFd < 0 ||
+      bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listenFd, SOMAXCONN) != 0) {
+    std::cerr << "Could not listen on " << socketPath << ": "
+              << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  // The workers (and their analysis threads) block the termination signals,
+  // so that these interrupt accept() in this thread
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  auto nWorkers = fDefaults.server_jobs;
+  if (nWorkers == 0)
+    nWorkers = std::thread::hardware_concurrency();
+  fThreads = std::make_unique<ThreadPool>(
+      std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < nWorkers; ++i)
+    workers.emplace_back(&AnalysisServer::Work, this);
+
+  struct sigaction action = {};
+  action.sa_handler = handle_signal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+
+  std::cerr << "serving requests on " << socketPath << " with " << nWorkers
+            << " workers" << std::endl;
+
+  while (!gStopRequested) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    {
+      std::lock_guard<std::mutex> guard(fQueueLock);
+      fQueue.push_back(fd);
+    }
+    fQueueCond.notify_one();
+  }
+
+  // Requests already accepted are still served
+  {
+    std::lock_guard<std::mutex> guard(fQueueLock);
+    fStopping = true;
+  }
+  fQueueCond.notify_all();
+  for (auto &t : workers)
+    t.join();
+
+  close(listenFd);
+  unlink(socketPath.c_str());
+  return 0;
+}
+
+void AnalysisServer::Work() {
+  while (true) {
+    int fd;
+    {
+      std::unique_lock<std::mutex> lock(fQueueLock);
+      fQueueCond.wait(lock, [this]() { return fStopping || !fQueue.empty(); });
+      if (fQueue.empty())
+        return;
+      fd = fQueue.front();
+      fQueue.pop_front();
+    }
+    Serve(fd);
+  }
+}
+
+void AnalysisServer::Serve(int fd) {
+  std::string request;
+  std::string response;
+  if (!read_line(fd, &request)) {
+    response = "ERROR could not read request\n";
+  } else {
+    try {
+      response = Handle(request);
+    } catch (const std::exception &e) {
+      response = std::string("ERROR ") + e.what() + "\n";
+    }
+  }
+  write_all(fd, response);
+  close(fd);
+}
+
+std::string AnalysisServer::Handle(const std::string &request) {
+  auto ts_init = std::chrono::steady_clock::now();
+
+  std::vector<std::string> args = {"request"};
+  std::istringstream is(request);
+  for (std::string arg; is >> arg;)
+    args.push_back(arg);
+  std::vector<char *> argv;
+  for (auto &arg : args)
+    argv.push_back(arg.data());
+  argv.push_back(nullptr);
+
+  AnalysisOptions opts = fDefaults;
+  bool valid;
+  {
+    // getopt keeps its state in globals
+    static std::mutex parseLock;
+    std::lock_guard<std::mutex> guard(parseLock);
+    optind = 0;
+    valid = parse_options(args.size(), argv.data(), &opts);
+  }
+  if (!valid || opts.input_path.empty() || !opts.server_socket.empty())
+    return "ERROR invalid request: " + request + "\n";
+
+  auto hist = std::make_unique<TH1D>(*fHistTemplate);
+  hist->SetDirectory(nullptr);
+
+  auto metadataCache = GetMetadataCache(opts);
+  ResidentState resident;
+  resident.metadata = metadataCache.get();
+  resident.readers = &fReaders;
+  resident.threads = fThreads.get();
+  auto runtime_analysis = fBenchmark(opts, resident, hist.get());
+  if (metadataCache && !metadataCache->IsLoaded())
+    SaveMetadataCache(opts, metadataCache);
+
+  if (!opts.histo_path.empty()) {
+    static std::mutex saveLock;
+    std::lock_guard<std::mutex> guard(saveLock);
+    if (opts.partial) {
+      save_partial_histogram(hist.get(), opts.histo_path, opts.unit_range,
+                             runtime_analysis);
+    } else {
+      save_histogram(hist.get(), opts.histo_path);
+    }
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_main =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_init)
+          .count();
+
+  std::ostringstream os;
+  os.precision(std::numeric_limits<double>::max_digits10);
+  os << "OK " << runtime_analysis.first << ", " << runtime_analysis.second
+     << ", " << runtime_main << "\n";
+  auto nBins = hist->GetNbinsX();
+  os << nBins << " " << hist->GetXaxis()->GetXmin() << " "
+     << hist->GetXaxis()->GetXmax() << "\n";
+  for (int i = 0; i <= nBins + 1; ++i)
+    os << (i > 0 ? " " : "") << hist->GetBinContent(i);
+  os << "\n";
+  return os.str();
+}
+
+std::shared_ptr<MetadataCache>
+AnalysisServer::GetMetadataCache(const AnalysisOptions &opts) {
+  if (opts.metadata_cache_dir.empty())
+    return nullptr;
+
+  std::lock_guard<std::mutex> guard(fMetadataLock);
+  auto &cache = fMetadataCaches[{opts.metadata_cache_dir, opts.input_path}];
+  if (!cache || cache->IsStale())
+    cache = std::make_shared<MetadataCache>(opts.metadata_cache_dir,
+                                            opts.input_path);
+  return cache;
+}
+
+void AnalysisServer::SaveMetadataCache(const AnalysisOptions &opts,
+                                       std::shared_ptr<MetadataCache> cache) {
+  cache->Save();
+
+  // Replace the cache that recorded the metadata by one that serves it.
+  // Requests still using the previous one, and the pooled readers opened
+  // through it, keep it alive.
+  auto loaded = std::make_shared<MetadataCache>(opts.metadata_cache_dir,
+                                                opts.input_path);
+  std::lock_guard<std::mutex> guard(fMetadataLock);
+  auto &resident = fMetadataCaches[{opts.metadata_cache_dir, opts.input_path}];
+  if (resident == cache)
+    resident = std::move(loaded);
+}
@@ -0,0 +1,81 @@
+#ifndef SERVER__HXX
+#define SERVER__HXX
+
+#include <TH1D.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "reader_pool.hxx"
+#include "util.hxx"
+
+class MetadataCache;
+
+// Runs the analysis of one input file into the given histogram
+using BenchmarkFn_t = std::function<AnalysisTime_t(
+    const AnalysisOptions &opts, const ResidentState &resident, TH1D *hist)>;
+
+// Long-running analysis process that serves requests on a Unix socket, so that
+// library loading and interpreter initialization are paid only once.
+//
+// A request is a single line with the command line arguments of the benchmark
+// (options, input path and optional histogram path), separated by whitespace.
+// Options not given in the request default to those the server was started
+// with. The response is either
+//
+//   OK <init>, <analysis>, <main>
+//   <number of bins> <low edge> <high edge>
+//   <bin contents, including underflow and overflow>
+//
+// or a single line "ERROR <message>". Here, main is the time from receiving
+// the request to sending the response.
+//
+// Requests are served concurrently by a fixed pool of workers. The metadata
+// caches (if enabled) and the readers of the input files stay resident between
+// requests, and the analysis threads of all requests (-t) are taken from one
+// pool of hardware_concurrency threads instead of being started per request.
+// A request that fails, e.g. because its input does not exist, is answered
+// with an error.
+class AnalysisServer {
+public:
+  AnalysisServer(const AnalysisOptions &defaults, BenchmarkFn_t benchmark,
+                 const TH1D &histTemplate);
+
+  // Serves requests until SIGINT or SIGTERM is received
+  int Run();
+
+private:
+  void Work();
+  void Serve(int fd);
+  std::string Handle(const std::string &request);
+  std::shared_ptr<MetadataCache> GetMetadataCache(const AnalysisOptions &opts);
+  void SaveMetadataCache(const AnalysisOptions &opts,
+                         std::shared_ptr<MetadataCache> cache);
+
+  std::string fSocketPath;
+  AnalysisOptions fDefaults;
+  BenchmarkFn_t fBenchmark;
+  std::unique_ptr<TH1D> fHistTemplate;
+
+  // Accepted connections waiting for a worker
+  std::mutex fQueueLock;
+  std::condition_variable fQueueCond;
+  std::deque<int> fQueue;
+  bool fStopping = false;
+
+  // Resident metadata caches, by cache directory and input path
+  std::mutex fMetadataLock;
+  std::map<std::pair<std::string, std::string>, std::shared_ptr<MetadataCache>>
+      fMetadataCaches;
+
+  ReaderPool fReaders;
+  std::unique_ptr<ThreadPool> fThreads;
+};
+
+#endif // SERVER__HXX
@@ -0,0 +1,454 @@
+#include "sparse_read.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleView.hxx>
+
+#include <arrow/adapters/orc/adapter.h>
+#include <arrow/buffer.h>
+#include <arrow/io/memory.h>
+#include <parquet/column_reader.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/level_conversion.h>
+#include <parquet/metadata.h>
+#include <parquet/page_index.h>
+
+#include "metadata_cache.hxx"
+#include "read_trace.hxx"
+
+namespace {
+
+// Bytes read by the calling thread through read system calls (rchar), whether
+// or not they were served from the page cache
+std::uint64_t get_thread_read_bytes() {
+  std::ifstream is("/proc/thread-self/io");
+  std::string key;
+  std::uint64_t value;
+  while (is >> key >> value) {
+    if (key == "rchar:")
+      return value;
+  }
+  return 0;
+}
+
+// Fetches the entries one by one and records their latencies. Units are given
+// by the first entry of every unit, followed by the total number of entries.
+void fetch_each(const std::vector<std::uint64_t> &entries,
+                const std::vector<std::uint64_t> &unitBoundaries,
+                const std::function<void(std::uint64_t entry)> &fetch,
+                FetchStats *stats) {
+  if (!entries.empty() && entries.back() >= unitBoundaries.back()) {
+    throw std::invalid_argument("entry " + std::to_string(entries.back()) +
+                                " is out of range");
+  }
+
+  auto nBytes = get_thread_read_bytes();
+  std::int64_t lastUnit = -1;
+  for (auto entry : entries) {
+    TraceContext entryContext("entry " + std::to_string(entry));
+    auto ts_start = std::chrono::steady_clock::now();
+    fetch(entry);
+    auto ts_end = std::chrono::steady_clock::now();
+    stats->latencies.push_back(
+        std::chrono::duration_cast<std::chrono::microseconds>(ts_end -
+                                                              ts_start)
+            .count());
+
+    std::int64_t unit = std::upper_bound(unitBoundaries.begin(),
+                                         unitBoundaries.end(), entry) -
+                        unitBoundaries.begin() - 1;
+    if (unit != lastUnit) {
+      ++stats->nUnits;
+      lastUnit = unit;
+    }
+  }
+  stats->nEntries += entries.size();
+  stats->nBytes += get_thread_read_bytes() - nBytes;
+}
+
+AnalysisTime_t get_runtimes(std::chrono::steady_clock::time_point ts_init,
+                            std::chrono::steady_clock::time_point ts_first) {
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_init =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_first - ts_init)
+          .count();
+  auto runtime_analyze =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_first)
+          .count();
+  return std::make_pair(runtime_init, runtime_analyze);
+}
+
+AnalysisTime_t fetch_rntuple(const AnalysisOptions &opts,
+                             std::string_view ntupleName,
+                             const std::vector<std::string> &columnNames,
+                             const std::vector<std::uint64_t> &entries,
+                             MetadataCache *metadataCache, FetchStats *stats) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  // The cluster cache reads (and prefetches) entire clusters; without it, the
+  // views load only the pages containing the requested entries
+  ROOT::RNTupleReadOptions readOptions;
+  readOptions.SetClusterCache(ROOT::RNTupleReadOptions::EClusterCache::kOff);
+  auto ntuple = open_rntuple(ntupleName, opts.input_path, opts, metadataCache,
+                             readOptions);
+  auto clusterBoundaries = get_cluster_boundaries(ntuple->GetDescriptor());
+
+  std::vector<ROOT::RNTupleView<void>> views;
+  for (const auto &name : columnNames)
+    views.emplace_back(ntuple->GetView<void>(name));
+
+  auto ts_first = std::chrono::steady_clock::now();
+
+  fetch_each(
+      entries, clusterBoundaries,
+      [&](std::uint64_t entry) {
+        for (auto &view : views)
+          view(entry);
+      },
+      stats);
+
+  return get_runtimes(ts_init, ts_first);
+}
+
+// Reads single rows of one column of a Parquet file, in increasing order.
+// With an offset index, only the data page containing the row (and the
+// dictionary page of the column chunk) is read and decoded. Otherwise, the
+// column chunk is decoded from the start of the row group.
+class ParquetRowReader {
+public:
+  ParquetRowReader(parquet::ParquetFileReader &reader,
+                   std::shared_ptr<arrow::io::RandomAccessFile> file,
+                   int column)
+      : fReader(reader), fFile(std::move(file)), fColumn(column),
+        fDescr(reader.metadata()->schema()->Column(column)) {}
+
+  void Read(int rowGroup, std::int64_t row,
+            std::shared_ptr<parquet::OffsetIndex> offsetIndex) {
+    int page = -1;
+    if (offsetIndex) {
+      const auto &locations = offsetIndex->page_locations();
+      page = std::upper_bound(locations.begin(), locations.end(), row,
+                              [](std::int64_t r,
+                                 const parquet::PageLocation &location) {
+                                return r < location.first_row_index;
+                              }) -
+             locations.begin() - 1;
+    }
+
+    if (!fRecordReader || rowGroup != fRowGroup || page != fPage ||
+        row < fNextRow) {
+      std::unique_ptr<parquet::PageReader> pageReader;
+      if (page < 0) {
+        pageReader = fReader.RowGroup(rowGroup)->GetColumnPageReader(fColumn);
+        fNextRow = 0;
+      } else {
+        pageReader = OpenPage(rowGroup, offsetIndex->page_locations(), page);
+        fNextRow = offsetIndex->page_locations()[page].first_row_index;
+      }
+      fRecordReader = parquet::internal::RecordReader::Make(
+          fDescr, parquet::internal::LevelInfo::ComputeLevelInfo(fDescr));
+      fRecordReader->SetPageReader(std::move(pageReader));
+      fRowGroup = rowGroup;
+      fPage = page;
+    }
+
+    fRecordReader->Reset();
+    if (fRecordReader->SkipRecords(row - fNextRow) != row - fNextRow ||
+        fRecordReader->ReadRecords(1) != 1) {
+      throw std::runtime_error("could not read row " + std::to_string(row) +
+                               " of row group " + std::to_string(rowGroup));
+    }
+    fNextRow = row + 1;
+  }
+
+private:
+  // Returns a page reader over the dictionary page (if any) and the given data
+  // page of the column chunk
+  std::unique_ptr<parquet::PageReader>
+  OpenPage(int rowGroup, const std::vector<parquet::PageLocation> &locations,
+           int page) {
+    auto chunk = fReader.metadata()->RowGroup(rowGroup)->ColumnChunk(fColumn);
+    arrow::BufferVector buffers;
+    if (chunk->has_dictionary_page()) {
+      if (fDictionaryRowGroup != rowGroup) {
+        auto start = chunk->dictionary_page_offset();
+        PARQUET_ASSIGN_OR_THROW(
+            fDictionary, fFile->ReadAt(start, locations[0].offset - start));
+        fDictionaryRowGroup = rowGroup;
+      }
+      buffers.push_back(fDictionary);
+    }
+    std::shared_ptr<arrow::Buffer> data;
+    PARQUET_ASSIGN_OR_THROW(data,
+                            fFile->ReadAt(locations[page].offset,
+                                          locations[page].compressed_page_size));
+    buffers.push_back(std::move(data));
+
+    std::shared_ptr<arrow::Buffer> pages;
+    PARQUET_ASSIGN_OR_THROW(pages, arrow::ConcatenateBuffers(buffers));
+    auto stream = std::make_shared<arrow::io::BufferReader>(std::move(pages));
+    // The page reader stops at the end of the stream, before reaching the
+    // number of values of the column chunk
+    return parquet::PageReader::Open(stream, chunk->num_values(),
+                                     chunk->compression(),
+                                     parquet::default_reader_properties());
+  }
+
+  parquet::ParquetFileReader &fReader;
+  std::shared_ptr<arrow::io::RandomAccessFile> fFile;
+  int fColumn;
+  const parquet::ColumnDescriptor *fDescr;
+
+  std::shared_ptr<parquet::internal::RecordReader> fRecordReader;
+  int fRowGroup = -1;
+  // Page the record reader started at, -1 for the start of the column chunk
+  int fPage = -1;
+  // Row of the row group the record reader is positioned at
+  std::int64_t fNextRow = 0;
+
+  // Dictionary page of the column chunk in fDictionaryRowGroup
+  std::shared_ptr<arrow::Buffer> fDictionary;
+  int fDictionaryRowGroup = -1;
+};
+
+AnalysisTime_t fetch_parquet(const AnalysisOptions &opts,
+                             const std::vector<std::string> &columnNames,
+                             const std::vector<std::uint64_t> &entries,
+                             MetadataCache *metadataCache, FetchStats *stats) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  std::shared_ptr<parquet::FileMetaData> metadata;
+  if (metadataCache)
+    metadata = metadataCache->GetParquetMetadata();
+  auto file = open_input_file(opts.input_path, opts);
+  auto reader = parquet::ParquetFileReader::Open(
+      file, parquet::default_reader_properties(), metadata);
+  if (metadataCache && !metadata)
+    metadataCache->PutParquetMetadata(*reader->metadata());
+  metadata = reader->metadata();
+  if (auto trace = get_read_trace(opts))
+    add_parquet_column_ranges(*trace, *metadata);
+
+  std::vector<int> columns;
+  for (const auto &name : columnNames)
+    columns.push_back(get_leaf_column(*metadata->schema(), name));
+
+  std::vector<std::uint64_t> rowGroupBoundaries;
+  std::uint64_t nRows = 0;
+  for (int i = 0; i < metadata->num_row_groups(); ++i) {
+    rowGroupBoundaries.push_back(nRows);
+    nRows += metadata->RowGroup(i)->num_rows();
+  }
+  rowGroupBoundaries.push_back(nRows);
+
+  // Load the offset indexes of the row groups containing any of the entries
+  // upfront, so that the fetches only read data pages
+  std::vector<int> rowGroups;
+  for (auto entry : entries) {
+    int rowGroup = std::upper_bound(rowGroupBoundaries.begin(),
+                                    rowGroupBoundaries.end(), entry) -
+                   rowGroupBoundaries.begin() - 1;
+    if (rowGroups.empty() || rowGroups.back() != rowGroup)
+      rowGroups.push_back(rowGroup);
+  }
+  std::map<int, std::vector<std::shared_ptr<parquet::OffsetIndex>>>
+      offsetIndexes;
+  auto pageIndexReader = reader->GetPageIndexReader();
+  if (pageIndexReader && !rowGroups.empty()) {
+    parquet::PageIndexSelection selection;
+    selection.offset_index = true;
+    pageIndexReader->WillNeed(rowGroups, columns, selection);
+  }
+  bool haveOffsetIndex = false;
+  for (auto rowGroup : rowGroups) {
+    auto rowGroupIndex =
+        pageIndexReader ? pageIndexReader->RowGroup(rowGroup) : nullptr;
+    auto &indexes = offsetIndexes[rowGroup];
+    for (auto column : columns) {
+      indexes.push_back(rowGroupIndex ? rowGroupIndex->GetOffsetIndex(column)
+                                      : nullptr);
+      haveOffsetIndex = haveOffsetIndex || indexes.back();
+    }
+  }
+  if (!rowGroups.empty() && !haveOffsetIndex) {
+    std::cerr << "no page index in " << opts.input_path
+              << ", reading row groups from their start" << std::endl;
+  }
+
+  std::vector<ParquetRowReader> rowReaders;
+  for (auto column : columns)
+    rowReaders.emplace_back(*reader, file, column);
+
+  auto ts_first = std::chrono::steady_clock::now();
+
+  fetch_each(
+      entries, rowGroupBoundaries,
+      [&](std::uint64_t entry) {
+        int rowGroup = std::upper_bound(rowGroupBoundaries.begin(),
+                                        rowGroupBoundaries.end(), entry) -
+                       rowGroupBoundaries.begin() - 1;
+        const auto &indexes = offsetIndexes[rowGroup];
+        for (std::size_t i = 0; i < rowReaders.size(); ++i) {
+          rowReaders[i].Read(rowGroup, entry - rowGroupBoundaries[rowGroup],
+                             indexes[i]);
+        }
+      },
+      stats);
+
+  return get_runtimes(ts_init, ts_first);
+}
+
+AnalysisTime_t fetch_orc(const AnalysisOptions &opts,
+                         const std::vector<std::string> &columnNames,
+                         const std::vector<std::uint64_t> &entries,
+                         MetadataCache *metadataCache, FetchStats *stats) {
+  auto ts_init = std::chrono::steady_clock::now();
+  TraceContext traceContext("open");
+
+  auto localFile = open_input_file(opts.input_path, opts);
+  std::shared_ptr<MetadataCachingFile> cachingFile;
+  if (metadataCache) {
+    cachingFile = metadataCache->WrapFile(localFile);
+    localFile = cachingFile;
+  }
+  std::unique_ptr<arrow::adapters::orc::ORCFileReader> reader;
+  PARQUET_ASSIGN_OR_THROW(reader, arrow::adapters::orc::ORCFileReader::Open(
+                                      localFile, arrow::default_memory_pool()));
+  std::shared_ptr<arrow::Schema> schema;
+  PARQUET_ASSIGN_OR_THROW(schema, reader->ReadSchema());
+  if (cachingFile)
+    cachingFile->StopRecording();
+
+  std::vector<int> columns;
+  for (const auto &name : columnNames)
+    columns.push_back(schema->GetFieldIndex(name));
+
+  std::vector<std::uint64_t> stripeBoundaries;
+  for (std::int64_t i = 0; i < reader->NumberOfStripes(); ++i)
+    stripeBoundaries.push_back(reader->GetStripeInformation(i).first_row_id);
+  stripeBoundaries.push_back(reader->NumberOfRows());
+
+  auto ts_first = std::chrono::steady_clock::now();
+
+  fetch_each(
+      entries, stripeBoundaries,
+      [&](std::uint64_t entry) {
+        // The stripe reader seeks to the row group of the row index containing
+        // the entry and skips the rows before it
+        auto st = reader->Seek(entry);
+        if (!st.ok())
+          throw std::runtime_error("could not seek to entry " +
+                                   std::to_string(entry));
+        std::shared_ptr<arrow::RecordBatchReader> batchReader;
+        PARQUET_ASSIGN_OR_THROW(batchReader,
+                                reader->NextStripeReader(1, columns));
+        std::shared_ptr<arrow::RecordBatch> batch;
+        st = batchReader->ReadNext(&batch);
+        if (!st.ok() || !batch || batch->num_rows() != 1)
+          throw std::runtime_error("could not read entry " +
+                                   std::to_string(entry));
+      },
+      stats);
+
+  return get_runtimes(ts_init, ts_first);
+}
+
+} // anonymous namespace
+
+std::vector<std::uint64_t> read_entry_list(const std::string &path) {
+  std::ifstream is(path);
+  if (!is)
+    throw std::invalid_argument("could not open entry list " + path);
+
+  std::vector<std::uint64_t> entries;
+  std::uint64_t entry;
+  while (is >> entry)
+    entries.push_back(entry);
+  if (!is.eof())
+    throw std::invalid_argument("invalid entry list " + path);
+
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+  return entries;
+}
+
+AnalysisTime_t fetch_entries(const AnalysisOptions &opts,
+                             std::string_view ntupleName,
+                             const std::vector<std::string> &columnNames,
+                             const ResidentState &resident, TH1D *hist,
+                             FetchStats *stats) {
+  auto metadataCache = resident.metadata;
+  auto fmt = get_file_format(get_path_suffix(opts.input_path));
+  auto entries = read_entry_list(opts.entry_list_path);
+
+  std::mutex statsLock;
+  AnalysisFn_t fetch = [&](const WorkerSlice &slice, TH1D *) {
+    auto range = get_unit_range(entries.size(), slice);
+    std::vector<std::uint64_t> share(entries.begin() + range.first,
+                                     entries.begin() + range.second);
+
+    FetchStats threadStats;
+    AnalysisTime_t runtimes;
+    switch (fmt) {
+    case FileFormat::rntuple:
+      runtimes = fetch_rntuple(opts, ntupleName, columnNames, share,
+                               metadataCache, &threadStats);
+      break;
+    case FileFormat::parquet:
+      runtimes = fetch_parquet(opts, columnNames, share, metadataCache,
+                               &threadStats);
+      break;
+    case FileFormat::orc:
+      runtimes =
+          fetch_orc(opts, columnNames, share, metadataCache, &threadStats);
+      break;
+    default:
+      throw std::invalid_argument("Invalid file format");
+    }
+
+    std::lock_guard<std::mutex> guard(statsLock);
+    stats->nEntries += threadStats.nEntries;
+    stats->nUnits += threadStats.nUnits;
+    stats->nBytes += threadStats.nBytes;
+    stats->latencies.insert(stats->latencies.end(),
+                            threadStats.latencies.begin(),
+                            threadStats.latencies.end());
+    return runtimes;
+  };
+
+  return run_analysis(opts, fetch, hist, resident.threads);
+}
+
+void print_fetch_stats(const FetchStats &stats) {
+  if (stats.latencies.empty()) {
+    std::cerr << "entries: 0" << std::endl;
+    return;
+  }
+
+  auto latencies = stats.latencies;
+  std::sort(latencies.begin(), latencies.end());
+  double mean = 0;
+  for (auto latency : latencies)
+    mean += latency;
+  mean /= latencies.size();
+  auto n = latencies.size();
+
+  std::cerr << "entries: " << stats.nEntries << " in " << stats.nUnits
+            << " units, latency: mean " << static_cast<std::uint64_t>(mean)
+            << " us, median " << latencies[n / 2] << " us, p99 "
+            << latencies[std::min(n - 1, n * 99 / 100)] << " us, "
+            << stats.nBytes / stats.nEntries << " bytes per entry"
+            << std::endl;
+}
@@ -0,0 +1,52 @@
+#ifndef SPARSE_READ__HXX
+#define SPARSE_READ__HXX
+
+#include <TH1D.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "util.hxx"
+
+// Reads an entry list with one entry number per line. The entries are returned
+// sorted and without duplicates.
+std::vector<std::uint64_t> read_entry_list(const std::string &path);
+
+// Cost of fetching the entries of an entry list
+struct FetchStats {
+  std::uint64_t nEntries = 0;
+  // Clusters, row groups or stripes containing at least one of the entries
+  std::uint64_t nUnits = 0;
+  // Bytes read from files by the fetching threads, including page cache hits
+  std::uint64_t nBytes = 0;
+  // Time to fetch each entry, in microseconds
+  std::vector<std::uint64_t> latencies;
+};
+
+// Fetches the values of the given columns for the entries listed in
+// opts.entry_list_path, one entry at a time, using the index structures of the
+// format to read only what is needed:
+//
+//   RNTuple: the cluster and page of every column are looked up from the entry
+//            number, with the cluster cache disabled so that only those pages
+//            are read
+//   Parquet: the offset index (page index) gives the data page containing the
+//            row; only that page and the dictionary page are read
+//   ORC:     the row index of the stripe is used to seek to the row group
+//            containing the entry
+//
+// The entries are split between the threads like the units of a scan. The
+// histogram is not filled.
+AnalysisTime_t fetch_entries(const AnalysisOptions &opts,
+                             std::string_view ntupleName,
+                             const std::vector<std::string> &columnNames,
+                             const ResidentState &resident, TH1D *hist,
+                             FetchStats *stats);
+
+// Prints the number of entries, the latency distribution and the bytes read
+// per entry to stderr
+void print_fetch_stats(const FetchStats &stats);
+
+#endif // SPARSE_READ__HXX
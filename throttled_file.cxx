@@ -0,0 +1,216 @@
+#include "throttled_file.hxx"
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <tuple>
+
+#include <arrow/buffer.h>
+#include <arrow/util/thread_pool.h>
+
+namespace {
+
+// Holds one of the limited request slots of a throttle
+class RequestSlot {
+public:
+  RequestSlot(std::mutex &lock, std::condition_variable &requestDone,
+              unsigned &nActive, unsigned maxRequests)
+      : fLock(lock), fRequestDone(requestDone), fNActive(nActive) {
+    std::unique_lock<std::mutex> guard(fLock);
+    fRequestDone.wait(guard, [&]() {
+      return maxRequests == 0 || fNActive < maxRequests;
+    });
+    ++fNActive;
+  }
+
+  ~RequestSlot() {
+    {
+      std::lock_guard<std::mutex> guard(fLock);
+      --fNActive;
+    }
+    fRequestDone.notify_one();
+  }
+
+private:
+  std::mutex &fLock;
+  std::condition_variable &fRequestDone;
+  unsigned &fNActive;
+};
+
+} // anonymous namespace
+
+std::shared_ptr<StorageThrottle>
+StorageThrottle::Get(double latencyMs, double bandwidthMBps,
+                     unsigned maxRequests) {
+  if (latencyMs <= 0 && bandwidthMBps <= 0 && maxRequests == 0)
+    return nullptr;
+
+  static std::mutex lock;
+  static std::map<std::tuple<double, double, unsigned>,
+                  std::shared_ptr<StorageThrottle>>
+      throttles;
+  std::lock_guard<std::mutex> guard(lock);
+  auto &throttle = throttles[{latencyMs, bandwidthMBps, maxRequests}];
+  if (!throttle)
+    throttle = std::make_shared<StorageThrottle>(latencyMs, bandwidthMBps,
+                                                 maxRequests);
+  return throttle;
+}
+
+StorageThrottle::StorageThrottle(double latencyMs, double bandwidthMBps,
+                                 unsigned maxRequests)
+    : fLatency(std::chrono::duration_cast<Clock_t::duration>(
+          std::chrono::duration<double, std::milli>(std::max(latencyMs, 0.)))),
+      fBandwidth(std::max(bandwidthMBps, 0.) * 1e6),
+      fMaxRequests(maxRequests) {}
+
+std::uint64_t
+StorageThrottle::Request(const std::function<std::uint64_t()> &read) {
+  RequestSlot slot(fLock, fRequestDone, fNActive, fMaxRequests);
+
+  auto start = Clock_t::now();
+  auto nbytes = read();
+
+  // The first byte arrives after the latency, then the data is transferred
+  // once the link has finished the data of earlier requests
+  auto completion = start + fLatency;
+  if (fBandwidth > 0) {
+    auto transferTime = std::chrono::duration_cast<Clock_t::duration>(
+        std::chrono::duration<double>(nbytes / fBandwidth));
+    std::lock_guard<std::mutex> guard(fLock);
+    fLinkFree = std::max(completion, fLinkFree) + transferTime;
+    completion = fLinkFree;
+  }
+  ++fNRequests;
+  fNBytes += nbytes;
+
+  std::this_thread::sleep_until(completion);
+  return nbytes;
+}
+
+arrow::Result<std::int64_t> ThrottledFile::GetSize() {
+  arrow::Result<std::int64_t> result;
+  fThrottle->Request([&]() -> std::uint64_t {
+    result = fFile->GetSize();
+    return 0;
+  });
+  return result;
+}
+
+arrow::Result<std::int64_t> ThrottledFile::Read(std::int64_t nbytes,
+                                                void *out) {
+  arrow::Result<std::int64_t> result;
+  fThrottle->Request([&]() -> std::uint64_t {
+    result = fFile->Read(nbytes, out);
+    return result.ok() ? *result : 0;
+  });
+  return result;
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>>
+ThrottledFile::Read(std::int64_t nbytes) {
+  arrow::Result<std::shared_ptr<arrow::Buffer>> result;
+  fThrottle->Request([&]() -> std::uint64_t {
+    result = fFile->Read(nbytes);
+    return result.ok() ? (*result)->size() : 0;
+  });
+  return result;
+}
+
+arrow::Result<std::int64_t>
+ThrottledFile::ReadAt(std::int64_t position, std::int64_t nbytes, void *out) {
+  arrow::Result<std::int64_t> result;
+  fThrottle->Request([&]() -> std::uint64_t {
+    result = fFile->ReadAt(position, nbytes, out);
+    return result.ok() ? *result : 0;
+  });
+  return result;
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>>
+ThrottledFile::ReadAt(std::int64_t position, std::int64_t nbytes) {
+  arrow::Result<std::shared_ptr<arrow::Buffer>> result;
+  fThrottle->Request([&]() -> std::uint64_t {
+    result = fFile->ReadAt(position, nbytes);
+    return result.ok() ? (*result)->size() : 0;
+  });
+  return result;
+}
+
+std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+ThrottledFile::Throttle(
+    const arrow::io::IOContext &ctx,
+    std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> reads) {
+  using Results_t = std::vector<arrow::Result<std::shared_ptr<arrow::Buffer>>>;
+
+  // The throttle blocks, so it must not run on the thread that completes the
+  // underlying reads (e.g. the io_uring reaper)
+  auto nReads = reads.size();
+  auto done =
+      ctx.executor()
+          ->Transfer(arrow::All(std::move(reads)))
+          .Then([throttle = fThrottle](const Results_t &results) {
+            throttle->Request([&]() -> std::uint64_t {
+              std::uint64_t nbytes = 0;
+              for (const auto &result : results)
+                nbytes += result.ok() ? (*result)->size() : 0;
+              return nbytes;
+            });
+            return results;
+          });
+
+  std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> futures;
+  for (std::size_t i = 0; i < nReads; ++i) {
+    futures.emplace_back(done.Then(
+        [i](const Results_t &results) { return results[i]; }));
+  }
+  return futures;
+}
+
+arrow::Future<std::shared_ptr<arrow::Buffer>>
+ThrottledFile::ReadAsync(const arrow::io::IOContext &ctx,
+                         std::int64_t position, std::int64_t nbytes) {
+  return Throttle(ctx, {fFile->ReadAsync(ctx, position, nbytes)})[0];
+}
+
+std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+ThrottledFile::ReadManyAsync(const arrow::io::IOContext &ctx,
+                             const std::vector<arrow::io::ReadRange> &ranges) {
+  return Throttle(ctx, fFile->ReadManyAsync(ctx, ranges));
+}
+
+ThrottledRawFile::ThrottledRawFile(
+    std::unique_ptr<ROOT::Internal::RRawFile> file,
+    std::shared_ptr<StorageThrottle> throttle, const ROptions &options)
+    : ROOT::Internal::RRawFile(file->GetUrl(), options),
+      fFile(std::move(file)), fThrottle(std::move(throttle)) {}
+
+std::unique_ptr<ROOT::Internal::RRawFile> ThrottledRawFile::Clone() const {
+  return std::make_unique<ThrottledRawFile>(fFile->Clone(), fThrottle,
+                                            fOptions);
+}
+
+size_t ThrottledRawFile::ReadAtImpl(void *buffer, size_t nbytes,
+                                    std::uint64_t offset) {
+  return fThrottle->Request(
+      [&]() -> std::uint64_t { return fFile->ReadAt(buffer, nbytes, offset); });
+}
+
+void ThrottledRawFile::ReadVImpl(RIOVec *ioVec, unsigned int nReq) {
+  fThrottle->Request([&]() -> std::uint64_t {
+    fFile->ReadV(ioVec, nReq);
+    std::uint64_t nbytes = 0;
+    for (unsigned int i = 0; i < nReq; ++i)
+      nbytes += ioVec[i].fOutBytes;
+    return nbytes;
+  });
+}
+
+std::uint64_t ThrottledRawFile::GetSizeImpl() {
+  std::uint64_t size;
+  fThrottle->Request([&]() -> std::uint64_t {
+    size = fFile->GetSize();
+    return 0;
+  });
+  return size;
+}
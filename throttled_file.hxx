@@ -0,0 +1,131 @@
+#ifndef THROTTLED_FILE__HXX
+#define THROTTLED_FILE__HXX
+
+#include <ROOT/RRawFile.hxx>
+#include <arrow/io/interfaces.h>
+#include <arrow/result.h>
+#include <arrow/util/future.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Emulates remote storage on top of a local file system. Every read is a
+// request that completes after a fixed latency plus the time needed to
+// transfer its data over a link of limited bandwidth, which is shared by all
+// requests in flight. Optionally, the number of requests in flight is limited.
+//
+// The throttles are process-wide, so that all threads (and all requests of the
+// analysis server) share the same emulated storage.
+class StorageThrottle {
+public:
+  // Returns nullptr if none of the limits is set
+  static std::shared_ptr<StorageThrottle>
+  Get(double latencyMs, double bandwidthMBps, unsigned maxRequests);
+
+  StorageThrottle(double latencyMs, double bandwidthMBps, unsigned maxRequests);
+
+  // Performs the actual read, which returns the number of bytes read, and
+  // blocks until the request would have completed on the emulated storage
+  std::uint64_t Request(const std::function<std::uint64_t()> &read);
+
+  std::uint64_t GetNRequests() const { return fNRequests; }
+  std::uint64_t GetNBytes() const { return fNBytes; }
+
+private:
+  using Clock_t = std::chrono::steady_clock;
+
+  Clock_t::duration fLatency;
+  double fBandwidth; // bytes per second, 0 for unlimited
+  unsigned fMaxRequests; // 0 for unlimited
+
+  std::mutex fLock;
+  std::condition_variable fRequestDone;
+  unsigned fNActive = 0;
+  // When the link finishes transferring the data of the requests so far
+  Clock_t::time_point fLinkFree;
+
+  std::atomic<std::uint64_t> fNRequests{0};
+  std::atomic<std::uint64_t> fNBytes{0};
+};
+
+// Arrow file whose reads go through a storage throttle. Asynchronous reads are
+// issued to the underlying file right away, so that e.g. io_uring still sees
+// all of them, and complete once the throttle has let them through on the I/O
+// thread pool. A ReadManyAsync() is a single request, like a multi-range
+// request to a remote server. Prefetch hints are passed on.
+class ThrottledFile : public arrow::io::RandomAccessFile {
+public:
+  ThrottledFile(std::shared_ptr<arrow::io::RandomAccessFile> file,
+                std::shared_ptr<StorageThrottle> throttle)
+      : fFile(std::move(file)), fThrottle(std::move(throttle)) {}
+
+  arrow::Status Close() override { return fFile->Close(); }
+  bool closed() const override { return fFile->closed(); }
+  arrow::Result<std::int64_t> Tell() const override { return fFile->Tell(); }
+  arrow::Status Seek(std::int64_t position) override {
+    return fFile->Seek(position);
+  }
+  arrow::Result<std::int64_t> GetSize() override;
+
+  arrow::Result<std::int64_t> Read(std::int64_t nbytes, void *out) override;
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  Read(std::int64_t nbytes) override;
+
+  using arrow::io::RandomAccessFile::ReadAsync;
+  using arrow::io::RandomAccessFile::ReadAt;
+  using arrow::io::RandomAccessFile::ReadManyAsync;
+  arrow::Result<std::int64_t> ReadAt(std::int64_t position,
+                                     std::int64_t nbytes, void *out) override;
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  ReadAt(std::int64_t position, std::int64_t nbytes) override;
+  arrow::Future<std::shared_ptr<arrow::Buffer>>
+  ReadAsync(const arrow::io::IOContext &ctx, std::int64_t position,
+            std::int64_t nbytes) override;
+  std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+  ReadManyAsync(const arrow::io::IOContext &ctx,
+                const std::vector<arrow::io::ReadRange> &ranges) override;
+  arrow::Status
+  WillNeed(const std::vector<arrow::io::ReadRange> &ranges) override {
+    return fFile->WillNeed(ranges);
+  }
+
+private:
+  // Completes the given reads as one request of the throttle
+  std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+  Throttle(const arrow::io::IOContext &ctx,
+           std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> reads);
+
+  std::shared_ptr<arrow::io::RandomAccessFile> fFile;
+  std::shared_ptr<StorageThrottle> fThrottle;
+};
+
+// ROOT raw file whose reads go through a storage throttle. A vector read is a
+// single request, like a multi-range request to a remote server.
+class ThrottledRawFile : public ROOT::Internal::RRawFile {
+public:
+  ThrottledRawFile(std::unique_ptr<ROOT::Internal::RRawFile> file,
+                   std::shared_ptr<StorageThrottle> throttle,
+                   const ROptions &options);
+
+  std::unique_ptr<ROOT::Internal::RRawFile> Clone() const override;
+  int GetFeatures() const override { return fFile->GetFeatures(); }
+
+protected:
+  void OpenImpl() override {}
+  size_t ReadAtImpl(void *buffer, size_t nbytes,
+                    std::uint64_t offset) override;
+  void ReadVImpl(RIOVec *ioVec, unsigned int nReq) override;
+  std::uint64_t GetSizeImpl() override;
+
+private:
+  std::unique_ptr<ROOT::Internal::RRawFile> fFile;
+  std::shared_ptr<StorageThrottle> fThrottle;
+};
+
+#endif // THROTTLED_FILE__HXX
@@ -0,0 +1,397 @@
+#include "uring_file.hxx"
+
+#include <arrow/buffer.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+// A read as issued by the caller, finished once all of its requests are done
+struct UringFile::Pending {
+  std::shared_ptr<arrow::Buffer> buffer;
+  arrow::Future<std::shared_ptr<arrow::Buffer>> future =
+      arrow::Future<std::shared_ptr<arrow::Buffer>>::Make();
+  std::atomic<int> nOutstanding{0};
+  arrow::Status status;
+};
+
+// A single io_uring read of at most kMaxRequestSize bytes
+struct UringFile::Request {
+  std::shared_ptr<Pending> pending;
+  std::uint8_t *dst;
+  std::int64_t offset;
+  std::int64_t nbytes;
+  std::int64_t done = 0;
+};
+
+UringFile::UringFile(int fd, std::int64_t size, unsigned queueDepth,
+                     arrow::MemoryPool *pool)
+    : fFd(fd), fSize(size), fQueueDepth(queueDepth), fPool(pool) {}
+
+arrow::Result<std::shared_ptr<UringFile>>
+UringFile::Open(const std::string &path, unsigned queueDepth,
+                arrow::MemoryPool *pool) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return arrow::Status::IOError("cannot open ", path, ": ", strerror(errno));
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    return arrow::Status::IOError("cannot stat ", path, ": ", strerror(errno));
+  }
+
+  queueDepth = std::max(queueDepth, 1u);
+  std::shared_ptr<UringFile> file(
+      new UringFile(fd, info.st_size, queueDepth, pool));
+  int rv = io_uring_queue_init(queueDepth, &file->fRing, 0);
+  if (rv < 0) {
+    file->fClosed = true;
+    close(fd);
+    return arrow::Status::IOError("cannot set up io_uring: ", strerror(-rv));
+  }
+  file->fReaper = std::thread(&UringFile::ReapCompletions, file.get());
+
+  return file;
+}
+
+UringFile::~UringFile() {
+  auto st = Close();
+  if (!st.ok())
+    std::cerr << "error closing file: " << st.ToString() << std::endl;
+}
+
+arrow::Status UringFile::Close() {
+  if (fClosed)
+    return arrow::Status::OK();
+  fClosed = true;
+
+  if (std::this_thread::get_id() == fReaper.get_id()) {
+    // Closed by the callback of a completion, e.g. because it dropped the last
+    // reference to the file. The reaper thread cannot wait for itself, so the
+    // remaining reads are reaped here, and the thread stops as soon as the
+    // callback returns.
+    while (true) {
+      {
+        std::lock_guard<std::mutex> guard(fSubmitLock);
+        if (fInFlight == 0 && fBacklog.empty())
+          break;
+      }
+      ReapCompletion();
+    }
+    *fReaperStopped = true;
+    fReaper.detach();
+    fCache.clear();
+  } else {
+    for (auto &[offset, future] : fCache)
+      future.Wait();
+    fCache.clear();
+
+    {
+      // Completions are not ordered, so the stop request may only be
+      // submitted once all reads are done, including those of ReadAsync()
+      // calls that nobody waits for
+      std::unique_lock<std::mutex> guard(fSubmitLock);
+      fIdle.wait(guard, [this] { return fInFlight == 0 && fBacklog.empty(); });
+      // A request without user data tells the reaper thread to stop
+      struct io_uring_sqe *sqe;
+      while (!(sqe = io_uring_get_sqe(&fRing)))
+        io_uring_submit(&fRing);
+      io_uring_prep_nop(sqe);
+      io_uring_sqe_set_data(sqe, nullptr);
+      io_uring_submit(&fRing);
+    }
+    fReaper.join();
+  }
+  io_uring_queue_exit(&fRing);
+
+  if (close(fFd) < 0)
+    return arrow::Status::IOError("cannot close file: ", strerror(errno));
+  return arrow::Status::OK();
+}
+
+bool UringFile::closed() const { return fClosed; }
+
+arrow::Result<std::int64_t> UringFile::Tell() const { return fPosition; }
+
+arrow::Status UringFile::Seek(std::int64_t position) {
+  if (position < 0)
+    return arrow::Status::Invalid("negative seek position");
+  fPosition = position;
+  return arrow::Status::OK();
+}
+
+arrow::Result<std::int64_t> UringFile::GetSize() { return fSize; }
+
+arrow::Result<std::int64_t> UringFile::Read(std::int64_t nbytes, void *out) {
+  ARROW_ASSIGN_OR_RAISE(auto nread, ReadAt(fPosition, nbytes, out));
+  fPosition += nread;
+  return nread;
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>>
+UringFile::Read(std::int64_t nbytes) {
+  ARROW_ASSIGN_OR_RAISE(auto buffer, ReadAt(fPosition, nbytes));
+  fPosition += buffer->size();
+  return buffer;
+}
+
+arrow::Result<std::int64_t> UringFile::ReadAt(std::int64_t position,
+                                              std::int64_t nbytes, void *out) {
+  std::shared_ptr<arrow::Buffer> cached;
+  if (ReadFromCache(position, nbytes, &cached)) {
+    memcpy(out, cached->data(), cached->size());
+    return cached->size();
+  }
+
+  std::vector<Request *> requests;
+  ARROW_ASSIGN_OR_RAISE(
+      auto future, StartRead(position, nbytes,
+                             static_cast<std::uint8_t *>(out), &requests));
+  Submit(requests);
+  ARROW_ASSIGN_OR_RAISE(auto buffer, future.result());
+  return buffer->size();
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>>
+UringFile::ReadAt(std::int64_t position, std::int64_t nbytes) {
+  std::shared_ptr<arrow::Buffer> cached;
+  if (ReadFromCache(position, nbytes, &cached))
+    return cached;
+
+  std::vector<Request *> requests;
+  ARROW_ASSIGN_OR_RAISE(auto future,
+                        StartRead(position, nbytes, nullptr, &requests));
+  Submit(requests);
+  return future.result();
+}
+
+arrow::Future<std::shared_ptr<arrow::Buffer>>
+UringFile::ReadAsync(const arrow::io::IOContext &ctx, std::int64_t position,
+                     std::int64_t nbytes) {
+  std::shared_ptr<arrow::Buffer> cached;
+  if (ReadFromCache(position, nbytes, &cached))
+    return arrow::Future<std::shared_ptr<arrow::Buffer>>::MakeFinished(cached);
+
+  std::vector<Request *> requests;
+  auto maybeFuture = StartRead(position, nbytes, nullptr, &requests);
+  if (!maybeFuture.ok()) {
+    return arrow::Future<std::shared_ptr<arrow::Buffer>>::MakeFinished(
+        maybeFuture.status());
+  }
+  Submit(requests);
+  return *maybeFuture;
+}
+
+std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+UringFile::ReadManyAsync(const arrow::io::IOContext &ctx,
+                         const std::vector<arrow::io::ReadRange> &ranges) {
+  std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> futures;
+  std::vector<Request *> requests;
+
+  for (const auto &range : ranges) {
+    auto maybeFuture = StartRead(range.offset, range.length, nullptr, &requests);
+    if (maybeFuture.ok()) {
+      futures.emplace_back(*maybeFuture);
+    } else {
+      futures.emplace_back(
+          arrow::Future<std::shared_ptr<arrow::Buffer>>::MakeFinished(
+              maybeFuture.status()));
+    }
+  }
+  Submit(requests);
+
+  return futures;
+}
+
+arrow::Status
+UringFile::WillNeed(const std::vector<arrow::io::ReadRange> &ranges) {
+  std::map<std::int64_t, arrow::Future<std::shared_ptr<arrow::Buffer>>> cache;
+  std::vector<Request *> requests;
+
+  for (const auto &range : ranges) {
+    auto maybeFuture = StartRead(range.offset, range.length, nullptr, &requests);
+    if (!maybeFuture.ok()) {
+      Submit(requests);
+      return maybeFuture.status();
+    }
+    cache.emplace(range.offset, *maybeFuture);
+  }
+  Submit(requests);
+
+  // Readers announce the data of one unit at a time, the ranges of the
+  // previous unit are not needed anymore
+  std::lock_guard<std::mutex> guard(fCacheLock);
+  fCache = std::move(cache);
+  return arrow::Status::OK();
+}
+
+bool UringFile::ReadFromCache(std::int64_t position, std::int64_t nbytes,
+                              std::shared_ptr<arrow::Buffer> *out) {
+  std::int64_t start;
+  arrow::Future<std::shared_ptr<arrow::Buffer>> future;
+  {
+    std::lock_guard<std::mutex> guard(fCacheLock);
+    auto it = fCache.upper_bound(position);
+    if (it == fCache.begin())
+      return false;
+    --it;
+    start = it->first;
+    future = it->second;
+  }
+
+  const auto &maybeBuffer = future.result();
+  if (!maybeBuffer.ok())
+    return false;
+  const auto &buffer = *maybeBuffer;
+  nbytes = std::max<std::int64_t>(0, std::min(nbytes, fSize - position));
+  if (position + nbytes > start + buffer->size())
+    return false;
+
+  *out = arrow::SliceBuffer(buffer, position - start, nbytes);
+  return true;
+}
+
+arrow::Result<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+UringFile::StartRead(std::int64_t position, std::int64_t nbytes,
+                     std::uint8_t *out, std::vector<Request *> *requests) {
+  if (fClosed)
+    return arrow::Status::Invalid("operation on closed file");
+  if (position < 0 || nbytes < 0)
+    return arrow::Status::Invalid("invalid read range");
+  nbytes = std::max<std::int64_t>(0, std::min(nbytes, fSize - position));
+
+  auto pending = std::make_shared<Pending>();
+  if (out) {
+    pending->buffer = std::make_shared<arrow::Buffer>(out, nbytes);
+  } else {
+    ARROW_ASSIGN_OR_RAISE(pending->buffer, arrow::AllocateBuffer(nbytes, fPool));
+    out = pending->buffer->mutable_data();
+  }
+
+  if (nbytes == 0) {
+    pending->future.MarkFinished(pending->buffer);
+    return pending->future;
+  }
+
+  for (std::int64_t offset = 0; offset < nbytes; offset += kMaxRequestSize) {
+    ++pending->nOutstanding;
+    requests->push_back(new Request{pending, out + offset, position + offset,
+                                    std::min(kMaxRequestSize, nbytes - offset)});
+  }
+
+  return pending->future;
+}
+
+void UringFile::Submit(const std::vector<Request *> &requests) {
+  std::lock_guard<std::mutex> guard(fSubmitLock);
+  fBacklog.insert(fBacklog.end(), requests.begin(), requests.end());
+  SubmitBacklog();
+}
+
+// Must be called with fSubmitLock held
+void UringFile::SubmitBacklog() {
+  unsigned nSubmit = 0;
+  while (!fBacklog.empty() && fInFlight < fQueueDepth) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&fRing);
+    if (!sqe)
+      break;
+
+    auto request = fBacklog.front();
+    fBacklog.pop_front();
+    io_uring_prep_read(sqe, fFd, request->dst + request->done,
+                       request->nbytes - request->done,
+                       request->offset + request->done);
+    io_uring_sqe_set_data(sqe, request);
+    ++fInFlight;
+    ++nSubmit;
+  }
+
+  if (nSubmit == 0)
+    return;
+
+  int rv;
+  while ((rv = io_uring_submit(&fRing)) == -EAGAIN || rv == -EINTR) {
+  }
+  if (rv < 0) {
+    std::cerr << "io_uring submission failed: " << strerror(-rv) << std::endl;
+    abort();
+  }
+}
+
+void UringFile::Finish(Request *request, const arrow::Status &status) {
+  auto pending = std::move(request->pending);
+  delete request;
+
+  if (!status.ok() && pending->status.ok())
+    pending->status = status;
+  if (--pending->nOutstanding > 0)
+    return;
+
+  if (pending->status.ok())
+    pending->future.MarkFinished(pending->buffer);
+  else
+    pending->future.MarkFinished(pending->status);
+}
+
+void UringFile::ReapCompletions() {
+  bool stopped = false;
+  fReaperStopped = &stopped;
+  // The callbacks of a completion may destroy the file, see Close(), in which
+  // case it must not be touched anymore
+  while (ReapCompletion() && !stopped) {
+  }
+}
+
+bool UringFile::ReapCompletion() {
+  struct io_uring_cqe *cqe;
+  int rv;
+  while ((rv = io_uring_wait_cqe(&fRing, &cqe)) == -EINTR) {
+  }
+  if (rv < 0) {
+    std::cerr << "io_uring completion failed: " << strerror(-rv) << std::endl;
+    abort();
+  }
+
+  auto request = static_cast<Request *>(io_uring_cqe_get_data(cqe));
+  int res = cqe->res;
+  io_uring_cqe_seen(&fRing, cqe);
+  if (!request)
+    return false;
+
+  arrow::Status status;
+  bool resubmit = false;
+  if (res == -EAGAIN || res == -EINTR) {
+    resubmit = true;
+  } else if (res < 0) {
+    status = arrow::Status::IOError("read failed: ", strerror(-res));
+  } else if (res == 0) {
+    status = arrow::Status::IOError("unexpected end of file");
+  } else {
+    request->done += res;
+    resubmit = request->done < request->nbytes;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(fSubmitLock);
+    --fInFlight;
+    if (resubmit)
+      fBacklog.push_front(request);
+    SubmitBacklog();
+    if (fInFlight == 0 && fBacklog.empty())
+      fIdle.notify_all();
+  }
+
+  // Outside of the lock: finishing the future runs its callbacks, which may
+  // issue further reads
+  if (!resubmit)
+    Finish(request, status);
+  // The file may have been destroyed by now
+  return true;
+}
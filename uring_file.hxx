@@ -0,0 +1,105 @@
+#ifndef URING_FILE__HXX
+#define URING_FILE__HXX
+
+#include <arrow/io/interfaces.h>
+#include <arrow/memory_pool.h>
+#include <arrow/util/future.h>
+
+#include <liburing.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Random access file that reads through io_uring.
+//
+// Reads are split into requests of at most kMaxRequestSize bytes, of which up
+// to queue depth are in flight at once. All ranges of a ReadManyAsync() call
+// are submitted as one batch. WillNeed() does the same and keeps the data
+// around, so that subsequent synchronous ReadAt() calls within these ranges
+// (e.g. from the ORC reader) are served from memory.
+class UringFile : public arrow::io::RandomAccessFile {
+public:
+  static constexpr std::int64_t kMaxRequestSize = 1024 * 1024;
+
+  static arrow::Result<std::shared_ptr<UringFile>>
+  Open(const std::string &path, unsigned queueDepth,
+       arrow::MemoryPool *pool = arrow::default_memory_pool());
+  ~UringFile() override;
+
+  arrow::Status Close() override;
+  bool closed() const override;
+  arrow::Result<std::int64_t> Tell() const override;
+  arrow::Status Seek(std::int64_t position) override;
+  arrow::Result<std::int64_t> GetSize() override;
+
+  arrow::Result<std::int64_t> Read(std::int64_t nbytes, void *out) override;
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  Read(std::int64_t nbytes) override;
+
+  using arrow::io::RandomAccessFile::ReadAsync;
+  using arrow::io::RandomAccessFile::ReadAt;
+  using arrow::io::RandomAccessFile::ReadManyAsync;
+  arrow::Result<std::int64_t> ReadAt(std::int64_t position,
+                                     std::int64_t nbytes, void *out) override;
+  arrow::Result<std::shared_ptr<arrow::Buffer>>
+  ReadAt(std::int64_t position, std::int64_t nbytes) override;
+  arrow::Future<std::shared_ptr<arrow::Buffer>>
+  ReadAsync(const arrow::io::IOContext &ctx, std::int64_t position,
+            std::int64_t nbytes) override;
+  std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+  ReadManyAsync(const arrow::io::IOContext &ctx,
+                const std::vector<arrow::io::ReadRange> &ranges) override;
+  arrow::Status
+  WillNeed(const std::vector<arrow::io::ReadRange> &ranges) override;
+
+private:
+  struct Pending;
+  struct Request;
+
+  UringFile(int fd, std::int64_t size, unsigned queueDepth,
+            arrow::MemoryPool *pool);
+
+  arrow::Result<arrow::Future<std::shared_ptr<arrow::Buffer>>>
+  StartRead(std::int64_t position, std::int64_t nbytes, std::uint8_t *out,
+            std::vector<Request *> *requests);
+  void Submit(const std::vector<Request *> &requests);
+  void SubmitBacklog();
+  void Finish(Request *request, const arrow::Status &status);
+  void ReapCompletions();
+  bool ReapCompletion();
+  bool ReadFromCache(std::int64_t position, std::int64_t nbytes,
+                     std::shared_ptr<arrow::Buffer> *out);
+
+  int fFd;
+  std::int64_t fSize;
+  std::int64_t fPosition = 0;
+  unsigned fQueueDepth;
+  arrow::MemoryPool *fPool;
+  bool fClosed = false;
+
+  struct io_uring fRing;
+  std::thread fReaper;
+  // Set by Close() if it runs on the reaper thread, which then stops
+  bool *fReaperStopped = nullptr;
+
+  // Guards the submission queue, fInFlight and fBacklog
+  std::mutex fSubmitLock;
+  unsigned fInFlight = 0;
+  std::deque<Request *> fBacklog;
+  // Signaled when no requests are in flight or waiting anymore
+  std::condition_variable fIdle;
+
+  // Ranges announced through WillNeed(), by offset
+  std::mutex fCacheLock;
+  std::map<std::int64_t, arrow::Future<std::shared_ptr<arrow::Buffer>>>
+      fCache;
+};
+
+#endif // URING_FILE__HXX
@@ -1,13 +1,40 @@
 #include "util.hxx"
 
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <arrow/adapters/orc/adapter.h>
 #include <arrow/io/api.h>
 #include <parquet/arrow/reader.h>
+#include <parquet/exception.h>
+
+#include <ROOT/RPageStorageFile.hxx>
+#include <ROOT/RRawFile.hxx>
 
 #include <TCanvas.h>
 #include <TError.h>
+#include <TFile.h>
+#include <TParameter.h>
+#include <TROOT.h>
+
+#include "memory_pool.hxx"
+#include "metadata_cache.hxx"
+#include "read_trace.hxx"
+#include "throttled_file.hxx"
+
+#ifdef HAVE_LIBURING
+#include "uring_file.hxx"
+#endif
 
 void split_path(std::string_view path, std::string *basename,
                 std::string *suffix) {
@@ -42,7 +69,7 @@ FileFormat get_file_format(std::string_view suffix) {
     return FileFormat::orc;
   else if (suffix == "parquet")
     return FileFormat::parquet;
-  abort();
+  throw std::invalid_argument("Invalid file format: " + std::string(suffix));
 }
 
 std::vector<std::string> get_column_names(const std::string &basename) {
@@ -57,24 +84,601 @@ std::vector<std::string> get_column_names(const std::string &basename) {
   return colNames;
 }
 
-std::shared_ptr<arrow::Table> open_arrow(const std::string &input_path, FileFormat fmt) {
-  arrow::MemoryPool *pool = arrow::default_memory_pool();
+static bool parse_affinity(std::string_view name, AffinityPolicy *policy) {
+  if (name == "none")
+    *policy = AffinityPolicy::none;
+  else if (name == "compact")
+    *policy = AffinityPolicy::compact;
+  else if (name == "scatter")
+    *policy = AffinityPolicy::scatter;
+  else if (name == "numa")
+    *policy = AffinityPolicy::numa;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_io_backend(std::string_view name, IoBackend *io) {
+  if (name == "sync")
+    *io = IoBackend::sync;
+  else if (name == "uring")
+    *io = IoBackend::uring;
+  else
+    return false;
+  return true;
+}
+
+// FIRST:LAST, or FIRST: for all units from FIRST on
+static bool parse_unit_range(std::string_view spec, UnitRange_t *range) {
+  auto sep = spec.find(':');
+  if (sep == std::string_view::npos || sep == 0)
+    return false;
+  range->first = std::stoll(std::string(spec.substr(0, sep)));
+  if (sep + 1 < spec.size())
+    range->second = std::stoll(std::string(spec.substr(sep + 1)));
+  return range->first >= 0 && range->first <= range->second;
+}
+
+static bool parse_memory_pool(std::string_view name,
+                              MemoryPoolBackend *backend) {
+  if (name == "default")
+    *backend = MemoryPoolBackend::arrow;
+  else if (name == "system")
+    *backend = MemoryPoolBackend::system;
+  else if (name == "jemalloc")
+    *backend = MemoryPoolBackend::jemalloc;
+  else if (name == "mimalloc")
+    *backend = MemoryPoolBackend::mimalloc;
+  else if (name == "arena")
+    *backend = MemoryPoolBackend::arena;
+  else if (name == "arena-huge")
+    *backend = MemoryPoolBackend::arena_huge;
+  else
+    return false;
+  return true;
+}
+
+bool parse_options(int argc, char **argv, AnalysisOptions *opts) {
+  static const struct option longOptions[] = {
+      {"threads", required_argument, nullptr, 't'},
+      {"affinity", required_argument, nullptr, 'a'},
+      {"weak-scaling", no_argument, nullptr, 'w'},
+      {"io", required_argument, nullptr, 'i'},
+      {"io-depth", required_argument, nullptr, 'q'},
+      {"memory-pool", required_argument, nullptr, 'M'},
+      {"selection-cache", required_argument, nullptr, 's'},
+      {"column-cache", required_argument, nullptr, 'c'},
+      {"column-cache-size", required_argument, nullptr, 'S'},
+      {"metadata-cache", required_argument, nullptr, 'm'},
+      {"listen", required_argument, nullptr, 'l'},
+      {"jobs", required_argument, nullptr, 'j'},
+      {"latency", required_argument, nullptr, 'L'},
+      {"bandwidth", required_argument, nullptr, 'B'},
+      {"max-requests", required_argument, nullptr, 'R'},
+      {"trace", required_argument, nullptr, 'T'},
+      {"entry-list", required_argument, nullptr, 'e'},
+      {"unit-range", required_argument, nullptr, 'u'},
+      {"partial", no_argument, nullptr, 'P'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "t:a:wi:q:M:s:c:S:m:l:j:L:B:R:T:e:u:Ph", longOptions, nullptr)) !=
+         -1) {
+    // Numeric values are parsed with std::stoul and friends, which throw on
+    // malformed input
+    try {
+      switch (c) {
+      case 't':
+        opts->n_threads = std::stoul(optarg);
+        if (opts->n_threads == 0)
+          opts->n_threads = std::thread::hardware_concurrency();
+        break;
+      case 'a':
+        if (!parse_affinity(optarg, &opts->affinity)) {
+          std::cerr << "Invalid affinity policy: " << optarg << std::endl;
+          return false;
+        }
+        break;
+      case 'w':
+        opts->weak_scaling = true;
+        break;
+      case 'i':
+        if (!parse_io_backend(optarg, &opts->io)) {
+          std::cerr << "Invalid I/O backend: " << optarg << std::endl;
+          return false;
+        }
+        break;
+      case 'q':
+        opts->io_depth = std::stoul(optarg);
+        break;
+      case 'M':
+        if (!parse_memory_pool(optarg, &opts->memory_pool)) {
+          std::cerr << "Invalid memory pool: " << optarg << std::endl;
+          return false;
+        }
+        try {
+          get_memory_pool(*opts);
+        } catch (const std::invalid_argument &e) {
+          std::cerr << e.what() << std::endl;
+          return false;
+        }
+        break;
+      case 's':
+        opts->selection_cache_dir = optarg;
+        break;
+      case 'c':
+        opts->column_cache_dir = optarg;
+        break;
+      case 'S':
+        opts->column_cache_size = std::stoull(optarg) * 1024 * 1024;
+        break;
+      case 'm':
+        opts->metadata_cache_dir = optarg;
+        break;
+      case 'l':
+        opts->server_socket = optarg;
+        break;
+      case 'j':
+        opts->server_jobs = std::stoul(optarg);
+        break;
+      case 'L':
+        opts->storage_latency_ms = std::stod(optarg);
+        break;
+      case 'B':
+        opts->storage_bandwidth = std::stod(optarg);
+        break;
+      case 'R':
+        opts->storage_max_requests = std::stoul(optarg);
+        break;
+      case 'T':
+        opts->trace_path = optarg;
+        break;
+      case 'e':
+        opts->entry_list_path = optarg;
+        break;
+      case 'u':
+        if (!parse_unit_range(optarg, &opts->unit_range)) {
+          std::cerr << "Invalid unit range: " << optarg << std::endl;
+          return false;
+        }
+        break;
+      case 'P':
+        opts->partial = true;
+        break;
+      default:
+        return false;
+      }
+    } catch (const std::logic_error &) {
+      std::cerr << "Invalid value for option -" << static_cast<char>(c) << ": "
+                << optarg << std::endl;
+      return false;
+    }
+  }
+
+  // The entry list is split between the threads by entries, not by units
+  if (!opts->entry_list_path.empty() &&
+      opts->unit_range != AnalysisOptions().unit_range) {
+    std::cerr << "--unit-range cannot be combined with --entry-list"
+              << std::endl;
+    return false;
+  }
+  // The bytes fetched are counted from the read system calls of the fetching
+  // threads, which do not include the reads through io_uring
+  if (!opts->entry_list_path.empty() && opts->io == IoBackend::uring) {
+    std::cerr << "--io uring cannot be combined with --entry-list"
+              << std::endl;
+    return false;
+  }
+
+  // In server mode, the input is given per request
+  if (optind >= argc)
+    return !opts->server_socket.empty();
+  opts->input_path = argv[optind++];
+  if (optind < argc)
+    opts->histo_path = argv[optind++];
+  if (opts->partial && opts->histo_path.empty()) {
+    std::cerr << "--partial requires HISTO_PATH" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+void print_usage(const char *progname) {
+  printf("%s [OPTIONS] INPUT_PATH [HISTO_PATH]\n", progname);
+  printf("%s [OPTIONS] --listen SOCKET\n\n", progname);
+  printf("Options:\n");
+  printf("  -t, --threads N         number of analysis threads, 0 for all "
+         "cores (default: 1)\n");
+  printf("  -a, --affinity POLICY   pin threads: none, compact, scatter or "
+         "numa (default: none)\n");
+  printf("  -w, --weak-scaling      every thread processes the full input\n");
+  printf("  -i, --io BACKEND        ORC/Parquet file access: sync or uring "
+         "(default: sync)\n");
+  printf("  -q, --io-depth N        maximum number of reads in flight with "
+         "uring (default: 64)\n");
+  printf("  -M, --memory-pool POOL  Arrow buffer allocation: default, system, "
+         "jemalloc,\n"
+         "                          mimalloc, arena or arena-huge "
+         "(default: default)\n");
+  printf("  -s, --selection-cache DIR\n"
+         "                          reuse the event selection of previous "
+         "runs, cached in DIR\n");
+  printf("  -c, --column-cache DIR  cache decoded columns in DIR\n");
+  printf("  -S, --column-cache-size MB\n"
+         "                          size limit of the column cache "
+         "(default: 10240)\n");
+  printf("  -m, --metadata-cache DIR\n"
+         "                          cache the file metadata in DIR\n");
+  printf("  -l, --listen SOCKET     serve analysis requests on the Unix socket "
+         "SOCKET\n");
+  printf("  -j, --jobs N            number of requests served concurrently, 0 "
+         "for all cores (default: 0)\n");
+  printf("  -L, --latency MS        emulate remote storage with MS "
+         "milliseconds latency per read\n");
+  printf("  -B, --bandwidth MBPS    emulate remote storage with a bandwidth of "
+         "MBPS MB/s\n");
+  printf("  -R, --max-requests N    emulate remote storage that serves at most "
+         "N reads at a time\n");
+  printf("  -T, --trace FILE        record the reads from the input file in "
+         "FILE\n");
+  printf("  -e, --entry-list FILE   only fetch the entries listed in FILE, one "
+         "per line\n");
+  printf("  -u, --unit-range FIRST:[LAST]\n"
+         "                          only process the clusters, row groups or "
+         "stripes [FIRST, LAST)\n");
+  printf("  -P, --partial           write the histogram to HISTO_PATH as a ROOT "
+         "file, for merge\n");
+}
+
+UnitRange_t get_unit_range(std::int64_t nUnits, const WorkerSlice &slice) {
+  std::int64_t firstUnit = std::min(slice.units.first, nUnits);
+  std::int64_t lastUnit = std::min(slice.units.second, nUnits);
+  if (slice.weak_scaling)
+    return {firstUnit, lastUnit};
+
+  // Spread the remainder over the first workers, so that the shares differ by
+  // at most one unit
+  nUnits = lastUnit - firstUnit;
+  std::int64_t share = nUnits / slice.count;
+  std::int64_t rest = nUnits % slice.count;
+  std::int64_t first = firstUnit + slice.index * share +
+                       std::min<std::int64_t>(slice.index, rest);
+  std::int64_t last = first + share + (slice.index < rest ? 1 : 0);
+  return {first, last};
+}
+
+std::vector<std::uint64_t>
+get_cluster_boundaries(const ROOT::RNTupleDescriptor &desc) {
+  std::vector<std::uint64_t> boundaries;
+  for (const auto &cluster : desc.GetClusterIterable()) {
+    boundaries.push_back(cluster.GetFirstEntryIndex());
+  }
+  std::sort(boundaries.begin(), boundaries.end());
+  boundaries.push_back(desc.GetNEntries());
+  return boundaries;
+}
+
+static std::vector<int> parse_cpu_list(const std::string &cpuList) {
+  std::vector<int> cpus;
+  std::stringstream ss(cpuList);
+  std::string item;
+
+  while (std::getline(ss, item, ',')) {
+    if (item.empty())
+      continue;
+    auto idxDash = item.find('-');
+    int first = std::stoi(item.substr(0, idxDash));
+    int last = (idxDash == std::string::npos) ? first
+                                                : std::stoi(item.substr(idxDash + 1));
+    for (int cpu = first; cpu <= last; ++cpu)
+      cpus.push_back(cpu);
+  }
+
+  return cpus;
+}
+
+// Returns the CPUs this process may run on, grouped by NUMA node. Machines
+// without NUMA information in sysfs are treated as a single node.
+static std::vector<std::vector<int>> get_numa_nodes() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+
+  std::vector<std::pair<int, std::vector<int>>> nodes;
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+    auto name = entry.path().filename().string();
+    if (name.rfind("node", 0) != 0 ||
+        name.find_first_not_of("0123456789", 4) != std::string::npos ||
+        name.size() == 4)
+      continue;
+
+    std::ifstream fs(entry.path() / "cpulist");
+    std::string cpuList;
+    fs >> cpuList;
+
+    std::vector<int> cpus;
+    for (auto cpu : parse_cpu_list(cpuList)) {
+      if (CPU_ISSET(cpu, &allowed))
+        cpus.push_back(cpu);
+    }
+    if (!cpus.empty())
+      nodes.emplace_back(std::stoi(name.substr(4)), cpus);
+  }
+  std::sort(nodes.begin(), nodes.end());
+
+  std::vector<std::vector<int>> result;
+  for (auto &node : nodes)
+    result.emplace_back(std::move(node.second));
+
+  if (result.empty()) {
+    result.emplace_back();
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed))
+        result.back().push_back(cpu);
+    }
+  }
+
+  return result;
+}
+
+static std::vector<cpu_set_t> get_affinity_masks(AffinityPolicy policy,
+                                                 unsigned nThreads) {
+  auto nodes = get_numa_nodes();
+  std::vector<int> allCpus;
+  for (const auto &node : nodes)
+    allCpus.insert(allCpus.end(), node.begin(), node.end());
+
+  std::vector<cpu_set_t> masks(nThreads);
+  for (unsigned i = 0; i < nThreads; ++i) {
+    CPU_ZERO(&masks[i]);
+    switch (policy) {
+    case AffinityPolicy::none:
+      for (auto cpu : allCpus)
+        CPU_SET(cpu, &masks[i]);
+      break;
+    case AffinityPolicy::compact:
+      CPU_SET(allCpus[i % allCpus.size()], &masks[i]);
+      break;
+    case AffinityPolicy::scatter: {
+      const auto &node = nodes[i % nodes.size()];
+      CPU_SET(node[(i / nodes.size()) % node.size()], &masks[i]);
+    } break;
+    case AffinityPolicy::numa:
+      for (auto cpu : nodes[i % nodes.size()])
+        CPU_SET(cpu, &masks[i]);
+      break;
+    }
+  }
+
+  return masks;
+}
+
+ThreadPool::ThreadPool(unsigned nThreads) {
+  for (unsigned i = 0; i < std::max(nThreads, 1u); ++i)
+    fThreads.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(fLock);
+    fStopping = true;
+  }
+  fCond.notify_all();
+  for (auto &t : fThreads)
+    t.join();
+}
+
+void ThreadPool::Run(const std::vector<std::function<void()>> &tasks) {
+  std::mutex doneLock;
+  std::condition_variable doneCond;
+  std::size_t nDone = 0;
+  std::exception_ptr error;
+
+  {
+    std::lock_guard<std::mutex> guard(fLock);
+    for (const auto &task : tasks) {
+      fTasks.emplace_back([&, task]() {
+        std::exception_ptr taskError;
+        try {
+          task();
+        } catch (...) {
+          taskError = std::current_exception();
+        }
+        std::lock_guard<std::mutex> doneGuard(doneLock);
+        if (taskError && !error)
+          error = taskError;
+        if (++nDone == tasks.size())
+          doneCond.notify_one();
+      });
+    }
+  }
+  fCond.notify_all();
+
+  std::unique_lock<std::mutex> doneGuard(doneLock);
+  doneCond.wait(doneGuard, [&]() { return nDone == tasks.size(); });
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void ThreadPool::Work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(fLock);
+      fCond.wait(lock, [this]() { return fStopping || !fTasks.empty(); });
+      if (fTasks.empty())
+        return;
+      task = std::move(fTasks.front());
+      fTasks.pop_front();
+    }
+    task();
+  }
+}
+
+AnalysisTime_t run_analysis(const AnalysisOptions &opts,
+                            const AnalysisFn_t &analysis, TH1D *hist,
+                            ThreadPool *threadPool) {
+  if (!threadPool && opts.n_threads <= 1 &&
+      opts.affinity == AffinityPolicy::none)
+    return analysis(WorkerSlice{0, 1, false, opts.unit_range}, hist);
+
+  ROOT::EnableThreadSafety();
+
+  auto nThreads = std::max(opts.n_threads, 1u);
+  auto masks = get_affinity_masks(opts.affinity, nThreads);
+
+  // Every thread fills its own copy of the histogram, they are merged at the
+  // end
+  std::vector<std::unique_ptr<TH1D>> threadHists;
+  for (unsigned i = 0; i < nThreads; ++i) {
+    threadHists.emplace_back(static_cast<TH1D *>(hist->Clone()));
+    threadHists.back()->SetDirectory(nullptr);
+  }
+
+  std::vector<AnalysisTime_t> threadTimes(nThreads);
+  std::vector<std::function<void()>> slices;
+  for (unsigned i = 0; i < nThreads; ++i) {
+    slices.emplace_back([&, i]() {
+      // Pool threads go back to their previous placement afterwards
+      cpu_set_t previous;
+      bool pinned = opts.affinity != AffinityPolicy::none;
+      if (pinned) {
+        pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &previous);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &masks[i]);
+      }
+      WorkerSlice slice{i, nThreads, opts.weak_scaling, opts.unit_range};
+      try {
+        threadTimes[i] = analysis(slice, threadHists[i].get());
+      } catch (...) {
+        if (pinned)
+          pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &previous);
+        throw;
+      }
+      if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &previous);
+    });
+  }
+
+  auto ts_start = std::chrono::steady_clock::now();
+  if (threadPool) {
+    threadPool->Run(slices);
+  } else {
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(nThreads);
+    for (unsigned i = 0; i < nThreads; ++i) {
+      threads.emplace_back([&, i]() {
+        try {
+          slices[i]();
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    for (auto &t : threads)
+      t.join();
+    for (const auto &error : errors) {
+      if (error)
+        std::rethrow_exception(error);
+    }
+  }
+  auto ts_end = std::chrono::steady_clock::now();
+
+  for (const auto &h : threadHists)
+    hist->Add(h.get());
+
+  // The init phase ends when the slowest thread has opened its input, all
+  // remaining wall-clock time is attributed to the analysis
+  std::uint64_t runtime_init = 0;
+  for (const auto &t : threadTimes)
+    runtime_init = std::max(runtime_init, t.first);
+  std::uint64_t runtime_total =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_start)
+          .count();
+
+  return std::make_pair(runtime_init,
+                        runtime_total - std::min(runtime_init, runtime_total));
+}
+
+std::shared_ptr<StorageThrottle>
+get_storage_throttle(const AnalysisOptions &opts) {
+  return StorageThrottle::Get(opts.storage_latency_ms, opts.storage_bandwidth,
+                              opts.storage_max_requests);
+}
+
+std::shared_ptr<ReadTrace> get_read_trace(const AnalysisOptions &opts) {
+  return ReadTrace::Get(opts.trace_path);
+}
+
+std::shared_ptr<arrow::io::RandomAccessFile>
+open_input_file(const std::string &path, const AnalysisOptions &opts) {
+  arrow::MemoryPool *pool = get_memory_pool(opts);
+
+  std::shared_ptr<arrow::io::RandomAccessFile> file;
+  switch (opts.io) {
+  case IoBackend::sync: {
+    PARQUET_ASSIGN_OR_THROW(file, arrow::io::ReadableFile::Open(path, pool));
+    break;
+  }
+  case IoBackend::uring: {
+#ifdef HAVE_LIBURING
+    PARQUET_ASSIGN_OR_THROW(file, UringFile::Open(path, opts.io_depth, pool));
+    break;
+#else
+    throw std::runtime_error("built without io_uring support");
+#endif
+  }
+  }
+
+  if (auto throttle = get_storage_throttle(opts))
+    file = std::make_shared<ThrottledFile>(std::move(file), throttle);
+  if (auto trace = get_read_trace(opts))
+    file = std::make_shared<TracingFile>(std::move(file), trace);
+  return file;
+}
+
+parquet::ArrowReaderProperties
+get_arrow_reader_properties(const AnalysisOptions &opts) {
+  auto properties = parquet::default_arrow_reader_properties();
+  if (opts.io == IoBackend::uring) {
+    // Issue the reads for all column chunks of a row group at once, instead of
+    // lazily when a column is decoded
+    properties.set_pre_buffer(true);
+    properties.set_cache_options(arrow::io::CacheOptions::Defaults());
+  }
+  return properties;
+}
+
+std::shared_ptr<arrow::Table> open_arrow(const std::string &input_path,
+                                         FileFormat fmt,
+                                         const AnalysisOptions &opts) {
+  arrow::MemoryPool *pool = get_memory_pool(opts);
   std::shared_ptr<arrow::io::RandomAccessFile> input =
-      arrow::io::ReadableFile::Open(input_path.c_str()).ValueOrDie();
+      open_input_file(input_path, opts);
 
   if (fmt == FileFormat::orc){
     // Open ORC file reader
-    auto maybe_reader = arrow::adapters::orc::ORCFileReader::Open(input, pool);
-    auto &reader = maybe_reader.ValueOrDie();
+    std::unique_ptr<arrow::adapters::orc::ORCFileReader> reader;
+    PARQUET_ASSIGN_OR_THROW(
+        reader, arrow::adapters::orc::ORCFileReader::Open(input, pool));
 
     // Read entire file as a single Arrow table
-    auto maybe_table = reader->Read();
-    std::shared_ptr<arrow::Table> table = maybe_table.ValueOrDie();
+    std::shared_ptr<arrow::Table> table;
+    PARQUET_ASSIGN_OR_THROW(table, reader->Read());
     return table;
   } else if (fmt == FileFormat::parquet) {
     // Open Parquet file reader
+    parquet::arrow::FileReaderBuilder reader_builder;
+    PARQUET_THROW_NOT_OK(reader_builder.Open(input));
+    reader_builder.memory_pool(pool);
+    reader_builder.properties(get_arrow_reader_properties(opts));
     std::unique_ptr<parquet::arrow::FileReader> reader;
-    PARQUET_THROW_NOT_OK(parquet::arrow::OpenFile(input, pool, &reader));
+    PARQUET_THROW_NOT_OK(reader_builder.Build(&reader));
+    if (auto trace = get_read_trace(opts))
+      add_parquet_column_ranges(*trace, *reader->parquet_reader()->metadata());
 
     // Read entire file as a single Arrow table
     std::shared_ptr<arrow::Table> table;
@@ -85,6 +689,152 @@ std::shared_ptr<arrow::Table> open_arrow(const std::string &input_path, FileForm
   return nullptr;
 }
 
+std::unique_ptr<ROOT::RNTupleReader>
+open_rntuple(std::string_view ntupleName, std::string_view path,
+             const AnalysisOptions &opts, MetadataCache *metadataCache,
+             const ROOT::RNTupleReadOptions &readOptions) {
+  auto throttle = get_storage_throttle(opts);
+  auto trace = get_read_trace(opts);
+  if (!metadataCache && !throttle && !trace)
+    return ROOT::RNTupleReader::Open(ntupleName, path, readOptions);
+
+  // Only the outermost of the throttled and tracing files buffers, so that
+  // the wrappers see the actual requests to the storage
+  ROOT::Internal::RRawFile::ROptions unbuffered;
+  unbuffered.fBlockSize = 0;
+  auto rawFile = ROOT::Internal::RRawFile::Create(
+      path, throttle || trace ? unbuffered
+                              : ROOT::Internal::RRawFile::ROptions());
+  if (throttle) {
+    rawFile = std::make_unique<ThrottledRawFile>(
+        std::move(rawFile), throttle,
+        trace ? unbuffered : ROOT::Internal::RRawFile::ROptions());
+  }
+  if (trace) {
+    rawFile = std::make_unique<TracingRawFile>(
+        std::move(rawFile), trace, ROOT::Internal::RRawFile::ROptions());
+  }
+
+  MetadataCachingRawFile *cachingFile = nullptr;
+  if (metadataCache) {
+    auto wrapped = metadataCache->WrapRawFile(std::move(rawFile));
+    cachingFile = wrapped.get();
+    rawFile = std::move(wrapped);
+  }
+
+  auto pageSource = std::make_unique<ROOT::Internal::RPageSourceFile>(
+      ntupleName, std::move(rawFile), readOptions);
+  // Creating the reader attaches the page source, which reads the anchor,
+  // header, footer and page lists
+  auto reader =
+      ROOT::Internal::CreateRNTupleReader(std::move(pageSource), readOptions);
+  if (cachingFile)
+    cachingFile->StopRecording();
+  if (trace)
+    add_rntuple_column_ranges(*trace, reader->GetDescriptor());
+  return reader;
+}
+
+template <typename T>
+static std::shared_ptr<arrow::Array>
+read_rntuple_values(ROOT::RNTupleReader &reader, const std::string &fieldName,
+                    std::uint64_t firstEntry, std::uint64_t lastEntry) {
+  using ArrowType = typename RootConversionTraits<T>::ArrowType;
+
+  typename arrow::TypeTraits<ArrowType>::BuilderType builder;
+  PARQUET_THROW_NOT_OK(builder.Reserve(lastEntry - firstEntry));
+  auto view = reader.GetView<T>(fieldName);
+  for (auto i = firstEntry; i < lastEntry; ++i) {
+    builder.UnsafeAppend(view(i));
+  }
+  std::shared_ptr<arrow::Array> array;
+  PARQUET_ASSIGN_OR_THROW(array, builder.Finish());
+  return array;
+}
+
+template <typename T>
+static std::shared_ptr<arrow::Array>
+read_rntuple_collection(ROOT::RNTupleReader &reader,
+                        const std::string &fieldName, std::uint64_t firstEntry,
+                        std::uint64_t lastEntry) {
+  using ArrowType = typename RootConversionTraits<T>::ArrowType;
+  using BuilderType = typename arrow::TypeTraits<ArrowType>::BuilderType;
+
+  auto valueBuilder = std::make_shared<BuilderType>();
+  arrow::ListBuilder builder(arrow::default_memory_pool(), valueBuilder);
+  auto view = reader.GetView<ROOT::RVec<T>>(fieldName);
+  for (auto i = firstEntry; i < lastEntry; ++i) {
+    const auto &values = view(i);
+    PARQUET_THROW_NOT_OK(builder.Append());
+    if constexpr (std::is_same_v<T, bool>) {
+      // Booleans are stored as a bitmap, append them one by one
+      PARQUET_THROW_NOT_OK(valueBuilder->Reserve(values.size()));
+      for (auto value : values)
+        valueBuilder->UnsafeAppend(value);
+    } else {
+      PARQUET_THROW_NOT_OK(
+          valueBuilder->AppendValues(values.data(), values.size()));
+    }
+  }
+  std::shared_ptr<arrow::Array> array;
+  PARQUET_ASSIGN_OR_THROW(array, builder.Finish());
+  return array;
+}
+
+std::shared_ptr<arrow::RecordBatch>
+read_rntuple_batch(ROOT::RNTupleReader &reader,
+                   const std::vector<std::string> &fieldNames,
+                   std::uint64_t firstEntry, std::uint64_t lastEntry) {
+  const auto &desc = reader.GetDescriptor();
+
+  arrow::FieldVector fields;
+  arrow::ArrayVector arrays;
+  for (const auto &fieldName : fieldNames) {
+    const auto &typeName =
+        desc.GetFieldDescriptor(desc.FindFieldId(fieldName)).GetTypeName();
+    auto valueType = get_collection_value_type(typeName);
+
+    std::shared_ptr<arrow::Array> array;
+    visit_root_type(valueType.empty() ? typeName : valueType, [&](auto tag) {
+      using T = typename decltype(tag)::Type;
+      array = valueType.empty()
+                  ? read_rntuple_values<T>(reader, fieldName, firstEntry,
+                                           lastEntry)
+                  : read_rntuple_collection<T>(reader, fieldName, firstEntry,
+                                               lastEntry);
+    });
+
+    if (!array)
+      throw std::runtime_error("unsupported type " + typeName + " of field " +
+                               fieldName);
+    fields.push_back(arrow::field(fieldName, array->type()));
+    arrays.push_back(std::move(array));
+  }
+
+  return arrow::RecordBatch::Make(arrow::schema(fields),
+                                  lastEntry - firstEntry, arrays);
+}
+
+std::string_view get_collection_value_type(std::string_view typeName) {
+  for (std::string_view prefix : {"ROOT::VecOps::RVec<", "std::vector<"}) {
+    if (typeName.size() > prefix.size() &&
+        typeName.substr(0, prefix.size()) == prefix &&
+        typeName.back() == '>')
+      return typeName.substr(prefix.size(),
+                             typeName.size() - prefix.size() - 1);
+  }
+  return {};
+}
+
+int get_leaf_column(const parquet::SchemaDescriptor &schema,
+                    const std::string &name) {
+  for (int column = 0; column < schema.num_columns(); ++column) {
+    if (schema.Column(column)->path()->ToDotVector()[0] == name)
+      return column;
+  }
+  throw std::runtime_error("column " + name + " not found");
+}
+
 void save_histogram(TH1D *hist, const std::string &output_path) {
   gErrorIgnoreLevel = kWarning;
   auto c = TCanvas("c", "", 800, 700);
@@ -94,3 +844,21 @@ void save_histogram(TH1D *hist, const std::string &output_path) {
   c.Update();
   c.SaveAs(output_path.c_str());
 }
+
+void save_partial_histogram(TH1D *hist, const std::string &output_path,
+                            const UnitRange_t &units,
+                            const AnalysisTime_t &runtime) {
+  std::unique_ptr<TFile> file(TFile::Open(output_path.c_str(), "RECREATE"));
+  if (!file || file->IsZombie())
+    throw std::runtime_error("could not create " + output_path);
+  file->WriteObject(hist, hist->GetName());
+  auto write_parameter = [&](const char *name, Long64_t value) {
+    TParameter<Long64_t> parameter(name, value);
+    file->WriteObject(&parameter, name);
+  };
+  write_parameter("first_unit", units.first);
+  write_parameter("last_unit", units.second);
+  write_parameter("runtime_init", runtime.first);
+  write_parameter("runtime_analyze", runtime.second);
+  file->Close();
+}
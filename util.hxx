@@ -1,10 +1,31 @@
 #ifndef UTIL__HXX
 #define UTIL__HXX
 
+#include <ROOT/RNTupleDescriptor.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleView.hxx>
 #include <ROOT/RVec.hxx>
 #include <arrow/io/api.h>
+#include <parquet/properties.h>
+#include <parquet/schema.h>
 
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <memory>
 #include <iostream>
@@ -14,9 +35,129 @@
 #include <arrow/api.h>
 
 using AnalysisTime_t = std::pair<std::uint64_t, std::uint64_t>;
+// Half-open range [first, second) of clusters, row groups or stripes
+using UnitRange_t = std::pair<std::int64_t, std::int64_t>;
 
 enum class FileFormat { rntuple, orc, parquet };
 
+// How analysis threads are pinned to CPUs
+enum class AffinityPolicy {
+  none,    // leave placement to the OS scheduler
+  compact, // fill the CPUs of one NUMA node before moving to the next
+  scatter, // distribute threads round-robin over the NUMA nodes
+  numa     // bind each thread to all CPUs of a NUMA node, round-robin
+};
+
+// How the Arrow-based readers access the input file
+enum class IoBackend {
+  sync, // arrow::io::ReadableFile, one pread per request
+  uring // UringFile, batched asynchronous reads through io_uring
+};
+
+// Where the Arrow-based readers allocate their buffers, see get_memory_pool
+enum class MemoryPoolBackend {
+  arrow,     // arrow::default_memory_pool()
+  system,    // malloc
+  jemalloc,  // if Arrow was built with it
+  mimalloc,  // if Arrow was built with it
+  arena,     // ArenaMemoryPool, recycles the buffers between units
+  arena_huge // ArenaMemoryPool backed by transparent huge pages
+};
+
+struct AnalysisOptions {
+  std::string input_path;
+  std::string histo_path;
+  unsigned n_threads = 1;
+  // Every thread processes the full input instead of a share of it
+  bool weak_scaling = false;
+  AffinityPolicy affinity = AffinityPolicy::none;
+  IoBackend io = IoBackend::sync;
+  unsigned io_depth = 64;
+  MemoryPoolBackend memory_pool = MemoryPoolBackend::arrow;
+  // Directory of the selection cache, disabled if empty
+  std::string selection_cache_dir;
+  // Directory of the decoded column cache, disabled if empty
+  std::string column_cache_dir;
+  std::uint64_t column_cache_size = 10ULL * 1024 * 1024 * 1024;
+  // Directory of the file metadata cache, disabled if empty
+  std::string metadata_cache_dir;
+  // Unix socket to serve analysis requests on, see AnalysisServer
+  std::string server_socket;
+  // Number of requests served concurrently, 0 for all cores
+  unsigned server_jobs = 0;
+  // Emulated remote storage, see StorageThrottle. Disabled if all are zero.
+  double storage_latency_ms = 0;
+  double storage_bandwidth = 0; // MB/s
+  unsigned storage_max_requests = 0;
+  // File to record the storage reads in, see ReadTrace. Disabled if empty.
+  std::string trace_path;
+  // Entries to fetch instead of scanning the input, see fetch_entries. Disabled
+  // if empty.
+  std::string entry_list_path;
+  // Only the units in this range are processed, e.g. one share of a work plan
+  // made by `partition`
+  UnitRange_t unit_range{0, std::numeric_limits<std::int64_t>::max()};
+  // Write the histogram and the run times to histo_path as a ROOT file, to be
+  // combined by `merge`
+  bool partial = false;
+};
+
+// The share of the input units processed by one analysis thread
+struct WorkerSlice {
+  unsigned index = 0;
+  unsigned count = 1;
+  bool weak_scaling = false;
+  // Units shared by the threads, clipped to the number of units of the input
+  UnitRange_t units{0, std::numeric_limits<std::int64_t>::max()};
+};
+
+class ColumnCache;
+class MetadataCache;
+class ReaderPool;
+class ReadTrace;
+class SelectionCache;
+class StorageThrottle;
+
+// Optional caches shared by all analysis threads
+struct AnalysisCaches {
+  SelectionCache *selection = nullptr;
+  ColumnCache *column = nullptr;
+  MetadataCache *metadata = nullptr;
+  ReaderPool *readers = nullptr;
+};
+
+// Fixed set of threads that runs the analysis slices of all requests of the
+// analysis server, instead of starting new threads for every request
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned nThreads);
+  ~ThreadPool();
+
+  // Runs the tasks and waits until all of them are done. Rethrows the first
+  // exception thrown by a task.
+  void Run(const std::vector<std::function<void()>> &tasks);
+
+private:
+  void Work();
+
+  std::mutex fLock;
+  std::condition_variable fCond;
+  std::deque<std::function<void()>> fTasks;
+  bool fStopping = false;
+  std::vector<std::thread> fThreads;
+};
+
+// What the analysis server keeps between requests, see AnalysisServer. All
+// members are optional.
+struct ResidentState {
+  MetadataCache *metadata = nullptr;
+  ReaderPool *readers = nullptr;
+  ThreadPool *threads = nullptr;
+};
+
+using AnalysisFn_t =
+    std::function<AnalysisTime_t(const WorkerSlice &slice, TH1D *hist)>;
+
 void split_path(std::string_view path, std::string *basename,
                 std::string *suffix);
 std::string get_path_suffix(std::string_view path);
@@ -25,9 +166,56 @@ FileFormat get_file_format(std::string_view suffix);
 
 std::vector<std::string> get_column_names(const std::string &basename);
 
-std::shared_ptr<arrow::Table> open_arrow(const std::string &input_path, FileFormat fmt);
+bool parse_options(int argc, char **argv, AnalysisOptions *opts);
+void print_usage(const char *progname);
+
+UnitRange_t get_unit_range(std::int64_t nUnits, const WorkerSlice &slice);
+std::vector<std::uint64_t>
+get_cluster_boundaries(const ROOT::RNTupleDescriptor &desc);
+
+// Runs the slices of the analysis on opts.n_threads threads, or as tasks of the
+// thread pool if given
+AnalysisTime_t run_analysis(const AnalysisOptions &opts,
+                            const AnalysisFn_t &analysis, TH1D *hist,
+                            ThreadPool *threadPool = nullptr);
+
+// Returns nullptr unless remote storage is emulated
+std::shared_ptr<StorageThrottle>
+get_storage_throttle(const AnalysisOptions &opts);
+// Returns nullptr unless reads are traced
+std::shared_ptr<ReadTrace> get_read_trace(const AnalysisOptions &opts);
+
+std::shared_ptr<arrow::io::RandomAccessFile>
+open_input_file(const std::string &path, const AnalysisOptions &opts);
+parquet::ArrowReaderProperties
+get_arrow_reader_properties(const AnalysisOptions &opts);
+
+std::shared_ptr<arrow::Table>
+open_arrow(const std::string &input_path, FileFormat fmt,
+           const AnalysisOptions &opts = AnalysisOptions());
+
+// Opens the RNTuple, serving the metadata from the cache if given
+std::unique_ptr<ROOT::RNTupleReader>
+open_rntuple(std::string_view ntupleName, std::string_view path,
+             const AnalysisOptions &opts,
+             MetadataCache *metadataCache = nullptr,
+             const ROOT::RNTupleReadOptions &readOptions =
+                 ROOT::RNTupleReadOptions());
+
+// Reads the given fields of the entry range [firstEntry, lastEntry) into a
+// record batch. Supports fields of fixed-width numbers and RVecs or
+// std::vectors thereof.
+std::shared_ptr<arrow::RecordBatch>
+read_rntuple_batch(ROOT::RNTupleReader &reader,
+                   const std::vector<std::string> &fieldNames,
+                   std::uint64_t firstEntry, std::uint64_t lastEntry);
 
 void save_histogram(TH1D *hist, const std::string &output_path);
+// Writes the histogram of a partial run to a ROOT file, together with the unit
+// range and the run times, see merge
+void save_partial_histogram(TH1D *hist, const std::string &output_path,
+                            const UnitRange_t &units,
+                            const AnalysisTime_t &runtime);
 
 template <typename T>
 struct RootConversionTraits {};
@@ -36,6 +224,7 @@ struct RootConversionTraits {};
    template <>                                         \
    struct RootConversionTraits<c_type> {               \
    using ArrowType = ::arrow::ArrowType_;              \
+   static constexpr const char *kTypeName = #c_type;   \
    };
 
 ROOT_ARROW_STL_CONVERSION(bool, BooleanType)
@@ -51,6 +240,60 @@ ROOT_ARROW_STL_CONVERSION(float, FloatType)
 ROOT_ARROW_STL_CONVERSION(double, DoubleType)
 ROOT_ARROW_STL_CONVERSION(std::string, StringType)
 
+template <typename T>
+struct TypeTag {
+  using Type = T;
+};
+
+// The number types that columns (or the elements of list columns) can have
+template <typename... Ts>
+struct TypeList {};
+using NumberTypes_t =
+    TypeList<bool, std::int8_t, std::int16_t, std::int32_t, std::int64_t,
+             std::uint8_t, std::uint16_t, std::uint32_t, std::uint64_t, float,
+             double>;
+
+template <typename... Ts, typename MatchT, typename VisitorT>
+bool visit_number_type(TypeList<Ts...>, const MatchT &match,
+                       VisitorT &&visitor) {
+  return ((match(TypeTag<Ts>{}) ? (visitor(TypeTag<Ts>{}), true) : false) ||
+          ...);
+}
+
+// Calls visitor(TypeTag<T>{}) for the number type T with the given ROOT type
+// name (e.g. std::int32_t) or Arrow type id. Returns false for other types.
+template <typename VisitorT>
+bool visit_root_type(std::string_view typeName, VisitorT &&visitor) {
+  return visit_number_type(
+      NumberTypes_t{},
+      [&](auto tag) {
+        using T = typename decltype(tag)::Type;
+        return typeName == RootConversionTraits<T>::kTypeName;
+      },
+      std::forward<VisitorT>(visitor));
+}
+
+template <typename VisitorT>
+bool visit_arrow_type(arrow::Type::type typeId, VisitorT &&visitor) {
+  return visit_number_type(
+      NumberTypes_t{},
+      [&](auto tag) {
+        using T = typename decltype(tag)::Type;
+        return typeId == RootConversionTraits<T>::ArrowType::type_id;
+      },
+      std::forward<VisitorT>(visitor));
+}
+
+// The element type name of a ROOT::VecOps::RVec or std::vector type name, or
+// an empty string for other types
+std::string_view get_collection_value_type(std::string_view typeName);
+
+// Index of the Parquet leaf column of a top-level field. All columns are
+// either flat or lists of numbers, so every field maps to a single leaf
+// column. Throws std::runtime_error if there is no such field.
+int get_leaf_column(const parquet::SchemaDescriptor &schema,
+                    const std::string &name);
+
 template <typename T>
 void fill_vector_from_arrow(std::int32_t entryId, const arrow::ListArray &src, ROOT::RVec<T> &dest) {
   using ArrowType = typename RootConversionTraits<T>::ArrowType;
@@ -62,6 +305,469 @@ void fill_vector_from_arrow(std::int32_t entryId, const arrow::ListArray &src, R
   std::swap(tmp, dest);
 }
 
+// The RVec adopts the memory of the column, so it must not outlive the batch
+template <typename T>
+ROOT::RVec<T> get_values(const arrow::RecordBatch &batch, const std::string &name) {
+  using ArrowType = typename RootConversionTraits<T>::ArrowType;
+  using ArrayType = typename arrow::TypeTraits<ArrowType>::ArrayType;
+
+  auto array = std::static_pointer_cast<ArrayType>(batch.GetColumnByName(name));
+  return ROOT::RVec<T>(const_cast<T *>(array->raw_values()), array->length());
+}
+
+// Values of an integer column kept as indices into its dictionary, see
+// read_dictionary_column
+struct DictionaryColumn {
+  std::vector<std::int32_t> dictionary;
+  // One index per value
+  std::vector<std::int32_t> indices;
+  // For list columns, the values of entry i are [offsets[i], offsets[i + 1]);
+  // empty for flat columns
+  std::vector<std::int32_t> offsets;
+};
+
+// Evaluates the cut once per dictionary entry. The result is indexed like the
+// dictionary.
+template <typename CutT>
+std::vector<char> evaluate_on_dictionary(const DictionaryColumn &column,
+                                         const CutT &cut) {
+  std::vector<char> result;
+  result.reserve(column.dictionary.size());
+  for (auto value : column.dictionary)
+    result.push_back(cut(value));
+  return result;
+}
+
+// Typed access to the columns of an analysis kernel. The columns are described
+// once by a Schema, and ArrowBatch and RNTupleBatch give access to them with
+// the same interface. A kernel written as a template over the batch type is
+// thus compiled to specialized code for every format, and the column names are
+// resolved once per file instead of once per unit.
+
+// Number columns are accessed by value, list columns (ROOT::RVec) as a range of
+// their elements with size() and operator[]
+template <typename T>
+struct ColumnTraits {
+  using Element_t = T;
+  static constexpr bool kIsList = false;
+};
+
+template <typename T>
+struct ColumnTraits<ROOT::RVec<T>> {
+  using Element_t = T;
+  static constexpr bool kIsList = true;
+};
+
+// The columns of a kernel and the C++ types Ts of their values. Columns are
+// identified by their position in Ts.
+template <typename... Ts>
+class Schema {
+public:
+  static constexpr std::size_t kNColumns = sizeof...(Ts);
+
+  explicit Schema(std::array<std::string, kNColumns> names)
+      : fNames(std::move(names)) {}
+
+  const std::string &GetName(std::size_t column) const {
+    return fNames[column];
+  }
+  std::vector<std::string> GetNames() const {
+    return {fNames.begin(), fNames.end()};
+  }
+
+  static std::vector<std::size_t> GetAllColumns() {
+    std::vector<std::size_t> columns(kNColumns);
+    std::iota(columns.begin(), columns.end(), 0);
+    return columns;
+  }
+
+private:
+  std::array<std::string, kNColumns> fNames;
+};
+
+// Bit mask of the given columns, e.g. for the dictionary columns of ArrowBatch
+constexpr std::uint64_t
+get_column_mask(std::initializer_list<std::size_t> columns) {
+  std::uint64_t mask = 0;
+  for (auto column : columns)
+    mask |= std::uint64_t(1) << column;
+  return mask;
+}
+
+template <typename T>
+bool has_arrow_type(const arrow::DataType &type) {
+  if constexpr (ColumnTraits<T>::kIsList) {
+    return type.id() == arrow::Type::LIST &&
+           has_arrow_type<typename ColumnTraits<T>::Element_t>(
+               *static_cast<const arrow::ListType &>(type).value_type());
+  } else {
+    return type.id() == RootConversionTraits<T>::ArrowType::type_id;
+  }
+}
+
+template <typename SchemaT>
+class ArrowBinding;
+
+// Positions of some of the columns of a schema in the record batches read for
+// them. Given the Arrow schema of the file, the columns are put in file order,
+// which is the order in which the ORC reader returns them (and the Parquet
+// reader and the column cache return them in the order requested), and their
+// types are checked. Throws std::runtime_error if a column is missing or has a
+// different type.
+template <typename... Ts>
+class ArrowBinding<Schema<Ts...>> {
+public:
+  ArrowBinding(const Schema<Ts...> &schema, std::vector<std::size_t> columns,
+               const arrow::Schema *fileSchema = nullptr) {
+    fPositions.fill(-1);
+    std::vector<int> fieldIndices;
+    for (auto column : columns) {
+      auto index = fileSchema ? fileSchema->GetFieldIndex(schema.GetName(column))
+                              : 0;
+      if (index < 0)
+        throw std::runtime_error("column " + schema.GetName(column) +
+                                 " not found");
+      fieldIndices.push_back(index);
+    }
+    if (fileSchema) {
+      std::vector<std::size_t> order(columns.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+        return fieldIndices[a] < fieldIndices[b];
+      });
+      for (auto i : order) {
+        fFieldIndices.push_back(fieldIndices[i]);
+        CheckType(schema, columns[i], *fileSchema->field(fieldIndices[i])->type());
+      }
+      std::vector<std::size_t> sorted;
+      for (auto i : order)
+        sorted.push_back(columns[i]);
+      columns = std::move(sorted);
+    }
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+      fPositions[columns[i]] = i;
+      fColumnNames.push_back(schema.GetName(columns[i]));
+    }
+  }
+
+  // In batch order
+  const std::vector<std::string> &GetColumnNames() const {
+    return fColumnNames;
+  }
+  // The field indices in the file, in batch order. Only with the file schema.
+  const std::vector<int> &GetFieldIndices() const { return fFieldIndices; }
+  // -1 if the column is not bound
+  int GetPosition(std::size_t column) const { return fPositions[column]; }
+
+private:
+  static void CheckType(const Schema<Ts...> &schema, std::size_t column,
+                        const arrow::DataType &type) {
+    if (!HasType(column, type, std::index_sequence_for<Ts...>{})) {
+      throw std::runtime_error("column " + schema.GetName(column) +
+                               " has unexpected type " + type.ToString());
+    }
+  }
+  template <std::size_t... Is>
+  static bool HasType(std::size_t column, const arrow::DataType &type,
+                      std::index_sequence<Is...>) {
+    return ((Is == column && has_arrow_type<Ts>(type)) || ...);
+  }
+
+  std::array<int, sizeof...(Ts)> fPositions;
+  std::vector<std::string> fColumnNames;
+  std::vector<int> fFieldIndices;
+};
+
+template <typename SchemaT>
+ArrowBinding(const SchemaT &, std::vector<std::size_t>,
+             const arrow::Schema * = nullptr) -> ArrowBinding<SchemaT>;
+
+// The values of an entry of a list column, in place in the buffers of the batch
+template <typename T>
+class ValueRange {
+public:
+  ValueRange() = default;
+  ValueRange(const T *values, std::size_t size)
+      : fValues(values), fSize(size) {}
+
+  std::size_t size() const { return fSize; }
+  const T &operator[](std::size_t i) const { return fValues[i]; }
+  const T *begin() const { return fValues; }
+  const T *end() const { return fValues + fSize; }
+
+private:
+  const T *fValues = nullptr;
+  std::size_t fSize = 0;
+};
+
+// The values of an entry of a dictionary-encoded list column
+template <typename T>
+class DictionaryRange {
+public:
+  DictionaryRange(const std::int32_t *dictionary, const std::int32_t *indices,
+                  std::size_t size)
+      : fDictionary(dictionary), fIndices(indices), fSize(size) {}
+
+  std::size_t size() const { return fSize; }
+  T operator[](std::size_t i) const { return fDictionary[fIndices[i]]; }
+  std::int32_t GetIndex(std::size_t i) const { return fIndices[i]; }
+
+private:
+  const std::int32_t *fDictionary;
+  const std::int32_t *fIndices;
+  std::size_t fSize;
+};
+
+template <typename SchemaT, std::uint64_t kDictionaryColumns = 0>
+class ArrowBatch;
+
+// Typed access to a record batch read for an ArrowBinding, directly on the
+// buffers of its arrays. The int32 columns in kDictionaryColumns are not part
+// of the batch but are read from a DictionaryColumn instead.
+template <typename... Ts, std::uint64_t kDictionaryColumns>
+class ArrowBatch<Schema<Ts...>, kDictionaryColumns> {
+public:
+  ArrowBatch(const ArrowBinding<Schema<Ts...>> &binding,
+             const arrow::RecordBatch &batch)
+      : fNEntries(batch.num_rows()) {
+    BindAll(binding, batch, std::index_sequence_for<Ts...>{});
+  }
+
+  void SetDictionaryColumn(std::size_t column, const DictionaryColumn &values) {
+    fDictionaries[column] = &values;
+  }
+  const DictionaryColumn &GetDictionaryColumn(std::size_t column) const {
+    return *fDictionaries[column];
+  }
+
+  std::int64_t GetNEntries() const { return fNEntries; }
+
+  template <std::size_t I>
+  auto Get(std::int64_t entry) const {
+    using T = std::tuple_element_t<I, std::tuple<Ts...>>;
+    using Element_t = typename ColumnTraits<T>::Element_t;
+    if constexpr ((kDictionaryColumns >> I) & 1) {
+      static_assert(std::is_same_v<Element_t, std::int32_t>);
+      const auto &column = *fDictionaries[I];
+      if constexpr (ColumnTraits<T>::kIsList) {
+        auto first = column.offsets[entry];
+        return DictionaryRange<Element_t>(column.dictionary.data(),
+                                          column.indices.data() + first,
+                                          column.offsets[entry + 1] - first);
+      } else {
+        return column.dictionary[column.indices[entry]];
+      }
+    } else if constexpr (ColumnTraits<T>::kIsList) {
+      const auto *offsets = fOffsets[I];
+      return ValueRange<Element_t>(
+          static_cast<const Element_t *>(fValues[I]) + offsets[entry],
+          offsets[entry + 1] - offsets[entry]);
+    } else {
+      return static_cast<const T *>(fValues[I])[entry];
+    }
+  }
+
+private:
+  template <std::size_t... Is>
+  void BindAll(const ArrowBinding<Schema<Ts...>> &binding,
+               const arrow::RecordBatch &batch, std::index_sequence<Is...>) {
+    (Bind<Is>(binding, batch), ...);
+  }
+  template <std::size_t I>
+  void Bind(const ArrowBinding<Schema<Ts...>> &binding,
+            const arrow::RecordBatch &batch) {
+    using T = std::tuple_element_t<I, std::tuple<Ts...>>;
+    using Element_t = typename ColumnTraits<T>::Element_t;
+    static_assert(!std::is_same_v<Element_t, bool>,
+                  "bit-packed columns are not supported");
+    auto position = binding.GetPosition(I);
+    if (position < 0)
+      return;
+    const arrow::ArrayData &data = *batch.column_data(position);
+    if constexpr (ColumnTraits<T>::kIsList) {
+      fOffsets[I] = data.GetValues<std::int32_t>(1);
+      fValues[I] = data.child_data[0]->GetValues<Element_t>(1);
+    } else {
+      fValues[I] = data.GetValues<T>(1);
+    }
+  }
+
+  std::int64_t fNEntries;
+  std::array<const void *, sizeof...(Ts)> fValues{};
+  std::array<const std::int32_t *, sizeof...(Ts)> fOffsets{};
+  std::array<const DictionaryColumn *, sizeof...(Ts)> fDictionaries{};
+};
+
+template <typename SchemaT>
+ArrowBatch(const ArrowBinding<SchemaT> &, const arrow::RecordBatch &)
+    -> ArrowBatch<SchemaT>;
+
+// A column read through an RNTuple view
+template <typename T>
+class RNTupleColumn {
+public:
+  RNTupleColumn(ROOT::RNTupleReader &reader, const std::string &name)
+      : fView(reader.GetView<T>(name)) {}
+
+  T Get(ROOT::NTupleSize_t entry) { return fView(entry); }
+
+private:
+  ROOT::RNTupleView<T> fView;
+};
+
+// A list column read through a collection view, element by element
+template <typename T>
+class RNTupleColumn<ROOT::RVec<T>> {
+public:
+  class Range {
+  public:
+    Range(ROOT::RNTupleView<T> &items, ROOT::RNTupleLocalIndex first,
+          std::size_t size)
+        : fItems(items), fFirst(first), fSize(size) {}
+
+    std::size_t size() const { return fSize; }
+    T operator[](std::size_t i) const {
+      return fItems(ROOT::RNTupleLocalIndex(fFirst.GetClusterId(),
+                                            fFirst.GetIndexInCluster() + i));
+    }
+
+  private:
+    ROOT::RNTupleView<T> &fItems;
+    ROOT::RNTupleLocalIndex fFirst;
+    std::size_t fSize;
+  };
+
+  RNTupleColumn(ROOT::RNTupleReader &reader, const std::string &name)
+      : fCollection(reader.GetCollectionView(name)),
+        fItems(fCollection.GetView<T>("_0")) {}
+
+  // Takes the entry ranges from the offsets of `other`, which has the same
+  // number of elements per entry, so that only one offset column is read
+  template <typename U>
+  void ShareOffsets(RNTupleColumn<ROOT::RVec<U>> &other) {
+    fOffsets = &other.fCollection;
+  }
+
+  Range Get(ROOT::NTupleSize_t entry) {
+    auto range = (fOffsets ? *fOffsets : fCollection).GetCollectionRange(entry);
+    return Range(fItems, *range.begin(), range.size());
+  }
+
+private:
+  template <typename U>
+  friend class RNTupleColumn;
+
+  ROOT::RNTupleCollectionView fCollection;
+  ROOT::RNTupleView<T> fItems;
+  ROOT::RNTupleCollectionView *fOffsets = nullptr;
+};
+
+template <typename SchemaT>
+class RNTupleBatch;
+
+// Typed access to the entries of one cluster of an RNTuple, with the same
+// interface as ArrowBatch. Views are only created for the given columns, so
+// that the pages of the other columns are not loaded.
+template <typename... Ts>
+class RNTupleBatch<Schema<Ts...>> {
+public:
+  RNTupleBatch(const Schema<Ts...> &schema, ROOT::RNTupleReader &reader,
+               const std::vector<std::size_t> &columns) {
+    Open(schema, reader, columns, std::index_sequence_for<Ts...>{});
+  }
+
+  void SetEntryRange(std::uint64_t firstEntry, std::uint64_t lastEntry) {
+    fFirstEntry = firstEntry;
+    fNEntries = lastEntry - firstEntry;
+  }
+
+  std::int64_t GetNEntries() const { return fNEntries; }
+
+  // See RNTupleColumn::ShareOffsets, both columns must be read
+  template <std::size_t I, std::size_t J>
+  void ShareOffsets() {
+    std::get<I>(fColumns)->ShareOffsets(*std::get<J>(fColumns));
+  }
+
+  template <std::size_t I>
+  auto Get(std::int64_t entry) {
+    return std::get<I>(fColumns)->Get(fFirstEntry + entry);
+  }
+
+private:
+  template <std::size_t... Is>
+  void Open(const Schema<Ts...> &schema, ROOT::RNTupleReader &reader,
+            const std::vector<std::size_t> &columns,
+            std::index_sequence<Is...>) {
+    ((std::find(columns.begin(), columns.end(), Is) != columns.end()
+          ? (void)std::get<Is>(fColumns).emplace(reader, schema.GetName(Is))
+          : (void)0),
+     ...);
+  }
+
+  std::tuple<std::optional<RNTupleColumn<Ts>>...> fColumns;
+  std::uint64_t fFirstEntry = 0;
+  std::int64_t fNEntries = 0;
+};
+
+// Value of column I of an entry of an ArrowBatch or RNTupleBatch
+template <std::size_t I, typename BatchT>
+auto get_column(BatchT &batch, std::int64_t entry) {
+  return batch.template Get<I>(entry);
+}
+
+// Whether column I of the batch is read from a DictionaryColumn
+template <typename BatchT, std::size_t I>
+constexpr bool kIsDictionaryColumn = false;
+template <typename SchemaT, std::uint64_t kDictionaryColumns, std::size_t I>
+constexpr bool kIsDictionaryColumn<ArrowBatch<SchemaT, kDictionaryColumns>, I> =
+    (kDictionaryColumns >> I) & 1;
+
+// A cut on the values of the flat column I of a batch. For a dictionary column,
+// the cut is evaluated once per dictionary entry and looked up by the index of
+// every entry; otherwise it is evaluated on the value of every entry.
+template <std::size_t I, typename BatchT, typename CutT>
+class ColumnCut {
+public:
+  ColumnCut(const BatchT &batch, CutT cut) : fCut(std::move(cut)) {
+    if constexpr (kIsDictionaryColumn<BatchT, I>) {
+      const auto &column = batch.GetDictionaryColumn(I);
+      fPassing = evaluate_on_dictionary(column, fCut);
+      fIndices = column.indices.data();
+    }
+  }
+
+  bool operator()(BatchT &batch, std::int64_t entry) const {
+    if constexpr (kIsDictionaryColumn<BatchT, I>)
+      return fPassing[fIndices[entry]];
+    else
+      return fCut(get_column<I>(batch, entry));
+  }
+
+private:
+  CutT fCut;
+  std::vector<char> fPassing;
+  const std::int32_t *fIndices = nullptr;
+};
+
+template <std::size_t I, typename BatchT, typename CutT>
+ColumnCut<I, BatchT, CutT> make_column_cut(const BatchT &batch, CutT cut) {
+  return ColumnCut<I, BatchT, CutT>(batch, std::move(cut));
+}
+
+// Whether elements i and j of a list column entry are equal. Equal dictionary
+// indices are equal without looking up their values; the dictionary need not
+// be free of duplicates, so different indices are compared by value.
+template <typename RangeT>
+bool same_value(const RangeT &values, std::size_t i, std::size_t j) {
+  return values[i] == values[j];
+}
+template <typename T>
+bool same_value(const DictionaryRange<T> &values, std::size_t i,
+                std::size_t j) {
+  return values.GetIndex(i) == values.GetIndex(j) || values[i] == values[j];
+}
+
 template <typename T>
 void print_vec(const ROOT::RVec<T> &vec) {
   std::cout << "{ ";
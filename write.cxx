@@ -0,0 +1,550 @@
+// Measures the write throughput of the three formats, by writing the contents
+// of an input file (any format) with the given codec, compression level and
+// number of entries per cluster, row group or stripe. The defaults mirror the
+// settings of `convert.py -m`.
+
+#include <Compression.h>
+#include <ROOT/REntry.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleParallelWriter.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleWriteOptions.hxx>
+
+#include <arrow/adapters/orc/adapter.h>
+#include <arrow/io/file.h>
+#include <arrow/util/byte_size.h>
+#include <arrow/util/thread_pool.h>
+#include <parquet/arrow/schema.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include "util.hxx"
+
+enum class Codec { none, zstd, lz4, zlib };
+
+struct WriteOptions {
+  std::string input_path;
+  std::string output_path;
+  std::string ntuple_name = "Events";
+  Codec codec = Codec::zstd;
+  // -1 for the level used by convert.py: 1 for RNTuple, 3 for Parquet and the
+  // codec default for ORC
+  int level = -1;
+  // Entries per cluster, row group or stripe, 0 for the average of the input
+  std::uint64_t unit_size = 0;
+  unsigned n_threads = 1;
+  // Columns to dictionary encode, or "all". As convert.py, no column is
+  // dictionary encoded by default.
+  std::vector<std::string> dictionary_columns;
+};
+
+// The contents of the input file
+struct InputData {
+  std::shared_ptr<arrow::RecordBatch> batch;
+  std::uint64_t entries_per_unit = 0;
+};
+
+static bool parse_codec(std::string_view name, Codec *codec) {
+  if (name == "none")
+    *codec = Codec::none;
+  else if (name == "zstd")
+    *codec = Codec::zstd;
+  else if (name == "lz4")
+    *codec = Codec::lz4;
+  else if (name == "zlib")
+    *codec = Codec::zlib;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_write_options(int argc, char **argv, WriteOptions *opts) {
+  static const struct option longOptions[] = {
+      {"ntuple", required_argument, nullptr, 'n'},
+      {"codec", required_argument, nullptr, 'c'},
+      {"level", required_argument, nullptr, 'l'},
+      {"unit-size", required_argument, nullptr, 'u'},
+      {"threads", required_argument, nullptr, 't'},
+      {"dictionary", required_argument, nullptr, 'd'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "n:c:l:u:t:d:h", longOptions, nullptr)) !=
+         -1) {
+    switch (c) {
+    case 'n':
+      opts->ntuple_name = optarg;
+      break;
+    case 'c':
+      if (!parse_codec(optarg, &opts->codec)) {
+        std::cerr << "Invalid codec: " << optarg << std::endl;
+        return false;
+      }
+      break;
+    case 'l':
+      opts->level = std::stoi(optarg);
+      break;
+    case 'u':
+      opts->unit_size = std::stoull(optarg);
+      break;
+    case 't':
+      opts->n_threads = std::stoul(optarg);
+      if (opts->n_threads == 0)
+        opts->n_threads = std::thread::hardware_concurrency();
+      break;
+    case 'd': {
+      std::istringstream is(optarg);
+      std::string column;
+      while (std::getline(is, column, ','))
+        opts->dictionary_columns.push_back(column);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+
+  if (optind + 2 != argc)
+    return false;
+  opts->input_path = argv[optind++];
+  opts->output_path = argv[optind++];
+  return true;
+}
+
+static void print_write_usage(const char *progname) {
+  printf("%s [OPTIONS] INPUT_PATH OUTPUT_PATH\n\n", progname);
+  printf("Options:\n");
+  printf("  -n, --ntuple NAME       name of the RNTuple to read or write "
+         "(default: Events)\n");
+  printf("  -c, --codec CODEC       none, zstd, lz4 or zlib (default: zstd)\n");
+  printf("  -l, --level N           compression level (default: as "
+         "convert.py)\n");
+  printf("  -u, --unit-size N       entries per cluster, row group or stripe, "
+         "0 to mirror the input (default: 0)\n");
+  printf("  -t, --threads N         number of writer threads, 0 for all cores "
+         "(default: 1)\n");
+  printf("  -d, --dictionary COLS   comma-separated columns to dictionary "
+         "encode, or all (Parquet\n"
+         "                          only) (default: none)\n");
+}
+
+static InputData read_input(const WriteOptions &opts) {
+  InputData input;
+  auto fmt = get_file_format(get_path_suffix(opts.input_path));
+  if (fmt == FileFormat::rntuple) {
+    auto ntuple =
+        open_rntuple(opts.ntuple_name, opts.input_path, AnalysisOptions());
+    const auto &desc = ntuple->GetDescriptor();
+    std::vector<std::string> fieldNames;
+    for (const auto &field : desc.GetTopLevelFields())
+      fieldNames.push_back(field.GetFieldName());
+    input.batch =
+        read_rntuple_batch(*ntuple, fieldNames, 0, desc.GetNEntries());
+    input.entries_per_unit =
+        desc.GetNEntries() / std::max<std::size_t>(desc.GetNClusters(), 1);
+    return input;
+  }
+
+  auto table = open_arrow(opts.input_path, fmt);
+  PARQUET_ASSIGN_OR_THROW(input.batch, table->CombineChunksToBatch());
+  std::int64_t nUnits;
+  if (fmt == FileFormat::parquet) {
+    nUnits = parquet::ParquetFileReader::OpenFile(opts.input_path)
+                 ->metadata()
+                 ->num_row_groups();
+  } else {
+    std::shared_ptr<arrow::io::ReadableFile> file;
+    PARQUET_ASSIGN_OR_THROW(file,
+                            arrow::io::ReadableFile::Open(opts.input_path));
+    std::unique_ptr<arrow::adapters::orc::ORCFileReader> reader;
+    PARQUET_ASSIGN_OR_THROW(reader, arrow::adapters::orc::ORCFileReader::Open(
+                                        file, arrow::default_memory_pool()));
+    nUnits = reader->NumberOfStripes();
+  }
+  input.entries_per_unit =
+      input.batch->num_rows() / std::max<std::int64_t>(nUnits, 1);
+  return input;
+}
+
+static bool encode_all_columns(const std::vector<std::string> &columns) {
+  return columns.size() == 1 && columns[0] == "all";
+}
+
+static arrow::Compression::type get_arrow_compression(Codec codec) {
+  switch (codec) {
+  case Codec::zstd:
+    return arrow::Compression::ZSTD;
+  case Codec::lz4:
+    return arrow::Compression::LZ4;
+  case Codec::zlib:
+    return arrow::Compression::GZIP;
+  default:
+    return arrow::Compression::UNCOMPRESSED;
+  }
+}
+
+// Copies the value of a flat column into its field of the RNTuple entry
+template <typename T>
+class ValueCopier {
+public:
+  using ArrayType = typename arrow::TypeTraits<
+      typename RootConversionTraits<T>::ArrowType>::ArrayType;
+
+  ValueCopier(const arrow::Array &array, const std::string &name,
+              ROOT::REntry &entry)
+      : fValues(static_cast<const ArrayType &>(array)),
+        fValue(entry.GetPtr<T>(name)) {}
+
+  void Copy(std::int64_t entryId) {
+    if constexpr (std::is_same_v<T, bool>)
+      *fValue = fValues.Value(entryId);
+    else
+      *fValue = fValues.raw_values()[entryId];
+  }
+
+private:
+  const ArrayType &fValues;
+  std::shared_ptr<T> fValue;
+};
+
+// Points the RVec field of the RNTuple entry at the elements of a list column
+template <typename T>
+class ListCopier {
+public:
+  using ArrayType = typename arrow::TypeTraits<
+      typename RootConversionTraits<T>::ArrowType>::ArrayType;
+
+  ListCopier(const arrow::Array &array, const std::string &name,
+             ROOT::REntry &entry)
+      : fList(static_cast<const arrow::ListArray &>(array)),
+        fValues(static_cast<const ArrayType &>(*fList.values())),
+        fVec(entry.GetPtr<ROOT::RVec<T>>(name)) {}
+
+  void Copy(std::int64_t entryId) {
+    auto first = fList.value_offset(entryId);
+    auto size = fList.value_length(entryId);
+    if constexpr (std::is_same_v<T, bool>) {
+      // Booleans are stored as a bitmap, copy them one by one
+      fVec->resize(size);
+      for (std::int32_t i = 0; i < size; ++i)
+        (*fVec)[i] = fValues.Value(first + i);
+    } else {
+      // The RVec adopts the memory of the Arrow array
+      ROOT::RVec<T> elements(const_cast<T *>(fValues.raw_values() + first),
+                             size);
+      std::swap(elements, *fVec);
+    }
+  }
+
+private:
+  const arrow::ListArray &fList;
+  const ArrayType &fValues;
+  std::shared_ptr<ROOT::RVec<T>> fVec;
+};
+
+template <typename TypesT>
+class EntryCopier;
+
+// Copies one entry of the record batch into the RNTuple entry. The columns are
+// grouped by type, so that every entry is copied by one loop per column type.
+template <typename... Ts>
+class EntryCopier<TypeList<Ts...>> {
+public:
+  EntryCopier(const arrow::RecordBatch &batch, ROOT::REntry &entry) {
+    for (int col = 0; col < batch.num_columns(); ++col) {
+      const auto &array = *batch.column(col);
+      const auto &name = batch.schema()->field(col)->name();
+      bool isList = array.type_id() == arrow::Type::LIST;
+      auto valueType = isList ? array.type()->field(0)->type()->id()
+                              : array.type_id();
+      visit_arrow_type(valueType, [&](auto tag) {
+        using T = typename decltype(tag)::Type;
+        if (isList)
+          std::get<std::vector<ListCopier<T>>>(fLists).emplace_back(array, name,
+                                                                    entry);
+        else
+          std::get<std::vector<ValueCopier<T>>>(fValues).emplace_back(
+              array, name, entry);
+      });
+    }
+  }
+
+  void Copy(std::int64_t entryId) {
+    auto copyAll = [entryId](auto &...copiers) {
+      (CopyEach(copiers, entryId), ...);
+    };
+    std::apply(copyAll, fValues);
+    std::apply(copyAll, fLists);
+  }
+
+private:
+  template <typename CopierT>
+  static void CopyEach(std::vector<CopierT> &copiers, std::int64_t entryId) {
+    for (auto &copier : copiers)
+      copier.Copy(entryId);
+  }
+
+  std::tuple<std::vector<ValueCopier<Ts>>...> fValues;
+  std::tuple<std::vector<ListCopier<Ts>>...> fLists;
+};
+
+static void write_rntuple(const WriteOptions &opts, const InputData &input) {
+  const auto &batch = *input.batch;
+  if (!opts.dictionary_columns.empty())
+    std::cerr << "RNTuple has no dictionary encoding, ignoring --dictionary"
+              << std::endl;
+
+  auto model = ROOT::RNTupleModel::CreateBare();
+  std::vector<std::string> typeNames;
+  for (const auto &field : batch.schema()->fields()) {
+    bool isList = field->type()->id() == arrow::Type::LIST;
+    auto valueType =
+        isList ? field->type()->field(0)->type()->id() : field->type()->id();
+    std::string typeName;
+    visit_arrow_type(valueType, [&](auto tag) {
+      typeName = RootConversionTraits<typename decltype(tag)::Type>::kTypeName;
+    });
+    if (typeName.empty())
+      throw std::runtime_error("unsupported type " +
+                               field->type()->ToString() + " of column " +
+                               field->name());
+    typeNames.push_back(typeName);
+    if (isList)
+      typeName = "ROOT::VecOps::RVec<" + typeName + ">";
+    model->AddField(ROOT::RFieldBase::Create(field->name(), typeName).Unwrap());
+  }
+
+  int algorithm;
+  switch (opts.codec) {
+  case Codec::zstd:
+    algorithm = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+    break;
+  case Codec::lz4:
+    algorithm = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+    break;
+  case Codec::zlib:
+    algorithm = ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+    break;
+  default:
+    algorithm = 0;
+  }
+  ROOT::RNTupleWriteOptions writeOptions;
+  writeOptions.SetCompression(
+      algorithm ? algorithm * 100 + (opts.level < 0 ? 1 : opts.level) : 0);
+  // Clusters are flushed explicitly after unit_size entries
+  writeOptions.SetApproxZippedClusterSize(std::size_t(1) << 40);
+  writeOptions.SetMaxUnzippedClusterSize(std::size_t(1) << 40);
+
+  auto writer = ROOT::RNTupleParallelWriter::Recreate(
+      std::move(model), opts.ntuple_name, opts.output_path, writeOptions);
+
+  // Every thread fills a contiguous share of the entries into its own clusters
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < opts.n_threads; ++i) {
+    threads.emplace_back([&, i]() {
+      auto fillContext = writer->CreateFillContext();
+      auto entry = fillContext->CreateEntry();
+
+      EntryCopier<NumberTypes_t> copier(batch, *entry);
+
+      auto entries =
+          get_unit_range(batch.num_rows(), WorkerSlice{i, opts.n_threads});
+      std::uint64_t nInCluster = 0;
+      for (auto entryId = entries.first; entryId < entries.second;
+           ++entryId) {
+        copier.Copy(entryId);
+        fillContext->Fill(*entry);
+        if (++nInCluster == opts.unit_size) {
+          fillContext->FlushCluster();
+          nInCluster = 0;
+        }
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+}
+
+static void write_parquet(const WriteOptions &opts, const InputData &input) {
+  // As convert.py: 1 MiB pages, no statistics and no dictionary encoding
+  // unless requested
+  parquet::WriterProperties::Builder builder;
+  builder.compression(get_arrow_compression(opts.codec))
+      ->data_pagesize(1024 * 1024)
+      ->max_row_group_length(opts.unit_size)
+      ->disable_statistics()
+      ->disable_dictionary();
+  if (encode_all_columns(opts.dictionary_columns)) {
+    builder.enable_dictionary();
+  } else if (!opts.dictionary_columns.empty()) {
+    // Dictionary encoding is enabled by the path of the leaf column
+    std::shared_ptr<parquet::SchemaDescriptor> schema;
+    PARQUET_THROW_NOT_OK(parquet::arrow::ToParquetSchema(
+        input.batch->schema().get(), *parquet::default_writer_properties(),
+        &schema));
+    for (const auto &name : opts.dictionary_columns)
+      builder.enable_dictionary(
+          schema->Column(get_leaf_column(*schema, name))->path());
+  }
+  if (opts.level >= 0)
+    builder.compression_level(opts.level);
+  else if (opts.codec == Codec::zstd)
+    builder.compression_level(3);
+
+  PARQUET_THROW_NOT_OK(arrow::SetCpuThreadPoolCapacity(opts.n_threads));
+  auto arrowProperties = parquet::ArrowWriterProperties::Builder()
+                             .set_use_threads(opts.n_threads > 1)
+                             ->build();
+
+  std::shared_ptr<arrow::io::FileOutputStream> output;
+  PARQUET_ASSIGN_OR_THROW(output,
+                          arrow::io::FileOutputStream::Open(opts.output_path));
+  std::unique_ptr<parquet::arrow::FileWriter> writer;
+  PARQUET_ASSIGN_OR_THROW(
+      writer, parquet::arrow::FileWriter::Open(
+                  *input.batch->schema(), arrow::default_memory_pool(), output,
+                  builder.build(), arrowProperties));
+
+  // Every unit_size entries go into their own row group, whose columns are
+  // encoded on the CPU pool
+  const auto &batch = *input.batch;
+  for (std::int64_t offset = 0; offset < batch.num_rows();
+       offset += opts.unit_size) {
+    PARQUET_THROW_NOT_OK(writer->NewBufferedRowGroup());
+    PARQUET_THROW_NOT_OK(
+        writer->WriteRecordBatch(*batch.Slice(offset, opts.unit_size)));
+  }
+  PARQUET_THROW_NOT_OK(writer->Close());
+  PARQUET_THROW_NOT_OK(output->Close());
+}
+
+static void write_orc(const WriteOptions &opts, const InputData &input) {
+  if (opts.level >= 0)
+    std::cerr << "the ORC writer does not support compression levels, "
+                 "ignoring --level"
+              << std::endl;
+  if (opts.n_threads > 1)
+    std::cerr << "the ORC writer is single-threaded, ignoring --threads"
+              << std::endl;
+  // ORC only has dictionaries for strings
+  if (!opts.dictionary_columns.empty())
+    std::cerr << "the ORC writer does not dictionary encode numbers, "
+                 "ignoring --dictionary"
+              << std::endl;
+
+  // As convert.py: 1 MiB compression blocks. Stripes are limited in bytes, so
+  // the stripe size is derived from the average (uncompressed) entry size.
+  arrow::adapters::orc::WriteOptions writeOptions;
+  writeOptions.compression = get_arrow_compression(opts.codec);
+  writeOptions.compression_block_size = 1024 * 1024;
+  auto entrySize = static_cast<double>(arrow::util::TotalBufferSize(
+                       *input.batch)) /
+                   std::max<std::int64_t>(input.batch->num_rows(), 1);
+  writeOptions.stripe_size =
+      std::max<std::int64_t>(opts.unit_size * entrySize, 1024 * 1024);
+
+  std::shared_ptr<arrow::io::FileOutputStream> output;
+  PARQUET_ASSIGN_OR_THROW(output,
+                          arrow::io::FileOutputStream::Open(opts.output_path));
+  std::unique_ptr<arrow::adapters::orc::ORCFileWriter> writer;
+  PARQUET_ASSIGN_OR_THROW(writer, arrow::adapters::orc::ORCFileWriter::Open(
+                                      output.get(), writeOptions));
+  PARQUET_THROW_NOT_OK(writer->Write(*input.batch));
+  PARQUET_THROW_NOT_OK(writer->Close());
+  PARQUET_THROW_NOT_OK(output->Close());
+}
+
+// Reads a value in kB from /proc/self/status
+static std::uint64_t get_status_kb(const std::string &key) {
+  std::ifstream is("/proc/self/status");
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.rfind(key + ":", 0) == 0)
+      return std::stoull(line.substr(key.size() + 1));
+  }
+  return 0;
+}
+
+static std::uint64_t get_cpu_time() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int main(int argc, char **argv) {
+  WriteOptions opts;
+  if (!parse_write_options(argc, argv, &opts)) {
+    print_write_usage(argv[0]);
+    return 1;
+  }
+
+  FileFormat fmt;
+  InputData input;
+  try {
+    fmt = get_file_format(get_path_suffix(opts.output_path));
+    input = read_input(opts);
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if (opts.unit_size == 0)
+    opts.unit_size = std::max<std::uint64_t>(input.entries_per_unit, 1);
+
+  // Only count the memory used for writing: reset the peak resident set size
+  // to the current one, which includes the input data
+  std::ofstream("/proc/self/clear_refs") << "5";
+  auto rssBefore = get_status_kb("VmRSS");
+  auto cpu_start = get_cpu_time();
+  auto ts_start = std::chrono::steady_clock::now();
+
+  switch (fmt) {
+  case FileFormat::rntuple:
+    write_rntuple(opts, input);
+    break;
+  case FileFormat::parquet:
+    write_parquet(opts, input);
+    break;
+  case FileFormat::orc:
+    write_orc(opts, input);
+    break;
+  }
+
+  auto ts_end = std::chrono::steady_clock::now();
+  auto runtime_write =
+      std::chrono::duration_cast<std::chrono::microseconds>(ts_end - ts_start)
+          .count();
+  auto runtime_cpu = get_cpu_time() - cpu_start;
+  auto peakMemory = (get_status_kb("VmHWM") - rssBefore) * 1024;
+  auto fileSize = std::filesystem::file_size(opts.output_path);
+  // Throughput of the uncompressed data, in MB/s
+  auto throughput =
+      static_cast<double>(arrow::util::TotalBufferSize(*input.batch)) /
+      std::max<std::int64_t>(runtime_write, 1);
+
+  std::cerr << input.batch->num_rows() << " entries, " << opts.unit_size
+            << " per unit" << std::endl;
+  std::cout << runtime_write << ", " << runtime_cpu << ", " << peakMemory
+            << ", " << fileSize << ", " << throughput << std::endl;
+
+  return 0;
+}